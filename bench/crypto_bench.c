@@ -0,0 +1,250 @@
+#include "../include/crypto/crypto.h"
+
+#include <openssl/crypto.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Times the crypto layer on its own: crypto_encrypt/crypto_decrypt for every
+ * legacy cipher and mode over payloads growing 4x from 64 B to 1 GiB, plus the
+ * key derivation with a cold and a warm key cache. Cipher timings use a raw
+ * key so PBKDF2 never lands inside them. One CSV row per measurement; MB/s
+ * counts 10^6 bytes.
+ *
+ *     stegobmp_crypto_bench [-out <csv>] [-max <bytes>] [-min-time <ms>]
+ */
+
+#define BENCH_MIN_PAYLOAD_SIZE 64
+#define BENCH_MAX_PAYLOAD_SIZE (1024ULL * 1024 * 1024)
+#define BENCH_PAYLOAD_SIZE_STEP 4
+#define BENCH_DEFAULT_MIN_TIME_MS 200
+#define BENCH_NS_PER_MS 1000000ULL
+#define BENCH_NS_PER_S 1000000000.0
+#define BENCH_BYTES_PER_MB 1000000.0
+#define BENCH_PASSWORD "stegobmp benchmark password"
+#define BENCH_CSV_HEADER "operation,method,mode,payload_bytes,iterations,ns_per_op,mb_per_s\n"
+
+static const char *bench_methods[] = { "aes128", "aes192", "aes256", "3des" };
+static const char *bench_modes[] = { "ecb", "cbc", "cfb", "ofb" };
+
+typedef struct {
+    FILE *csv;
+    uint64_t max_payload_size;
+    uint64_t min_time_ns;
+} BenchOptions;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static unsigned char pattern_byte(const size_t index) {
+    return (unsigned char) (index * 31u + (index >> 8));
+}
+
+static void fill_pattern(unsigned char *buffer, const size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        buffer[i] = pattern_byte(i);
+    }
+}
+
+static int pattern_matches(const unsigned char *buffer, const size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (buffer[i] != pattern_byte(i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void write_row(const BenchOptions *options, const char *operation, const char *method, const char *mode,
+                      const uint64_t payload_size, const uint64_t iterations, const uint64_t elapsed_ns) {
+    const double ns_per_op = (double) elapsed_ns / (double) iterations;
+    fprintf(options->csv, "%s,%s,%s,%llu,%llu,%.1f,", operation, method, mode,
+            (unsigned long long) payload_size, (unsigned long long) iterations, ns_per_op);
+    if (payload_size > 0) {
+        fprintf(options->csv, "%.2f", (double) payload_size * (double) iterations / ((double) elapsed_ns / BENCH_NS_PER_S) / BENCH_BYTES_PER_MB);
+    }
+    fputc('\n', options->csv);
+    fflush(options->csv);
+}
+
+/* PBKDF2 on a cleared cache, then the cache hit every later operation pays */
+static int bench_derive_key(const BenchOptions *options, const char *method) {
+    const CryptoCipher *cipher = crypto_cipher_lookup(method, "cbc");
+    if (!cipher) {
+        printf("Error: Unsupported cipher method %s\n", method);
+        return 1;
+    }
+
+    const CryptoSecret secret = crypto_secret_password(BENCH_PASSWORD);
+    const unsigned char salt[CRYPTO_SALT_SIZE] = {0};
+    unsigned char key[CRYPTO_MAX_KEY_SIZE];
+
+    for (int warm = 0; warm <= 1; warm++) {
+        uint64_t iterations = 0;
+        uint64_t elapsed = 0;
+        while (elapsed < options->min_time_ns) {
+            if (!warm) {
+                crypto_key_cache_clear();
+            }
+            const uint64_t start = now_ns();
+            if (crypto_derive_key(cipher, &secret, salt, key)) {
+                return 1;
+            }
+            elapsed += now_ns() - start;
+            iterations++;
+        }
+        write_row(options, warm ? "derive_key_cached" : "derive_key", method, cipher->mode, 0, iterations, elapsed);
+    }
+
+    OPENSSL_cleanse(key, sizeof(key));
+    return 0;
+}
+
+static int bench_cipher(const BenchOptions *options, const char *method, const char *mode,
+                        unsigned char *plain, unsigned char *ciphertext) {
+    const CryptoCipher *cipher = crypto_cipher_lookup(method, mode);
+    if (!cipher) {
+        printf("Error: Unsupported cipher method (%s) or mode (%s)\n", method, mode);
+        return 1;
+    }
+
+    unsigned char key[CRYPTO_MAX_KEY_SIZE];
+    for (int i = 0; i < cipher->key_length; i++) {
+        key[i] = (unsigned char) (i * 7 + 1);
+    }
+    const CryptoSecret secret = crypto_secret_key(key, (size_t) cipher->key_length);
+    const unsigned char salt[CRYPTO_SALT_SIZE] = {0};
+    unsigned char iv[CRYPTO_MAX_IV_SIZE];
+    memset(iv, 0xA5, sizeof(iv));
+
+    for (uint64_t size = BENCH_MIN_PAYLOAD_SIZE; size <= options->max_payload_size; size *= BENCH_PAYLOAD_SIZE_STEP) {
+        fill_pattern(plain, (size_t) size);
+
+        int cipher_length = -1;
+        uint64_t iterations = 0;
+        uint64_t elapsed = 0;
+        while (elapsed < options->min_time_ns) {
+            const uint64_t start = now_ns();
+            cipher_length = crypto_encrypt(plain, (int) size, method, mode, &secret, salt, iv, ciphertext);
+            elapsed += now_ns() - start;
+            iterations++;
+            if (cipher_length < 0) {
+                return 1;
+            }
+        }
+        write_row(options, "encrypt", method, mode, size, iterations, elapsed);
+
+        /* decrypts over the plain buffer, which must come back as the pattern */
+        int plain_length = -1;
+        iterations = 0;
+        elapsed = 0;
+        while (elapsed < options->min_time_ns) {
+            const uint64_t start = now_ns();
+            plain_length = crypto_decrypt(ciphertext, cipher_length, method, mode, &secret, salt, iv, plain);
+            elapsed += now_ns() - start;
+            iterations++;
+            if (plain_length < 0) {
+                return 1;
+            }
+        }
+        if ((uint64_t) plain_length != size || !pattern_matches(plain, (size_t) size)) {
+            printf("Error: %s-%s round trip of %llu bytes does not match\n", method, mode, (unsigned long long) size);
+            return 1;
+        }
+        write_row(options, "decrypt", method, mode, size, iterations, elapsed);
+    }
+
+    OPENSSL_cleanse(key, sizeof(key));
+    return 0;
+}
+
+static int parse_options(const int argc, char *argv[], BenchOptions *options, const char **csv_filename) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            printf("Error: Missing argument for %s\n", argv[i]);
+            return 1;
+        }
+        char *end = NULL;
+        if (strcmp(argv[i], "-out") == 0) {
+            *csv_filename = argv[++i];
+        } else if (strcmp(argv[i], "-max") == 0) {
+            options->max_payload_size = strtoull(argv[++i], &end, 10);
+            if (!end || *end != '\0' || options->max_payload_size < BENCH_MIN_PAYLOAD_SIZE || options->max_payload_size > BENCH_MAX_PAYLOAD_SIZE) {
+                printf("Error: -max expects a size between %d and %llu bytes\n", BENCH_MIN_PAYLOAD_SIZE, BENCH_MAX_PAYLOAD_SIZE);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-min-time") == 0) {
+            const unsigned long long milliseconds = strtoull(argv[++i], &end, 10);
+            if (!end || *end != '\0' || milliseconds == 0) {
+                printf("Error: -min-time expects a positive number of milliseconds\n");
+                return 1;
+            }
+            options->min_time_ns = milliseconds * BENCH_NS_PER_MS;
+        } else {
+            printf("Usage: %s [-out <csv>] [-max <bytes>] [-min-time <ms>]\n", argv[0]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(const int argc, char *argv[]) {
+    BenchOptions options = {
+        .csv = stdout,
+        .max_payload_size = BENCH_MAX_PAYLOAD_SIZE,
+        .min_time_ns = BENCH_DEFAULT_MIN_TIME_MS * BENCH_NS_PER_MS
+    };
+    const char *csv_filename = NULL;
+    if (parse_options(argc, argv, &options, &csv_filename)) {
+        return 1;
+    }
+
+    if (csv_filename) {
+        options.csv = fopen(csv_filename, "w");
+        if (!options.csv) {
+            printf("Error: Could not open output file %s\n", csv_filename);
+            return 1;
+        }
+    }
+
+    unsigned char *plain = malloc((size_t) options.max_payload_size);
+    unsigned char *ciphertext = malloc((size_t) options.max_payload_size + CRYPTO_MAX_BLOCK_SIZE);
+    int status = 1;
+    if (!plain || !ciphertext) {
+        printf("Error: Could not allocate %llu byte benchmark buffers (lower -max)\n", (unsigned long long) options.max_payload_size);
+        goto cleanup;
+    }
+
+    fputs(BENCH_CSV_HEADER, options.csv);
+
+    const size_t method_count = sizeof(bench_methods) / sizeof(bench_methods[0]);
+    const size_t mode_count = sizeof(bench_modes) / sizeof(bench_modes[0]);
+    for (size_t m = 0; m < method_count; m++) {
+        if (bench_derive_key(&options, bench_methods[m])) {
+            goto cleanup;
+        }
+    }
+    for (size_t m = 0; m < method_count; m++) {
+        for (size_t d = 0; d < mode_count; d++) {
+            if (bench_cipher(&options, bench_methods[m], bench_modes[d], plain, ciphertext)) {
+                goto cleanup;
+            }
+        }
+    }
+    status = 0;
+
+cleanup:
+    free(plain);
+    free(ciphertext);
+    if (options.csv != stdout) {
+        fclose(options.csv);
+    }
+    return status;
+}
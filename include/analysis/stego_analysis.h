@@ -17,6 +17,10 @@ typedef struct {
     StegoAnalysisMethod method;
     size_t declared_payload_size;
     size_t extracted_payload_size;
+    /* declared size counts zlib bytes; save_extracted_file inflates them */
+    int compressed;
+    /* the payload carried a CRC32C trailer and it matched */
+    int checksum_verified;
     unsigned char *payload;
 } StegoAnalysisResult;
 
@@ -0,0 +1,49 @@
+#ifndef STEGO_STATISTICS_H
+#define STEGO_STATISTICS_H
+
+#include "../bmp/bmp.h"
+#include "../stegobmp/stegobmp_kernels.h"
+
+#include <stddef.h>
+
+/*
+ * Blind LSB steganalysis: unlike stego_analysis_run it does not need this
+ * tool's container layout, so it also flags payloads from other tools and
+ * bare ciphertext. Rates are the fraction of a channel's samples that carry
+ * a message bit (0 = clean, 1 = every LSB used).
+ */
+
+/* Rows are cut into this many slices for the chi-square prefix scan */
+#define STEGO_STATISTICS_SEGMENTS 32
+/* Pairs of values seen fewer times than this are left out of the chi-square sum */
+#define STEGO_STATISTICS_CHI_MIN_PAIR_COUNT 10
+/* A prefix (or a whole channel) whose chi-square p-value reaches this looks fully embedded */
+#define STEGO_STATISTICS_CHI_P_THRESHOLD 0.95
+/* Mean estimated rate from which a carrier is reported as suspicious */
+#define STEGO_STATISTICS_RATE_THRESHOLD 0.05
+
+typedef struct {
+    /* pair-of-values chi-square over the whole channel and its p-value;
+     * p close to 1 means 2k and 2k+1 were equalised by embedding */
+    double chi_square;
+    double chi_square_p_value;
+    /* share of the rows, from the first one stored, that still looks fully embedded */
+    double chi_square_prefix;
+    double rs_rate;
+    double sample_pair_rate;
+    /* mean of the RS and sample pair estimates */
+    double embedding_rate;
+} StegoChannelStatistics;
+
+typedef struct {
+    /* B, G, R, in the order the pixels store them */
+    StegoChannelStatistics channels[STEGOBMP_STAT_CHANNELS];
+    double embedding_rate;
+    double chi_square_prefix;
+    int suspicious;
+} StegoStatisticsResult;
+
+int stego_statistics_run(const BMP *bmp, StegoStatisticsResult *result);
+const char *stego_statistics_channel_name(size_t channel);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef STEGOBMP_BATCH_H
+#define STEGOBMP_BATCH_H
+
+#include "../parser/parser.h"
+
+#include <stddef.h>
+
+#define BATCH_COMMENT_CHARACTER '#'
+#define BATCH_QUOTE_CHARACTER '"'
+#define BATCH_PROGRAM_NAME "batch"
+/* Per-worker buffer for the reports of the running job, indented under its result line */
+#define BATCH_CAPTURE_INITIAL_SIZE 1024
+#define BATCH_CAPTURE_PREFIX_SIZE 16
+
+/* runs one parsed job and returns 0 on success (main.c's single-shot path) */
+typedef int (*batch_job_fn)(const ProgramArguments *arguments);
+
+/*
+ * Runs every job of a manifest on a pool of worker_count threads (0 picks the
+ * number of online CPUs). Each non-empty line that does not start with '#'
+ * holds the options of one -embed or -extract invocation, e.g.
+ *
+ *     -embed -in secret.txt -p carrier.bmp -out stego.bmp -steg LSBI -pass "two words"
+ *
+ * Tokens are split on whitespace; double quotes keep whitespace in a token.
+ * -analyze is rejected: its report is printed straight to stdout rather than
+ * through the job's diagnostics sink, so it would interleave with other jobs;
+ * -analyze -scan is the concurrent way to analyse many carriers.
+ * Prints one result line per job, followed by what that job reported, and
+ * returns 0 only when every job succeeded.
+ */
+int batch_run(const char *manifest_filename, size_t worker_count, batch_job_fn run_job);
+
+#endif //STEGOBMP_BATCH_H
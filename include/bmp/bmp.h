@@ -27,10 +27,20 @@ typedef struct
     int32_t compression;
     int32_t pixel_data_offset; // offset to pixel array from file start
     int32_t row_bytes;         // bytes per row including padding
+    unsigned char *mapping;    // MAP_PRIVATE view of the whole file, NULL when data is heap allocated
+    size_t mapping_size;
+    size_t dirty_begin;        // pixel bytes [dirty_begin, dirty_end) modified since bmp_read
+    size_t dirty_end;
 } BMP;
 
 BMP *bmp_read(const char *bmp_filename);
+// Reads the pixels into memory instead of mapping the file: for the multi-file
+// modes, where a carrier truncated while in use must fail one job, not fault the process
+BMP *bmp_read_copy(const char *bmp_filename);
 int bmp_write(BMP *bmp, const char *output_bmp_filename);
 void bmp_free(BMP *bmp);
 
+void bmp_mark_dirty(BMP *bmp, size_t begin, size_t end);
+int bmp_write_dirty_range(const BMP *bmp, const char *bmp_filename, int sync);
+
 #endif // STEGOBMP_BMP_H
\ No newline at end of file
@@ -1,18 +1,137 @@
 #ifndef STEGOBMP_CRYPTO_H
 #define STEGOBMP_CRYPTO_H
 
+#include <openssl/evp.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
 #define CRYPTO_SALT_SIZE 8
 #define CRYPTO_AES_IV_SIZE 16
 #define CRYPTO_3DES_IV_SIZE 32
 #define CRYPTO_MAX_IV_SIZE 16
 #define CRYPTO_METADATA_IV_LEN_SIZE 1
+/* Largest growth of a single update/final call (one extra cipher block) */
+#define CRYPTO_MAX_BLOCK_SIZE 32
+
+/* Authenticated modes (gcm, poly1305) append a tag and store a key check value */
+#define CRYPTO_AEAD_TAG_SIZE 16
+#define CRYPTO_KEY_CHECK_SIZE 8
+#define CRYPTO_KEY_CHECK_LABEL "stegobmp key check"
+
+/* Derived keys kept by the PBKDF2 cache (keyed on SHA-256 of the password) */
+#define CRYPTO_KEY_CACHE_CAPACITY 16
+#define CRYPTO_KEY_CACHE_DIGEST_SIZE 32
+
+/* ECB/CBC/CFB ciphertexts are split across threads in chunks of at least this many bytes */
+#define CRYPTO_PARALLEL_MIN_CHUNK_SIZE (4 * 1024 * 1024)
+#define CRYPTO_PARALLEL_MAX_THREADS 64
+
+/* Multi-recipient containers wrap a random data key under each password */
+#define CRYPTO_WRAP_SALT_SIZE 8
+#define CRYPTO_WRAP_OVERHEAD 8
+#define CRYPTO_WRAP_KEY_SIZE 32
+#define CRYPTO_WRAP_KDF_ITERATIONS 10000
+
+/* Idle EVP_CIPHER_CTX kept per thread for reuse */
+#define CRYPTO_CONTEXT_POOL_SIZE 4
+
+/* Longest raw key any supported cipher takes (AES-256, ChaCha20) */
+#define CRYPTO_MAX_KEY_SIZE 32
+
+typedef struct CryptoStream CryptoStream;
+
+/*
+ * What a cipher key comes from: a password run through PBKDF2 (and the key
+ * cache), or a key supplied as is, which must match the cipher key length.
+ */
+typedef struct {
+    const char *password;
+    const unsigned char *key;
+    size_t key_length;
+} CryptoSecret;
+
+/* A method/mode pair resolved once, with the sizes callers need to lay out a payload */
+typedef struct {
+    const char *method;
+    const char *mode;
+    const EVP_CIPHER *cipher;
+    int key_length;
+    int iv_length;
+    int block_size;
+    int aead;
+    int tag_length;
+} CryptoCipher;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+} CryptoKeyCacheStats;
+
+CryptoSecret crypto_secret_password(const char *password);
+CryptoSecret crypto_secret_key(const unsigned char *key, size_t key_length);
+/* 1 when the secret holds a non-empty password or a key */
+int crypto_secret_is_set(const CryptoSecret *secret);
+int crypto_secret_is_raw_key(const CryptoSecret *secret);
+
+/* Fills cipher->key_length bytes of key through the same path every operation
+ * uses (PBKDF2 behind the key cache, or the supplied key); 0 on success */
+int crypto_derive_key(const CryptoCipher *cipher, const CryptoSecret *secret, const unsigned char *salt, unsigned char *key);
+
+/* Returns a process-wide descriptor (never freed by the caller), NULL when unsupported */
+const CryptoCipher *crypto_cipher_lookup(const char *method, const char *mode);
 
+int crypto_cipher_encrypt(
+    const CryptoCipher *cipher,
+    const unsigned char *plain_text,
+    int plain_text_length,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    unsigned char *ciphertext
+    );
+
+int crypto_cipher_decrypt(
+    const CryptoCipher *cipher,
+    const unsigned char *ciphertext,
+    int cipher_text_length,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    unsigned char *plain_text
+    );
+
+/* Same output as crypto_cipher_decrypt on up to thread_count threads (0 = online
+ * CPUs; callers already running inside a worker pool pass 1). Falls back to one
+ * thread for OFB, short inputs or a single CPU. */
+int crypto_cipher_decrypt_parallel(
+    const CryptoCipher *cipher,
+    const unsigned char *ciphertext,
+    int cipher_text_length,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    unsigned char *plain_text,
+    int thread_count
+    );
+
+CryptoStream *crypto_cipher_stream_new(
+    const CryptoCipher *cipher,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    int encrypt
+    );
+
+/* Name-based wrappers around the descriptor API above */
 int crypto_encrypt(
     const unsigned char *plain_text,
     int plain_tex_lenght,
     const char *method,
     const char *mode,
-    const char *password,
+    const CryptoSecret *secret,
     const unsigned char *salt,
     const unsigned char *iv,
     unsigned char *ciphertext
@@ -23,7 +142,7 @@ int crypto_decrypt(
     int cipher_text_length,
     const char *method,
     const char *mode,
-    const char *password,
+    const CryptoSecret *secret,
     const unsigned char *salt,
     const unsigned char *iv,
     unsigned char *plain_text
@@ -32,4 +151,71 @@ int crypto_decrypt(
 int crypto_get_iv_length(const char *method, const char *mode);
 int crypto_get_block_size(const char *method, const char *mode);
 
+/* Incremental encryption/decryption: each update may emit up to
+ * input_length + CRYPTO_MAX_BLOCK_SIZE bytes, final up to CRYPTO_MAX_BLOCK_SIZE. */
+CryptoStream *crypto_stream_new(
+    const char *method,
+    const char *mode,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    int encrypt
+    );
+int crypto_stream_update(CryptoStream *stream, const unsigned char *input, int input_length, unsigned char *output);
+int crypto_stream_final(CryptoStream *stream, unsigned char *output);
+/* AEAD streams only: associated data goes in before the first update, the
+ * tag is read after an encrypting final and set before a decrypting one. */
+int crypto_stream_set_aad(CryptoStream *stream, const unsigned char *aad, int aad_length);
+int crypto_stream_get_tag(CryptoStream *stream, unsigned char *tag);
+int crypto_stream_set_tag(CryptoStream *stream, const unsigned char *tag);
+void crypto_stream_free(CryptoStream *stream);
+
+/* One-shot AEAD; the tag is CRYPTO_AEAD_TAG_SIZE bytes. Decryption returns -1
+ * when the tag does not authenticate aad and ciphertext. */
+int crypto_aead_encrypt(
+    const CryptoCipher *cipher,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    const unsigned char *aad,
+    int aad_length,
+    const unsigned char *plain_text,
+    int plain_text_length,
+    unsigned char *ciphertext,
+    unsigned char *tag
+    );
+
+int crypto_aead_decrypt(
+    const CryptoCipher *cipher,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    const unsigned char *aad,
+    int aad_length,
+    const unsigned char *ciphertext,
+    int cipher_text_length,
+    const unsigned char *tag,
+    unsigned char *plain_text
+    );
+
+/* First CRYPTO_KEY_CHECK_SIZE bytes of HMAC-SHA256(key, CRYPTO_KEY_CHECK_LABEL || salt || iv),
+ * salt being the container's CRYPTO_SALT_SIZE bytes and iv its (possibly empty) IV.
+ * Lets extraction reject a wrong password or key before decrypting anything. */
+int crypto_key_check_value(const CryptoCipher *cipher, const CryptoSecret *secret, const unsigned char *salt, const unsigned char *iv, size_t iv_length, unsigned char *key_check);
+/* Constant-time comparison against a stored key check value; 1 when it matches */
+int crypto_key_check_matches(const CryptoCipher *cipher, const CryptoSecret *secret, const unsigned char *salt, const unsigned char *iv, size_t iv_length, const unsigned char *stored_key_check);
+
+/*
+ * Wraps key (a multiple of 8 bytes) with AES-256 key wrap under a key derived
+ * from password and a per-recipient salt. Returns the wrapped length
+ * (key_length + CRYPTO_WRAP_OVERHEAD) or -1. Unwrap returns the key length, or
+ * -1 without printing when the password does not open the wrapped key.
+ */
+int crypto_key_wrap(const char *password, const unsigned char *salt, const unsigned char *key, size_t key_length, unsigned char *wrapped_key);
+int crypto_key_unwrap(const char *password, const unsigned char *salt, const unsigned char *wrapped_key, size_t wrapped_length, unsigned char *key);
+
+void crypto_key_cache_get_stats(CryptoKeyCacheStats *stats);
+/* Wipes every cached key; also registered with atexit on first use */
+void crypto_key_cache_clear(void);
+
 #endif //STEGOBMP_CRYPTO_H
@@ -0,0 +1,46 @@
+#ifndef STEGOBMP_DIAGNOSTICS_H
+#define STEGOBMP_DIAGNOSTICS_H
+
+/*
+ * Where library code reports problems instead of calling printf. Each thread
+ * has its own current sink, so concurrent analyses can silence or collect
+ * their own reports without touching the process-wide stdout. Without a sink,
+ * reports go to stdout as "<Level>: <message>\n", as they always did; info
+ * reports are progress lines and print as "<message>\n".
+ */
+
+typedef enum {
+    STEGO_DIAG_DEBUG = 0,
+    STEGO_DIAG_INFO,
+    STEGO_DIAG_WARNING,
+    STEGO_DIAG_ERROR
+} StegoDiagLevel;
+
+/* message has no level prefix and no trailing newline */
+typedef void (*stego_diag_callback)(void *context, StegoDiagLevel level, const char *message);
+
+typedef struct {
+    /* NULL keeps the stdout output */
+    stego_diag_callback callback;
+    void *context;
+    /* reports below this level are dropped */
+    StegoDiagLevel min_level;
+    /* drops everything before any formatting happens */
+    int silent;
+} StegoDiagSink;
+
+/* Longest formatted message handed to a callback; longer ones are truncated */
+#define STEGO_DIAG_MESSAGE_SIZE 512
+
+/* Installs sink for the calling thread and returns the previous one. The sink
+ * must outlive its installation; NULL restores the stdout default. */
+const StegoDiagSink *stego_diag_set_sink(const StegoDiagSink *sink);
+
+/* 1 when a report at level reaches the calling thread's sink */
+int stego_diag_enabled(StegoDiagLevel level);
+
+void stego_diag_report(StegoDiagLevel level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+const char *stego_diag_level_name(StegoDiagLevel level);
+
+#endif //STEGOBMP_DIAGNOSTICS_H
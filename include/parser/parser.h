@@ -1,6 +1,13 @@
 #ifndef STEGOBMP_PARSER_H
 #define STEGOBMP_PARSER_H
 
+#include "../crypto/crypto.h"
+#include "../stegobmp/stegobmp_utils.h"
+
+#include <stddef.h>
+
+#define PARSER_MAX_THREADS 1024
+
 typedef struct {
     int embed;
     int extract;
@@ -12,6 +19,23 @@ typedef struct {
     const char *encryption_method;
     const char *encryption_mode;
     const char *password;
+    int inplace;
+    int fsync;
+    int stream;
+    const char *batch_filename;
+    /* -scan: analyse every BMP under this directory; -out then names the payload directory */
+    const char *scan_directory;
+    int threads;
+    int compression_level;
+    /* -checksum: append a CRC32C trailer that extraction verifies */
+    int checksum;
+    /* -statistics: also run the blind chi-square / RS / sample pair detectors */
+    int statistics;
+    /* -key/-keyfile: used as the cipher key instead of deriving one from -pass */
+    unsigned char key[CRYPTO_MAX_KEY_SIZE];
+    size_t key_length;
+    /* every -pass in order; more than one seals the payload for each of them */
+    StegoRecipients recipients;
 } ProgramArguments;
 
 int parse_arguments(int argc, char *argv[], ProgramArguments *arguments);
@@ -0,0 +1,39 @@
+#ifndef STEGOBMP_SCAN_H
+#define STEGOBMP_SCAN_H
+
+#include <stddef.h>
+
+/* Only files ending in this (any case) are analysed */
+#define SCAN_BMP_EXTENSION ".bmp"
+/* Paths queued per worker: how far the directory walk and its readahead run ahead of the analyses */
+#define SCAN_QUEUE_DEPTH_PER_WORKER 8
+/* Readahead per queued file when only the structural analysis runs; -statistics reads whole files */
+#define SCAN_READAHEAD_BYTES (256 * 1024)
+
+typedef struct {
+    /* a directory walked recursively, or a single BMP */
+    const char *root;
+    /* when set, every detected payload is saved there as <discovery index><extension> */
+    const char *payload_directory;
+    /* 0 picks the number of online CPUs */
+    size_t worker_count;
+    int statistics;
+} ScanOptions;
+
+/*
+ * Analyses every *.bmp under root on a pool of workers while the calling thread
+ * keeps walking the tree (directory symlinks are not followed). Each file gives
+ * one JSON object on its own stdout line, in completion order, e.g.
+ *
+ *     {"path":"a/b.bmp","status":"ok","method":"LSB1","declared_size":1234,
+ *      "extension":".txt","compressed":false,"checksum_verified":false,
+ *      "payload":"out/17.txt","elapsed_ms":0.412}
+ *
+ * Files without a payload report "method":null; unreadable files and directories
+ * report "status":"error" with the library's message in "error". -statistics adds
+ * "embedding_rate" and "suspicious". A summary goes to stderr so stdout stays pure
+ * JSON lines. Returns 0 only when every file could be analysed.
+ */
+int scan_run(const ScanOptions *options);
+
+#endif //STEGOBMP_SCAN_H
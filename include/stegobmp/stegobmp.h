@@ -2,6 +2,8 @@
 #define STEGOBMP_H
 
 #include "../bmp/bmp.h"
+#include "../crypto/crypto.h"
+#include "stegobmp_utils.h"
 
 int hide_file_in_bmp(
     const char *input_filename,
@@ -10,16 +12,22 @@ int hide_file_in_bmp(
     const char *steganography_method,
     const char *encryption_method,
     const char *encryption_mode,
-    const char *password
+    const CryptoSecret *secret,
+    const StegoRecipients *recipients,
+    int compression_level,
+    int checksum
     );
 
+/* decrypt_threads bounds crypto_cipher_decrypt_parallel: 0 = online CPUs,
+ * 1 when the caller is already one of several workers */
 int extract_file_from_bmp(
     const BMP *bmp,
     const char *output_filename,
     const char *steganography_method,
     const char *encryption_method,
     const char *encryption_mode,
-    const char *password
+    const CryptoSecret *secret,
+    int decrypt_threads
     );
 
 // TODO: check if this is OK (point 3.3)
@@ -0,0 +1,65 @@
+#ifndef STEGOBMP_STEGOBMP_COMPRESS_H
+#define STEGOBMP_STEGOBMP_COMPRESS_H
+
+#include <zlib.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * The top bits of the plain container size are flags: bit 31 marks the file
+ * bytes as a zlib stream (-compress), bit 30 a CRC32C trailer after the NUL
+ * (-checksum, stegobmp_utils.h). Files past 1 GiB are refused.
+ *
+ * This breaks compatibility with one kind of older container. Before the
+ * flags, an LSB4 carrier with more than 2 GiB of pixel data could hold a
+ * declared size of 1 GiB or more. Bit 30 of that size now reads as "checksum
+ * present", so the payload extracts with the wrong length and fails its
+ * checksum. Such a container has to be extracted with an older build. Bit 31
+ * needs over 4 GiB of pixels, which no BMP can hold, and LSB1/LSBI never get
+ * near 1 GiB. All smaller old payloads carry neither bit and read as before.
+ */
+#define STEGOBMP_SIZE_COMPRESSED_FLAG 0x80000000u
+#define STEGOBMP_SIZE_CHECKSUM_FLAG 0x40000000u
+#define STEGOBMP_SIZE_LENGTH_MASK 0x3FFFFFFFu
+
+#define STEGOBMP_COMPRESSION_MIN_LEVEL 1
+#define STEGOBMP_COMPRESSION_MAX_LEVEL 9
+
+/* Input/output bytes handed to zlib per step */
+#define STEGOBMP_COMPRESSION_CHUNK_SIZE (64 * 1024)
+
+/* Largest zlib stream input_size bytes can deflate to */
+size_t stego_compress_bound(uint32_t input_size);
+
+/*
+ * Deflates input_size bytes of input straight into output, reading the file in
+ * STEGOBMP_COMPRESSION_CHUNK_SIZE steps. output_capacity must be at least
+ * stego_compress_bound(input_size). Returns 0 and the stream length on success.
+ */
+int stego_compress_file_to_buffer(FILE *input, uint32_t input_size, int level, unsigned char *output, size_t output_capacity, size_t *output_size);
+
+/* Same stream written to an anonymous temporary file, rewound for reading */
+FILE *stego_compress_file_to_temporary(FILE *input, uint32_t input_size, int level, uint32_t *output_size);
+
+/*
+ * Writes the file bytes of a plain container, inflating them on the way when
+ * the container is compressed. finish fails unless the zlib stream ended
+ * exactly with the last byte written.
+ */
+typedef struct {
+    FILE *file;
+    int compressed;
+    int stream_ended;
+    z_stream stream;
+    unsigned char *buffer;
+} StegoPayloadWriter;
+
+int stego_payload_writer_init(StegoPayloadWriter *writer, FILE *file, int compressed);
+int stego_payload_writer_write(StegoPayloadWriter *writer, const unsigned char *bytes, size_t length);
+int stego_payload_writer_finish(StegoPayloadWriter *writer);
+/* Releases zlib state; safe after finish and on error paths */
+void stego_payload_writer_free(StegoPayloadWriter *writer);
+
+#endif //STEGOBMP_STEGOBMP_COMPRESS_H
@@ -0,0 +1,111 @@
+#ifndef STEGOBMP_STEGOBMP_KERNELS_H
+#define STEGOBMP_STEGOBMP_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    STEGOBMP_KERNEL_SCALAR = 0,
+    STEGOBMP_KERNEL_SSE2,
+    STEGOBMP_KERNEL_AVX2
+} StegoKernelLevel;
+
+/* Forces the scalar kernels when set to "scalar" (handy to compare outputs) */
+#define STEGOBMP_KERNEL_ENV "STEGOBMP_KERNEL"
+#define STEGOBMP_KERNEL_ENV_SCALAR "scalar"
+
+/* Writes every payload bit (MSB first) into the LSB of one carrier byte.
+ * The caller guarantees carrier holds payload_size * 8 bytes. */
+void stegobmp_lsb1_spread(unsigned char *carrier, const unsigned char *payload, size_t payload_size);
+
+/* Inverse of stegobmp_lsb1_spread: rebuilds payload_size bytes from
+ * payload_size * 8 carrier bytes. */
+void stegobmp_lsb1_gather(unsigned char *payload, const unsigned char *carrier, size_t payload_size);
+
+/* Splits every payload byte into its high and low nibble and stores them in
+ * the low nibble of two consecutive carrier bytes (STEGOBMP_LSB4_* masks).
+ * The caller guarantees carrier holds payload_size * 2 bytes. */
+void stegobmp_lsb4_spread(unsigned char *carrier, const unsigned char *payload, size_t payload_size);
+
+/* Inverse of stegobmp_lsb4_spread. */
+void stegobmp_lsb4_gather(unsigned char *payload, const unsigned char *carrier, size_t payload_size);
+
+/* Packs the LSBI pattern (bits 1..2) of STEGOBMP_PATTERNS_PER_PLANE_BYTE carrier
+ * bytes into every plane byte, the first carrier byte in the top two bits. The
+ * caller guarantees carrier holds plane_size * 4 bytes. */
+#define STEGOBMP_PATTERNS_PER_PLANE_BYTE 4
+void stegobmp_pattern_gather(unsigned char *plane, const unsigned char *carrier, size_t plane_size);
+
+/* LSBI: payload byte i uses the 12 carrier bytes after STEGOBMP_LSBI_CONTROL_BYTES + 12 * i,
+ * skipping the red channel. The caller checks the capacity. */
+
+/* Adds, per pattern (bits 1..2 of the channel), how many channels differ from the
+ * payload bit (cost0) and how many differ from its inverse (cost1). The payload
+ * starts at payload byte first_byte. */
+void stegobmp_lsbi_costs(const unsigned char *carrier, size_t first_byte, const unsigned char *payload, size_t payload_size, uint64_t cost0[4], uint64_t cost1[4]);
+
+/* Writes the payload bits at payload byte first_byte, inverted for the patterns
+ * flagged in must_change. */
+void stegobmp_lsbi_apply(unsigned char *carrier, size_t first_byte, const unsigned char *payload, size_t payload_size, const int must_change[4]);
+
+/* Decodes payload_size bytes starting at payload byte first_byte. */
+void stegobmp_lsbi_decode(unsigned char *payload, const unsigned char *carrier, size_t first_byte, size_t payload_size, const int must_change[4]);
+
+/* CRC32C (Castagnoli) of length bytes continued from crc; start from 0. Uses the
+ * SSE4.2 crc32 instruction when the CPU has it, independently of the level. */
+uint32_t stegobmp_crc32c(uint32_t crc, const unsigned char *data, size_t length);
+
+/* Steganalysis counters. Every kernel walks row_count rows of pixel_count 24-bit
+ * pixels, row_bytes apart, and adds per channel (B, G, R as stored); the caller
+ * zeroes the totals. Samples of one channel are compared with the next pixel
+ * of the same row only. */
+#define STEGOBMP_STAT_CHANNELS 3
+#define STEGOBMP_STAT_LEVELS 256
+/* RS groups are runs of this many samples, flipped with the mask 0 1 1 0 */
+#define STEGOBMP_RS_GROUP_SIZE 4
+
+typedef struct {
+    uint64_t pairs;
+    /* v even and u < v, or v odd and u > v */
+    uint64_t x;
+    /* v even and u > v, or v odd and u < v */
+    uint64_t y;
+    /* u and v only differ in their LSB (u >> 1 == v >> 1) */
+    uint64_t same_msbs;
+} StegoSamplePairCounts;
+
+/* Flipping applied to a group before it is compared with the unflipped one */
+typedef enum {
+    STEGOBMP_RS_POSITIVE = 0,
+    STEGOBMP_RS_NEGATIVE,
+    /* same masks over the carrier with every LSB inverted */
+    STEGOBMP_RS_POSITIVE_INVERTED,
+    STEGOBMP_RS_NEGATIVE_INVERTED,
+    STEGOBMP_RS_CASES
+} StegoRsCase;
+
+typedef struct {
+    uint64_t groups;
+    /* flipping made the group noisier (regular) or smoother (singular) */
+    uint64_t regular[STEGOBMP_RS_CASES];
+    uint64_t singular[STEGOBMP_RS_CASES];
+} StegoRsCounts;
+
+void stegobmp_channel_histograms(const unsigned char *pixels, size_t row_bytes, size_t pixel_count, size_t row_count, uint64_t histogram[STEGOBMP_STAT_CHANNELS][STEGOBMP_STAT_LEVELS]);
+
+/* Every horizontally adjacent pair (u, v) of the same channel */
+void stegobmp_sample_pairs(const unsigned char *pixels, size_t row_bytes, size_t pixel_count, size_t row_count, StegoSamplePairCounts counts[STEGOBMP_STAT_CHANNELS]);
+
+/* Groups start at every pixel, so all STEGOBMP_RS_GROUP_SIZE tilings of a row are counted */
+void stegobmp_rs_groups(const unsigned char *pixels, size_t row_bytes, size_t pixel_count, size_t row_count, StegoRsCounts counts[STEGOBMP_STAT_CHANNELS]);
+
+StegoKernelLevel stegobmp_kernels_level(void);
+const char *stegobmp_kernels_level_name(StegoKernelLevel level);
+
+/* Compares every kernel table and CRC32C implementation compiled in and supported
+ * by this CPU (steganalysis included) against the scalar ones, whatever the
+ * dispatcher picked or STEGOBMP_KERNEL forces. Reports each mismatching table
+ * and returns 0 only when all of them are bit-identical. */
+int stegobmp_kernels_self_check(void);
+
+#endif //STEGOBMP_STEGOBMP_KERNELS_H
@@ -2,6 +2,7 @@
 #define STEGOBMP_STEGOBMP_HIDE_H
 
 #include "../bmp/bmp.h"
+#include "stegobmp_planes.h"
 
 #define STEGOBMP_LSB1_BYTES_PER_PAYLOAD 8
 #define STEGOBMP_LSB1_MOST_SIGNIFICANT_BIT 7
@@ -19,11 +20,58 @@
 #define STEGOBMP_LSBI_BIT_MASK_1 0x01
 #define STEGOBMP_LSBI_CONTROL_BYTES 4
 #define STEGOBMP_LSBI_CONTROL_PATTERN 0xA
+#define STEGOBMP_LSBI_PATTERN_MASK 0x06
+#define STEGOBMP_LSBI_PATTERN_SHIFT 1
+/* 8 payload bits over 4 pixels once the red channel is skipped */
+#define STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD 12
+
+/* Longest extension (dot included) looked for after the declared file bytes */
+#define STEGOBMP_MAX_EXTENSION_SIZE 64
+#define STEGOBMP_EXTENSION_WINDOW (STEGOBMP_MAX_EXTENSION_SIZE + 1)
+
+/* payload bytes each method can hold in the carrier */
+uint64_t lsb_1_capacity(const BMP *bmp);
+uint64_t lsb_4_capacity(const BMP *bmp);
+uint64_t lsb_i_capacity(const BMP *bmp);
+uint64_t lsb_i_legacy_capacity(const BMP *bmp);
+
+/* decodes count payload bytes of the legacy (control pattern) LSBI layout */
+void lsb_i_legacy_decode(const BMP *bmp, unsigned char *out, size_t first_byte, size_t count);
 
 int lsb_1_hide(BMP *bmp, const unsigned char *payload_buffer, size_t payload_size);
 int lsb_4_hide(BMP *bmp, const unsigned char *payload_buffer, size_t payload_size);
 int lsb_i_hide(BMP *bmp, const unsigned char *payload_buffer, size_t payload_size);
 
+/* Size header and extension window of one method, decoded without allocating */
+typedef enum {
+    STEGOBMP_PROBE_LSB1 = 0,
+    STEGOBMP_PROBE_LSB4,
+    STEGOBMP_PROBE_LSBI,
+    STEGOBMP_PROBE_COUNT
+} StegoProbeMethod;
+
+typedef struct {
+    StegoProbeMethod method;
+    uint64_t capacity;
+    /* LSBI only: control layout read from the first carrier bytes */
+    int lsbi_legacy;
+    int must_change[4];
+    uint32_t size_field;
+    unsigned char window[STEGOBMP_EXTENSION_WINDOW];
+    /* ".ext\0" bytes of the window, and the whole container they end */
+    size_t trailer_size;
+    size_t payload_size;
+    /* the size fits the carrier and the window holds a well-formed extension */
+    int plausible;
+} StegoLsbProbe;
+
+/* Probes LSB1, LSB4 and LSBI (either control layout) in one go; indexed by StegoProbeMethod.
+ * planes must come from stego_planes_init on the same bmp. */
+void lsb_probe_methods(const BMP *bmp, StegoBitPlanes *planes, StegoLsbProbe probes[STEGOBMP_PROBE_COUNT]);
+/* Decodes a plausible probe into the same buffer its method's retrieve would return,
+ * reusing the plane blocks the probes already extracted */
+unsigned char *lsb_probe_retrieve(const BMP *bmp, StegoBitPlanes *planes, const StegoLsbProbe *probe, size_t *extracted_payload_size);
+
 unsigned char *lsb_1_retrieve(const BMP *bmp, size_t *extracted_payload_size);
 unsigned char *lsb_1_retrieve_encrypted(const BMP *bmp, size_t *extracted_payload_size);
 unsigned char *lsb_4_retrieve(const BMP *bmp, size_t *extracted_payload_size);
@@ -0,0 +1,53 @@
+#ifndef STEGOBMP_STEGOBMP_PLANES_H
+#define STEGOBMP_STEGOBMP_PLANES_H
+
+#include "../bmp/bmp.h"
+
+#include <stddef.h>
+
+/* Carrier bytes extracted at a time; a plane block is built once, on its first use */
+#define STEGOBMP_PLANES_BLOCK_BYTES 4096
+
+typedef enum {
+    /* bit 0 of every carrier byte, 8 per plane byte, first carrier byte in bit 7:
+     * byte i of this plane is byte i of an LSB1 payload */
+    STEGOBMP_PLANE_LSB = 0,
+    /* bits 1..2 (the LSBI pattern), 4 per plane byte, first carrier byte on top */
+    STEGOBMP_PLANE_PATTERN,
+    /* low nibble, 2 per plane byte, first carrier byte on top: byte i of this
+     * plane is byte i of an LSB4 payload */
+    STEGOBMP_PLANE_NIBBLE,
+    STEGOBMP_PLANE_COUNT
+} StegoPlane;
+
+/*
+ * Packed views of the low bits of a carrier, shared by every decoder that reads
+ * the same carrier. A plane is allocated for the whole carrier on its first use
+ * and its blocks are only extracted when a decoder asks for them, so probing a
+ * few headers costs a few blocks rather than a pass over the pixels.
+ */
+typedef struct {
+    const unsigned char *carrier;
+    size_t carrier_size;
+    unsigned char *planes[STEGOBMP_PLANE_COUNT];
+    /* one flag per STEGOBMP_PLANES_BLOCK_BYTES carrier bytes and plane */
+    unsigned char *built[STEGOBMP_PLANE_COUNT];
+    size_t block_count;
+    /* bytes allocated so far for planes and their flags */
+    size_t allocated_size;
+} StegoBitPlanes;
+
+/* Allocates nothing yet; returns 0 on success, and the planes must then be
+ * released with stego_planes_free */
+int stego_planes_init(StegoBitPlanes *planes, const BMP *bmp);
+void stego_planes_free(StegoBitPlanes *planes);
+
+/* 1 when carrier bytes [first, end) of a plane are already extracted */
+int stego_planes_hold(const StegoBitPlanes *planes, StegoPlane plane, size_t first, size_t end);
+
+/* Extracts whatever is missing of carrier bytes [first, end) in one plane and
+ * returns the plane, or NULL when it can not be allocated; end must not exceed
+ * the carrier size */
+const unsigned char *stego_planes_require(StegoBitPlanes *planes, StegoPlane plane, size_t first, size_t end);
+
+#endif //STEGOBMP_STEGOBMP_PLANES_H
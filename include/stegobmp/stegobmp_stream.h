@@ -0,0 +1,88 @@
+#ifndef STEGOBMP_STEGOBMP_STREAM_H
+#define STEGOBMP_STEGOBMP_STREAM_H
+
+#include "../bmp/bmp.h"
+#include "../crypto/crypto.h"
+#include "stegobmp_utils.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Input bytes read (and encrypted) per step by the streaming pipelines */
+#define STEGOBMP_STREAM_CHUNK_SIZE (64 * 1024)
+
+typedef enum {
+    STEGO_STREAM_METHOD_LSB1 = 0,
+    STEGO_STREAM_METHOD_LSB4,
+    STEGO_STREAM_METHOD_LSBI
+} StegoStreamMethod;
+
+/*
+ * Writes payload bytes straight into the carrier at a given payload offset.
+ * Every offset must be written exactly once before stego_sink_finish. LSBI
+ * writes the raw bits while accumulating the pattern costs; finish then
+ * stores the control bytes and inverts the flagged patterns in place.
+ */
+typedef struct {
+    BMP *bmp;
+    StegoStreamMethod method;
+    uint64_t capacity;
+    size_t payload_end;
+    uint64_t cost0[4];
+    uint64_t cost1[4];
+} StegoSink;
+
+int stego_sink_init(StegoSink *sink, BMP *bmp, const char *steganography_method);
+int stego_sink_write(StegoSink *sink, size_t offset, const unsigned char *bytes, size_t length);
+int stego_sink_finish(StegoSink *sink);
+
+/*
+ * Reads payload bytes straight out of the carrier at a given payload offset,
+ * bounds-checked against the method capacity. LSBI resolves the control
+ * bytes (including the legacy control pattern) once at init.
+ */
+typedef struct {
+    const BMP *bmp;
+    StegoStreamMethod method;
+    uint64_t capacity;
+    int lsbi_legacy;
+    int must_change[4];
+} StegoSource;
+
+int stego_source_init(StegoSource *source, const BMP *bmp, const char *steganography_method);
+int stego_source_read(const StegoSource *source, size_t offset, unsigned char *bytes, size_t length);
+
+/*
+ * Same container as hide_file_in_bmp, built in STEGOBMP_STREAM_CHUNK_SIZE steps.
+ * With compression the input is deflated to a temporary file first, since the
+ * encrypted header needs the final length before the first byte is written.
+ */
+int hide_file_in_bmp_streaming(
+    const char *input_filename,
+    BMP *bmp,
+    const char *steganography_method,
+    const char *encryption_method,
+    const char *encryption_mode,
+    const CryptoSecret *secret,
+    const StegoRecipients *recipients,
+    int compression_level,
+    int checksum
+    );
+
+/*
+ * Same output as extract_file_from_bmp, decoded (and decrypted) in
+ * STEGOBMP_STREAM_CHUNK_SIZE steps. A plain payload has its extension at a
+ * known offset, so it is read first and the final file written directly.
+ * An encrypted payload only reveals the extension after the last block, so
+ * the file is written to <output>.partXXXXXX and renamed once it is known.
+ */
+int extract_file_from_bmp_streaming(
+    const BMP *bmp,
+    const char *output_filename,
+    const char *steganography_method,
+    const char *encryption_method,
+    const char *encryption_mode,
+    const CryptoSecret *secret
+    );
+
+#endif //STEGOBMP_STEGOBMP_STREAM_H
@@ -1,6 +1,9 @@
 #ifndef STEGOBMP_STEGOBMP_UTILS_H
 #define STEGOBMP_STEGOBMP_UTILS_H
 
+#include "../crypto/crypto.h"
+#include "../bmp/bmp_utils.h"
+
 #include <stddef.h>
 #include <stdint.h>
 
@@ -14,11 +17,88 @@
 #define STEGOBMP_LSB4_METHOD "LSB4"
 #define STEGOBMP_LSBI_METHOD "LSBI"
 
+/* Big-endian CRC32C of everything before it, appended after the NUL of a container whose size carries STEGOBMP_SIZE_CHECKSUM_FLAG */
+#define STEGOBMP_CHECKSUM_SIZE 4
+
 unsigned char *build_payload_buffer(const char *input_filename, size_t *payload_size, char **payload_extension);
+/* Same container, placed head_room bytes into an allocation with tail_room spare bytes
+ * after it. Returns the allocation; payload_size excludes both reserves. A non-zero
+ * compression_level deflates the file bytes and flags the size (stegobmp_compress.h);
+ * checksum appends the CRC32C trailer. */
+unsigned char *build_payload_buffer_reserved(const char *input_filename, size_t head_room, size_t tail_room, int compression_level, int checksum, size_t *payload_size, char **payload_extension);
+
+/* Bytes the container keeps after its NUL terminator */
+size_t stego_payload_trailer_size(uint32_t size_field);
+/* 1 when the trailer right after the first checked_size bytes holds their CRC32C */
+int stego_payload_checksum_matches(const unsigned char *payload_buffer, size_t payload_size, size_t checked_size);
 
 void write_uint32_big_endian(unsigned char *buffer, uint32_t value);
 uint32_t read_uint32_big_endian(const unsigned char *buffer);
 
+/*
+ * Encrypted container header: outer size || salt || ivlen || iv || cipherlen.
+ * Authenticated modes add a key check value before cipherlen, authenticate the
+ * whole header as associated data and append the tag after the ciphertext.
+ * IVs never exceed CRYPTO_MAX_IV_SIZE, so the top bits of ivlen are flags: a
+ * key supplied with -key/-keyfile instead of one derived from -pass, or a
+ * recipient table (count || count x (salt || wrapped data key)) right after
+ * the iv, used when the payload is sealed for several passwords at once.
+ */
+#define STEGOBMP_IV_LENGTH_RAW_KEY_FLAG 0x80
+#define STEGOBMP_IV_LENGTH_RECIPIENTS_FLAG 0x40
+#define STEGOBMP_IV_LENGTH_MASK 0x3F
+#define STEGOBMP_RECIPIENT_COUNT_SIZE 1
+#define STEGOBMP_MAX_RECIPIENTS 16
+#define STEGOBMP_MAX_ENCRYPTION_HEADER_SIZE \
+    (BMP_INT_SIZE_BYTES + CRYPTO_SALT_SIZE + CRYPTO_METADATA_IV_LEN_SIZE + CRYPTO_MAX_IV_SIZE + STEGOBMP_RECIPIENT_COUNT_SIZE + \
+     STEGOBMP_MAX_RECIPIENTS * (CRYPTO_WRAP_SALT_SIZE + CRYPTO_MAX_KEY_SIZE + CRYPTO_WRAP_OVERHEAD) + CRYPTO_KEY_CHECK_SIZE + BMP_INT_SIZE_BYTES)
+
+typedef struct {
+    unsigned char salt[CRYPTO_WRAP_SALT_SIZE];
+    unsigned char wrapped_key[CRYPTO_MAX_KEY_SIZE + CRYPTO_WRAP_OVERHEAD];
+} StegoRecipientSlot;
+
+typedef struct {
+    uint32_t encrypted_section_size;
+    unsigned char salt[CRYPTO_SALT_SIZE];
+    int raw_key;
+    unsigned char iv_length;
+    unsigned char iv[CRYPTO_MAX_IV_SIZE];
+    size_t recipient_count;
+    StegoRecipientSlot recipients[STEGOBMP_MAX_RECIPIENTS];
+    unsigned char key_check[CRYPTO_KEY_CHECK_SIZE];
+    uint32_t cipher_length;
+} StegoEncryptionHeader;
+
+/* Passwords that each open a multi-recipient container (-pass given more than once) */
+typedef struct {
+    const char *passwords[STEGOBMP_MAX_RECIPIENTS];
+    size_t count;
+} StegoRecipients;
+
+/* Bytes between the outer size and the ciphertext */
+size_t stego_encryption_metadata_size(const CryptoCipher *cipher, size_t recipient_count);
+/* Writes the header (outer size included) and returns its length */
+size_t stego_encryption_header_write(unsigned char *buffer, const CryptoCipher *cipher, const StegoEncryptionHeader *header);
+/*
+ * Parses a header from the first available bytes of an encrypted container;
+ * 0 when its lengths are consistent with cipher, with *header_size set to the
+ * ciphertext offset. Legacy bare-ciphertext payloads do not parse.
+ */
+int stego_encryption_header_parse(const unsigned char *buffer, size_t available, const CryptoCipher *cipher, StegoEncryptionHeader *header, size_t *header_size);
+
+/* Draws a random data key and wraps it under every recipient password into header */
+int stego_recipients_seal(const CryptoCipher *cipher, const StegoRecipients *recipients, StegoEncryptionHeader *header, unsigned char data_key[CRYPTO_MAX_KEY_SIZE]);
+/*
+ * Picks what opens a parsed header: the data key unwrapped from the first
+ * recipient slot the password opens, or the caller's own secret when the
+ * header was sealed with the same kind of secret. Fails (with a hint) otherwise.
+ */
+int stego_resolve_secret(const CryptoCipher *cipher, const StegoEncryptionHeader *header, const CryptoSecret *secret,
+                         unsigned char data_key[CRYPTO_MAX_KEY_SIZE], CryptoSecret *resolved);
+
+/* Inflates the file bytes when the container size carries STEGOBMP_SIZE_COMPRESSED_FLAG;
+ * a flagged checksum is verified before anything is written */
 int save_extracted_file(const unsigned char *payload_buffer, size_t extracted_payload_size, const char * output_filename);
 int stego_payload_locate_extension(const unsigned char *payload_buffer, size_t payload_size, size_t file_size, size_t *extension_offset, size_t *extension_length);
 
@@ -1,68 +1,128 @@
 #include "include/stegobmp/stegobmp.h"
 #include "include/parser/parser.h"
 #include "include/analysis/stego_analysis.h"
+#include "include/analysis/stego_statistics.h"
 #include "include/stegobmp/stegobmp_utils.h"
+#include "include/stegobmp/stegobmp_stream.h"
+#include "include/batch/batch.h"
+#include "include/scan/scan.h"
+#include "include/diagnostics/diagnostics.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
-int main(const int argc, char* argv[]) {
+static CryptoSecret secret_from_arguments(const ProgramArguments *arguments) {
+    return arguments->key_length > 0
+        ? crypto_secret_key(arguments->key, arguments->key_length)
+        : crypto_secret_password(arguments->password);
+}
 
-    ProgramArguments arguments = {0};
-    if (parse_arguments(argc, argv, &arguments)) {
-        return 1;
+static void print_statistics(const StegoStatisticsResult *statistics) {
+    printf("Statistical analysis (embedding rate per channel):\n");
+    for (size_t channel = 0; channel < STEGOBMP_STAT_CHANNELS; channel++) {
+        const StegoChannelStatistics *channel_statistics = &statistics->channels[channel];
+        printf("  %-5s  chi-square p=%.4f (embedded prefix %.1f%%)  RS %.4f  sample pairs %.4f\n",
+               stego_statistics_channel_name(channel),
+               channel_statistics->chi_square_p_value,
+               channel_statistics->chi_square_prefix * 100.0,
+               channel_statistics->rs_rate,
+               channel_statistics->sample_pair_rate);
     }
+    printf("Estimated embedding rate: %.4f (%s)\n", statistics->embedding_rate,
+           statistics->suspicious ? "LSB embedding suspected" : "no LSB embedding suspected");
+}
+
+static int run_job_with_reader(const ProgramArguments *arguments, BMP *(*read_bmp)(const char *), const int decrypt_threads) {
 
-    BMP *bmp = bmp_read(arguments.bmp_filename);
+    BMP *bmp = read_bmp(arguments->bmp_filename);
     if (!bmp) {
-        printf("Error: Can not read BMP file: %s\n", arguments.bmp_filename);
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not read BMP file: %s", arguments->bmp_filename);
         return 1;
     }
 
-    if (arguments.embed) {
-        const int embed_status = hide_file_in_bmp(
-            arguments.input_filename,
-            bmp,
-            arguments.output_bmp_filename,
-            arguments.steganography_method,
-            arguments.encryption_method,
-            arguments.encryption_mode,
-            arguments.password
-        );
+    const CryptoSecret secret = secret_from_arguments(arguments);
+    /* a single -pass keeps the plain password-derived container */
+    const StegoRecipients *recipients = arguments->recipients.count > 1 ? &arguments->recipients : NULL;
+
+    if (arguments->embed) {
+        const int embed_status = arguments->stream
+            ? hide_file_in_bmp_streaming(
+                arguments->input_filename,
+                bmp,
+                arguments->steganography_method,
+                arguments->encryption_method,
+                arguments->encryption_mode,
+                &secret,
+                recipients,
+                arguments->compression_level,
+                arguments->checksum
+            )
+            : hide_file_in_bmp(
+                arguments->input_filename,
+                bmp,
+                arguments->output_bmp_filename,
+                arguments->steganography_method,
+                arguments->encryption_method,
+                arguments->encryption_mode,
+                &secret,
+                recipients,
+                arguments->compression_level,
+                arguments->checksum
+            );
         if (embed_status){
-            printf("Error: Can not embed file %s\n", arguments.input_filename);
+            stego_diag_report(STEGO_DIAG_ERROR, "Can not embed file %s", arguments->input_filename);
             bmp_free(bmp);
             return 1;
         }
-        printf("File successfully embedded\n");
+        stego_diag_report(STEGO_DIAG_INFO, "File successfully embedded");
 
-        const int write_status = bmp_write(bmp, arguments.output_bmp_filename);
-        if (write_status) {
-            printf("Error: Can not write BMP file: %s\n", arguments.output_bmp_filename);
-            bmp_free(bmp);
-            return 1;
+        if (arguments->inplace) {
+            const int patch_status = bmp_write_dirty_range(bmp, arguments->bmp_filename, arguments->fsync);
+            if (patch_status) {
+                stego_diag_report(STEGO_DIAG_ERROR, "Can not update BMP file in place: %s", arguments->bmp_filename);
+                bmp_free(bmp);
+                return 1;
+            }
+            stego_diag_report(STEGO_DIAG_INFO, "File successfully updated in place (%zu bytes written to %s)", bmp->dirty_end - bmp->dirty_begin, arguments->bmp_filename);
+        } else {
+            const int write_status = bmp_write(bmp, arguments->output_bmp_filename);
+            if (write_status) {
+                stego_diag_report(STEGO_DIAG_ERROR, "Can not write BMP file: %s", arguments->output_bmp_filename);
+                bmp_free(bmp);
+                return 1;
+            }
+            stego_diag_report(STEGO_DIAG_INFO, "File successfully written to %s", arguments->output_bmp_filename);
         }
-        printf("File successfully written to %s\n", arguments.output_bmp_filename);
     }
 
-    if (arguments.extract) {
-        const int extracted_file_in_bmp = extract_file_from_bmp(
-            bmp,
-            arguments.output_bmp_filename,
-            arguments.steganography_method,
-            arguments.encryption_method,
-            arguments.encryption_mode,
-            arguments.password
+    if (arguments->extract) {
+        const int extracted_file_in_bmp = arguments->stream
+            ? extract_file_from_bmp_streaming(
+                bmp,
+                arguments->output_bmp_filename,
+                arguments->steganography_method,
+                arguments->encryption_method,
+                arguments->encryption_mode,
+                &secret
+            )
+            : extract_file_from_bmp(
+                bmp,
+                arguments->output_bmp_filename,
+                arguments->steganography_method,
+                arguments->encryption_method,
+                arguments->encryption_mode,
+                &secret,
+                decrypt_threads
             );
         if (extracted_file_in_bmp) {
-            printf("Error: Can not extract file %s\n", arguments.output_bmp_filename);
+            stego_diag_report(STEGO_DIAG_ERROR, "Can not extract file %s", arguments->output_bmp_filename);
             bmp_free(bmp);
             return 1;
         }
-        printf("File successfully extracted in %s\n", arguments.output_bmp_filename);
+        stego_diag_report(STEGO_DIAG_INFO, "File successfully extracted in %s", arguments->output_bmp_filename);
     }
 
-    if (arguments.analyze) {
+    if (arguments->analyze) {
         StegoAnalysisResult analysis_result;
         stego_analysis_result_init(&analysis_result);
 
@@ -72,19 +132,71 @@ int main(const int argc, char* argv[]) {
         } else {
             printf("Payload detected using method: %s\n", stego_analysis_method_to_string(analysis_result.method));
             printf("Declared payload size: %zu bytes\n", analysis_result.declared_payload_size);
-            if (arguments.output_bmp_filename) {
-                if (save_extracted_file(analysis_result.payload, analysis_result.extracted_payload_size, arguments.output_bmp_filename) == 0) {
-                    printf("Payload saved to %s\n", arguments.output_bmp_filename);
+            if (analysis_result.compressed) {
+                printf("Payload is zlib-compressed\n");
+            }
+            if (analysis_result.checksum_verified) {
+                printf("Payload CRC32C checksum verified\n");
+            }
+            if (arguments->output_bmp_filename) {
+                if (save_extracted_file(analysis_result.payload, analysis_result.extracted_payload_size, arguments->output_bmp_filename) == 0) {
+                    printf("Payload saved to %s\n", arguments->output_bmp_filename);
                 } else {
-                    printf("Warning: Payload detected but could not be saved to %s\n", arguments.output_bmp_filename);
+                    printf("Warning: Payload detected but could not be saved to %s\n", arguments->output_bmp_filename);
                 }
             }
         }
 
         stego_analysis_result_free(&analysis_result);
+
+        if (arguments->statistics) {
+            StegoStatisticsResult statistics;
+            if (stego_statistics_run(bmp, &statistics) == 0) {
+                print_statistics(&statistics);
+            } else {
+                printf("Warning: Statistical analysis is not available for this BMP\n");
+            }
+        }
     }
 
     bmp_free(bmp);
 
     return 0;
 }
+
+static int run_job(const ProgramArguments *arguments) {
+    return run_job_with_reader(arguments, bmp_read, 0);
+}
+
+/* a manifest carrier rewritten by another process must only fail its own job;
+ * the batch workers already fill the CPUs, so each job decrypts on one thread */
+static int run_batch_job(const ProgramArguments *arguments) {
+    return run_job_with_reader(arguments, bmp_read_copy, 1);
+}
+
+int main(const int argc, char* argv[]) {
+
+    ProgramArguments arguments = {0};
+    if (parse_arguments(argc, argv, &arguments)) {
+        OPENSSL_cleanse(arguments.key, sizeof(arguments.key));
+        return 1;
+    }
+
+    if (arguments.batch_filename) {
+        return batch_run(arguments.batch_filename, (size_t) arguments.threads, run_batch_job);
+    }
+
+    if (arguments.scan_directory) {
+        const ScanOptions scan_options = {
+            .root = arguments.scan_directory,
+            .payload_directory = arguments.output_bmp_filename,
+            .worker_count = (size_t) arguments.threads,
+            .statistics = arguments.statistics
+        };
+        return scan_run(&scan_options);
+    }
+
+    const int status = run_job(&arguments);
+    OPENSSL_cleanse(arguments.key, sizeof(arguments.key));
+    return status;
+}
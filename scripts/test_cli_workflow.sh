@@ -0,0 +1,286 @@
+#!/usr/bin/env bash
+
+set -euo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_ROOT="$(cd "${SCRIPT_DIR}/.." && pwd)"
+
+usage() {
+    cat <<EOF
+Usage: $0 <carrier_bmp> [stegobmp_binary]
+
+Runs CLI regression cases that are not about a crypto method/mode:
+  - Embedding with -out naming the -p carrier itself.
+  - Embed/extract round trips for -inplace, -inplace -fsync, -compress, -checksum,
+    -key, -keyfile and repeated -pass, buffered and with -stream.
+  - -batch manifests (buffered and -stream jobs) and -analyze -scan.
+  - Failures: a corrupted -checksum carrier, a wrong -pass against a recipient
+    table and a -key/-pass mismatch must be rejected without an output file.
+
+The carrier BMP must be a 24-bit image; it is copied, never modified.
+
+Arguments:
+  carrier_bmp       Path to the BMP file that will be used as carrier.
+  stegobmp_binary   (Optional) Path to the stegobmp executable.
+                    Defaults to "${PROJECT_ROOT}/build/stegobmp".
+EOF
+}
+
+if [[ $# -lt 1 || $# -gt 2 ]]; then
+    usage
+    exit 1
+fi
+
+CARRIER_BMP="$1"
+if [[ ! -f "${CARRIER_BMP}" ]]; then
+    echo "Error: Carrier BMP '${CARRIER_BMP}' does not exist" >&2
+    exit 1
+fi
+
+STEGOBMP_BIN="${2:-${PROJECT_ROOT}/build/stegobmp}"
+if [[ ! -x "${STEGOBMP_BIN}" ]]; then
+    echo "Error: stegobmp binary '${STEGOBMP_BIN}' not found or not executable" >&2
+    exit 1
+fi
+
+WORKDIR="$(mktemp -d)"
+cleanup() {
+    rm -rf "${WORKDIR}"
+}
+trap cleanup EXIT
+
+MESSAGE_FILE="${WORKDIR}/message.txt"
+printf -- "Test payload generated at %s\n" "$(date -Iseconds)" > "${MESSAGE_FILE}"
+printf -- "abcdefghijklmnopqrstuvwxyz0123456789\n" >> "${MESSAGE_FILE}"
+
+STEG_METHOD="LSB1"
+KEY_HEX="000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+KEY_FILE="${WORKDIR}/key.bin"
+printf -- "$(sed 's/../\\x&/g' <<<"${KEY_HEX}")" > "${KEY_FILE}"
+
+printf -- "Carrier BMP: %s\n" "${CARRIER_BMP}"
+printf -- "stegobmp executable: %s\n" "${STEGOBMP_BIN}"
+printf -- "Working directory: %s\n" "${WORKDIR}"
+printf -- "----------------------------------------\n"
+
+FAILURES=0
+
+fail() {
+    echo "  $1"
+    ((FAILURES++)) || true
+}
+
+# Extracts <bmp> with the remaining arguments and compares the result with MESSAGE_FILE
+expect_roundtrip() {
+    local test_id="$1"
+    local bmp="$2"
+    shift 2
+
+    local recovery_prefix="${WORKDIR}/recovered_${test_id}"
+    local extract_log="${WORKDIR}/extract_${test_id}.log"
+    if ! "${STEGOBMP_BIN}" -extract -p "${bmp}" -out "${recovery_prefix}" "$@" >"${extract_log}" 2>&1; then
+        fail "Extract failed. Check ${extract_log}"
+        return 1
+    fi
+    if ! cmp -s "${MESSAGE_FILE}" "${recovery_prefix}.txt"; then
+        fail "Payload mismatch for ${test_id}"
+        return 1
+    fi
+    return 0
+}
+
+# Extraction of <bmp> must fail and leave nothing behind under <test_id>'s output prefix
+expect_rejected() {
+    local test_id="$1"
+    local bmp="$2"
+    shift 2
+
+    local recovery_prefix="${WORKDIR}/rejected_${test_id}"
+    local extract_log="${WORKDIR}/extract_rejected_${test_id}.log"
+    if "${STEGOBMP_BIN}" -extract -p "${bmp}" -out "${recovery_prefix}" "$@" >"${extract_log}" 2>&1; then
+        fail "Extraction of ${test_id} succeeded. Check ${extract_log}"
+        return 1
+    fi
+    if compgen -G "${recovery_prefix}*" >/dev/null; then
+        fail "Extraction of ${test_id} left an output file: $(compgen -G "${recovery_prefix}*" | head -n 1)"
+        return 1
+    fi
+    return 0
+}
+
+# Embeds MESSAGE_FILE into a copy of the carrier and extracts it back:
+#   roundtrip <test_id> <embed options...> -- <extract options...>
+# An -inplace embed patches the copy itself, otherwise the result goes to a new BMP.
+roundtrip() {
+    local test_id="$1"
+    shift
+    local embed_args=()
+    while [[ $# -gt 0 && "$1" != "--" ]]; do
+        embed_args+=("$1")
+        shift
+    done
+    [[ $# -gt 0 ]] && shift
+
+    local carrier="${WORKDIR}/carrier_${test_id}.bmp"
+    local stego_bmp="${WORKDIR}/embedded_${test_id}.bmp"
+    local embed_log="${WORKDIR}/embed_${test_id}.log"
+    cp "${CARRIER_BMP}" "${carrier}"
+
+    local output_args=(-out "${stego_bmp}")
+    if [[ " ${embed_args[*]} " == *" -inplace "* ]]; then
+        output_args=()
+        stego_bmp="${carrier}"
+    fi
+
+    printf -- "\n  [-] %s\n" "${test_id}"
+    if ! "${STEGOBMP_BIN}" -embed -in "${MESSAGE_FILE}" -p "${carrier}" "${output_args[@]}" -steg "${STEG_METHOD}" \
+        "${embed_args[@]}" >"${embed_log}" 2>&1; then
+        fail "Embed failed. Check ${embed_log}"
+        return 1
+    fi
+    if expect_roundtrip "${test_id}" "${stego_bmp}" -steg "${STEG_METHOD}" "$@"; then
+        echo "    OK"
+    fi
+}
+
+# Flips the low bit of one byte of a file in place
+flip_low_bit() {
+    local file="$1"
+    local offset="$2"
+    local byte
+    byte=$(od -An -tu1 -j "${offset}" -N1 "${file}" | tr -d ' ')
+    printf "\\$(printf '%03o' $((byte ^ 1)))" | dd of="${file}" bs=1 seek="${offset}" conv=notrunc status=none
+}
+
+# Pixel array offset (bfOffBits, little endian) of a BMP file
+pixel_data_offset() {
+    local bytes
+    read -r -a bytes <<<"$(od -An -tu1 -j 10 -N4 "$1")"
+    echo $((bytes[0] | bytes[1] << 8 | bytes[2] << 16 | bytes[3] << 24))
+}
+
+printf -- "\n[+] Testing -out naming the -p carrier\n"
+SAME_BMP="${WORKDIR}/same.bmp"
+cp "${CARRIER_BMP}" "${SAME_BMP}"
+if ! "${STEGOBMP_BIN}" -embed -in "${MESSAGE_FILE}" -p "${SAME_BMP}" -out "${SAME_BMP}" -steg LSB1 \
+    >"${WORKDIR}/embed_same.log" 2>&1; then
+    fail "Embed failed. Check ${WORKDIR}/embed_same.log"
+elif [[ $(wc -c <"${SAME_BMP}") -ne $(wc -c <"${CARRIER_BMP}") ]]; then
+    fail "Carrier size changed when -out is the -p file"
+elif expect_roundtrip "same_file" "${SAME_BMP}" -steg LSB1; then
+    echo "  OK"
+fi
+
+for stream_flag in "" "-stream"; do
+    suffix="${stream_flag:+_stream}"
+    printf -- "\n[+] Testing embed/extract flags%s\n" "${stream_flag:+ with -stream}"
+
+    roundtrip "plain${suffix}" ${stream_flag} -- ${stream_flag}
+    roundtrip "inplace${suffix}" -inplace ${stream_flag} -- ${stream_flag}
+    roundtrip "inplace_fsync${suffix}" -inplace -fsync ${stream_flag} -- ${stream_flag}
+    roundtrip "compress${suffix}" -compress 9 ${stream_flag} -- ${stream_flag}
+    roundtrip "checksum${suffix}" -checksum ${stream_flag} -- ${stream_flag}
+    roundtrip "compress_checksum_gcm${suffix}" -compress 6 -checksum -a aes256 -m gcm -pass "secret" ${stream_flag} \
+        -- -a aes256 -m gcm -pass "secret" ${stream_flag}
+    roundtrip "key${suffix}" -a aes256 -m cbc -key "${KEY_HEX}" ${stream_flag} -- -a aes256 -m cbc -key "${KEY_HEX}" ${stream_flag}
+    roundtrip "keyfile${suffix}" -a chacha20 -m poly1305 -keyfile "${KEY_FILE}" ${stream_flag} \
+        -- -a chacha20 -m poly1305 -key "${KEY_HEX}" ${stream_flag}
+    roundtrip "recipients${suffix}" -a aes128 -m gcm -pass "first" -pass "second" -pass "third" ${stream_flag} \
+        -- -a aes128 -m gcm -pass "second" ${stream_flag}
+
+    printf -- "\n[+] Testing rejected extractions%s\n" "${stream_flag:+ with -stream}"
+
+    # with LSB1 payload byte n lives in the low bits of carrier bytes 8n..8n+7:
+    # byte 20 is past the size prefix and inside the stored file
+    printf -- "\n  [-] corrupted_checksum%s\n" "${suffix}"
+    CORRUPTED_BMP="${WORKDIR}/embedded_checksum${suffix}.bmp"
+    if [[ -f "${CORRUPTED_BMP}" ]]; then
+        flip_low_bit "${CORRUPTED_BMP}" $(($(pixel_data_offset "${CORRUPTED_BMP}") + 8 * 20))
+        expect_rejected "corrupted_checksum${suffix}" "${CORRUPTED_BMP}" -steg "${STEG_METHOD}" ${stream_flag} && echo "    OK"
+    else
+        fail "No -checksum carrier to corrupt"
+    fi
+
+    printf -- "\n  [-] wrong_recipient%s\n" "${suffix}"
+    expect_rejected "wrong_recipient${suffix}" "${WORKDIR}/embedded_recipients${suffix}.bmp" -steg "${STEG_METHOD}" \
+        -a aes128 -m gcm -pass "fourth" ${stream_flag} && echo "    OK"
+
+    printf -- "\n  [-] key_pass_mismatch%s\n" "${suffix}"
+    expect_rejected "key_pass_mismatch${suffix}" "${WORKDIR}/embedded_key${suffix}.bmp" -steg "${STEG_METHOD}" \
+        -a aes256 -m cbc -pass "${KEY_HEX}" ${stream_flag} && echo "    OK"
+done
+
+printf -- "\n[+] Testing -batch\n"
+BATCH_MANIFEST="${WORKDIR}/manifest.txt"
+BATCH_IDS=()
+for job in 0 1 2 3; do
+    cp "${CARRIER_BMP}" "${WORKDIR}/batch_carrier_${job}.bmp"
+    stream_flag=""
+    if (( job % 2 )); then
+        stream_flag="-stream"
+    fi
+    printf -- '-embed %s -in "%s" -p "%s" -out "%s" -steg %s -a aes192 -m gcm -pass "batch pass %d"\n' "${stream_flag}" \
+        "${MESSAGE_FILE}" "${WORKDIR}/batch_carrier_${job}.bmp" "${WORKDIR}/batch_${job}.bmp" "${STEG_METHOD}" "${job}" >>"${BATCH_MANIFEST}"
+    BATCH_IDS+=("${job}")
+done
+printf -- '# comment lines and blank lines are skipped\n\n' >>"${BATCH_MANIFEST}"
+if ! "${STEGOBMP_BIN}" -batch "${BATCH_MANIFEST}" -threads 2 >"${WORKDIR}/batch.log" 2>&1; then
+    fail "Batch embed failed. Check ${WORKDIR}/batch.log"
+else
+    EXTRACT_MANIFEST="${WORKDIR}/extract_manifest.txt"
+    for job in "${BATCH_IDS[@]}"; do
+        stream_flag=""
+        if (( job % 2 == 0 )); then
+            stream_flag="-stream"
+        fi
+        printf -- '-extract %s -p "%s" -out "%s" -steg %s -a aes192 -m gcm -pass "batch pass %d"\n' "${stream_flag}" \
+            "${WORKDIR}/batch_${job}.bmp" "${WORKDIR}/recovered_batch_${job}" "${STEG_METHOD}" "${job}" >>"${EXTRACT_MANIFEST}"
+    done
+    if ! "${STEGOBMP_BIN}" -batch "${EXTRACT_MANIFEST}" -threads 3 >"${WORKDIR}/batch_extract.log" 2>&1; then
+        fail "Batch extract failed. Check ${WORKDIR}/batch_extract.log"
+    else
+        BATCH_OK=1
+        for job in "${BATCH_IDS[@]}"; do
+            if ! cmp -s "${MESSAGE_FILE}" "${WORKDIR}/recovered_batch_${job}.txt"; then
+                fail "Payload mismatch for batch job ${job}"
+                BATCH_OK=0
+            fi
+        done
+        [[ ${BATCH_OK} -eq 1 ]] && echo "  OK"
+    fi
+fi
+
+printf -- "\n[+] Testing -analyze -scan\n"
+SCAN_DIR="${WORKDIR}/scan"
+mkdir -p "${SCAN_DIR}/nested" "${WORKDIR}/scan_payloads"
+cp "${CARRIER_BMP}" "${SCAN_DIR}/clean.bmp"
+cp "${WORKDIR}/embedded_compress.bmp" "${SCAN_DIR}/nested/compressed.bmp"
+cp "${WORKDIR}/embedded_plain.bmp" "${SCAN_DIR}/plain.bmp"
+if ! "${STEGOBMP_BIN}" -analyze -scan "${SCAN_DIR}" -statistics -threads 2 -out "${WORKDIR}/scan_payloads" \
+    >"${WORKDIR}/scan.jsonl" 2>"${WORKDIR}/scan.log"; then
+    fail "Scan failed. Check ${WORKDIR}/scan.log"
+elif [[ $(grep -c '"method":"LSB1"' "${WORKDIR}/scan.jsonl") -ne 2 ]] || \
+     [[ $(grep -c '"method":null' "${WORKDIR}/scan.jsonl") -ne 1 ]]; then
+    fail "Unexpected scan results. Check ${WORKDIR}/scan.jsonl"
+else
+    SCAN_OK=1
+    while IFS= read -r payload; do
+        if ! cmp -s "${MESSAGE_FILE}" "${payload}"; then
+            fail "Scan saved a wrong payload: ${payload}"
+            SCAN_OK=0
+        fi
+    done < <(find "${WORKDIR}/scan_payloads" -type f)
+    if [[ $(find "${WORKDIR}/scan_payloads" -type f | wc -l) -ne 2 ]]; then
+        fail "Scan did not save both payloads"
+        SCAN_OK=0
+    fi
+    [[ ${SCAN_OK} -eq 1 ]] && echo "  OK"
+fi
+
+printf -- "\n----------------------------------------\n"
+if [[ ${FAILURES} -eq 0 ]]; then
+    printf -- "All CLI workflow tests succeeded.\n"
+else
+    printf -- "%d test(s) failed. Inspect the logs above.\n" "${FAILURES}"
+    exit 1
+fi
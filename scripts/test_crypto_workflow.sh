@@ -15,6 +15,9 @@ Runs embed/extract tests for:
       * -a + -pass (mode defaults to cbc)
       * -m + -pass (method defaults to aes128)
       * only -pass (aes128-cbc by default)
+  - Rejection of a wrong password and of a tampered carrier for the authenticated
+    modes (gcm, chacha20/poly1305), buffered and with -stream: extraction must
+    fail without leaving an output file.
 
 The carrier BMP must be a writable 24-bit image.
 
@@ -53,13 +56,17 @@ printf -- "Test payload generated at %s\n" "$(date -Iseconds)" > "${MESSAGE_FILE
 printf -- "abcdefghijklmnopqrstuvwxyz0123456789\n" >> "${MESSAGE_FILE}"
 
 declare -A MODES_BY_METHOD=(
-    ["aes128"]="ecb cbc cfb ofb"
-    ["aes192"]="ecb cbc cfb ofb"
-    ["aes256"]="ecb cbc cfb ofb"
+    ["aes128"]="ecb cbc cfb ofb gcm"
+    ["aes192"]="ecb cbc cfb ofb gcm"
+    ["aes256"]="ecb cbc cfb ofb gcm"
     ["3des"]="ecb cbc cfb ofb"
+    ["chacha20"]="poly1305"
 )
 
-METHODS=("aes128" "aes192" "aes256" "3des")
+METHODS=("aes128" "aes192" "aes256" "3des" "chacha20")
+
+# Authenticated method/mode pairs used by the rejection tests
+AEAD_PAIRS=("aes128 gcm" "aes256 gcm" "chacha20 poly1305")
 
 PASSWORD="codex-test-password"
 STEG_METHOD="LSB1"
@@ -176,9 +183,75 @@ run_default_test "a_plus_pass_3des" -a "3des" -pass "${PASSWORD}"
 run_default_test "m_plus_pass_cbc" -m "cbc" -pass "${PASSWORD}"
 run_default_test "pass_only" -pass "${PASSWORD}"
 
+printf -- "\n[+] Testing rejection of wrong passwords and tampered carriers\n"
+
+# Flips the low bit of one byte of a file in place
+flip_low_bit() {
+    local file="$1"
+    local offset="$2"
+    local byte
+    byte=$(od -An -tu1 -j "${offset}" -N1 "${file}" | tr -d ' ')
+    printf "\\$(printf '%03o' $((byte ^ 1)))" | dd of="${file}" bs=1 seek="${offset}" conv=notrunc status=none
+}
+
+# Pixel array offset (bfOffBits, little endian) of a BMP file
+pixel_data_offset() {
+    local bytes
+    read -r -a bytes <<<"$(od -An -tu1 -j 10 -N4 "$1")"
+    echo $((bytes[0] | bytes[1] << 8 | bytes[2] << 16 | bytes[3] << 24))
+}
+
+# Extraction of <bmp> must fail and leave nothing behind under <test_id>'s output prefix
+expect_rejected() {
+    local test_id="$1"
+    local bmp="$2"
+    shift 2
+
+    local recovery_prefix="${WORKDIR}/rejected_${test_id}"
+    local extract_log="${WORKDIR}/extract_rejected_${test_id}.log"
+    if "${STEGOBMP_BIN}" -extract -p "${bmp}" -out "${recovery_prefix}" -steg "${STEG_METHOD}" "$@" >"${extract_log}" 2>&1; then
+        echo "    Extraction of ${test_id} succeeded. Check ${extract_log}"
+        ((FAILURES++)) || true
+        return
+    fi
+    if compgen -G "${recovery_prefix}*" >/dev/null; then
+        echo "    Extraction of ${test_id} left an output file: $(compgen -G "${recovery_prefix}*" | head -n 1)"
+        ((FAILURES++)) || true
+        return
+    fi
+    echo "    OK"
+}
+
+for pair in "${AEAD_PAIRS[@]}"; do
+    read -r method mode <<<"${pair}"
+    for stream_flag in "" "-stream"; do
+        TEST_ID="${method}_${mode}${stream_flag:+_stream}"
+        OUT_BMP="${WORKDIR}/rejection_${TEST_ID}.bmp"
+        EMBED_LOG="${WORKDIR}/embed_rejection_${TEST_ID}.log"
+
+        if ! "${STEGOBMP_BIN}" -embed -in "${MESSAGE_FILE}" -p "${CARRIER_BMP}" -out "${OUT_BMP}" \
+            -steg "${STEG_METHOD}" -a "${method}" -m "${mode}" -pass "${PASSWORD}" ${stream_flag} >"${EMBED_LOG}" 2>&1; then
+            echo "  Embed failed. Check ${EMBED_LOG}"
+            ((FAILURES++)) || true
+            continue
+        fi
+
+        printf -- "\n  [-] Wrong password: %s\n" "${TEST_ID}"
+        expect_rejected "wrong_password_${TEST_ID}" "${OUT_BMP}" \
+            -a "${method}" -m "${mode}" -pass "wrong-${PASSWORD}" ${stream_flag}
+
+        # with LSB1 payload byte n lives in the low bits of carrier bytes 8n..8n+7:
+        # byte 60 is past the container header and inside the ciphertext
+        printf -- "\n  [-] Tampered carrier: %s\n" "${TEST_ID}"
+        flip_low_bit "${OUT_BMP}" $(($(pixel_data_offset "${OUT_BMP}") + 8 * 60))
+        expect_rejected "tampered_${TEST_ID}" "${OUT_BMP}" \
+            -a "${method}" -m "${mode}" -pass "${PASSWORD}" ${stream_flag}
+    done
+done
+
 printf -- "\n----------------------------------------\n"
 if [[ ${FAILURES} -eq 0 ]]; then
-    printf -- "All crypto embedding tests (including parser defaults) succeeded.\n"
+    printf -- "All crypto embedding tests (including parser defaults and rejections) succeeded.\n"
 else
     printf -- "%d test(s) failed. Inspect the logs above.\n" "${FAILURES}"
     exit 1
@@ -1,62 +1,21 @@
 #include "../../include/analysis/stego_analysis.h"
 #include "../../include/stegobmp/stegobmp_lsb.h"
 #include "../../include/stegobmp/stegobmp_utils.h"
+#include "../../include/stegobmp/stegobmp_compress.h"
 #include "../../include/bmp/bmp_utils.h"
+#include "../../include/diagnostics/diagnostics.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-#include <fcntl.h>
 
-typedef unsigned char *(*stego_analysis_retrieve_fn)(const BMP *, size_t *);
-
-typedef struct {
-    StegoAnalysisMethod method;
-    stego_analysis_retrieve_fn retrieve_fn;
-} StegoAnalysisCandidate;
-
-static unsigned char *call_retrieve_quiet(stego_analysis_retrieve_fn retrieve_fn, const BMP *bmp, size_t *extracted_size) {
-    if (!retrieve_fn) {
-        return NULL;
-    }
-
-    fflush(stdout);
-
-    const int stdout_fd = dup(STDOUT_FILENO);
-    if (stdout_fd < 0) {
-        return retrieve_fn(bmp, extracted_size);
-    }
-
-    const int devnull_fd = open("/dev/null", O_WRONLY);
-    if (devnull_fd < 0) {
-        close(stdout_fd);
-        return retrieve_fn(bmp, extracted_size);
-    }
-
-    if (dup2(devnull_fd, STDOUT_FILENO) < 0) {
-        close(devnull_fd);
-        close(stdout_fd);
-        return retrieve_fn(bmp, extracted_size);
-    }
-
-    close(devnull_fd);
-
-    unsigned char *payload_buffer = retrieve_fn(bmp, extracted_size);
-
-    fflush(stdout);
-    dup2(stdout_fd, STDOUT_FILENO);
-    close(stdout_fd);
-
-    return payload_buffer;
-}
-
-static int validate_payload_buffer(const unsigned char *payload_buffer, size_t payload_size, size_t *declared_payload_size) {
+static int validate_payload_buffer(const unsigned char *payload_buffer, size_t payload_size, size_t *declared_payload_size, int *compressed, int *checksum_verified) {
     if (!payload_buffer || payload_size < BMP_INT_SIZE_BYTES + STEGOBMP_NULL_CHARACTER_SIZE) {
         return 0;
     }
 
-    const uint32_t declared_size = read_uint32_big_endian(payload_buffer);
+    const uint32_t size_field = read_uint32_big_endian(payload_buffer);
+    const uint32_t declared_size = size_field & STEGOBMP_SIZE_LENGTH_MASK;
     size_t extension_offset = 0;
     size_t extension_length = 0;
 
@@ -69,9 +28,21 @@ static int validate_payload_buffer(const unsigned char *payload_buffer, size_t p
         return 0;
     }
 
+    /* a flagged checksum that does not match means this method decoded noise */
+    const int checksummed = (size_field & STEGOBMP_SIZE_CHECKSUM_FLAG) != 0;
+    if (checksummed && !stego_payload_checksum_matches(payload_buffer, payload_size, required_size)) {
+        return 0;
+    }
+
     if (declared_payload_size) {
         *declared_payload_size = declared_size;
     }
+    if (compressed) {
+        *compressed = (size_field & STEGOBMP_SIZE_COMPRESSED_FLAG) != 0;
+    }
+    if (checksum_verified) {
+        *checksum_verified = checksummed;
+    }
     return 1;
 }
 
@@ -83,6 +54,8 @@ void stego_analysis_result_init(StegoAnalysisResult *result) {
     result->method = STEGO_ANALYSIS_METHOD_UNKNOWN;
     result->declared_payload_size = 0;
     result->extracted_payload_size = 0;
+    result->compressed = 0;
+    result->checksum_verified = 0;
     result->payload = NULL;
 }
 
@@ -114,33 +87,58 @@ int stego_analysis_run(const BMP *bmp, StegoAnalysisResult *result) {
 
     stego_analysis_result_init(result);
 
-    const StegoAnalysisCandidate candidates[] = {
-        { STEGO_ANALYSIS_METHOD_LSB1, lsb_1_retrieve },
-        { STEGO_ANALYSIS_METHOD_LSB4, lsb_4_retrieve },
-        { STEGO_ANALYSIS_METHOD_LSBI, lsb_i_retrieve }
+    /* every method's header and extension window come out of one probe; only plausible ones are decoded in full */
+    static const StegoAnalysisMethod probe_methods[STEGOBMP_PROBE_COUNT] = {
+        STEGO_ANALYSIS_METHOD_LSB1,
+        STEGO_ANALYSIS_METHOD_LSB4,
+        STEGO_ANALYSIS_METHOD_LSBI
     };
 
-    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+    /* wrong guesses are expected here; silencing them is per thread, so scans can run side by side */
+    static const StegoDiagSink quiet_sink = { NULL, NULL, STEGO_DIAG_ERROR, 1 };
+    const StegoDiagSink *previous_sink = stego_diag_set_sink(&quiet_sink);
+
+    StegoBitPlanes planes;
+    if (stego_planes_init(&planes, bmp) != 0) {
+        stego_diag_set_sink(previous_sink);
+        return 1;
+    }
+
+    StegoLsbProbe probes[STEGOBMP_PROBE_COUNT];
+    lsb_probe_methods(bmp, &planes, probes);
+
+    int status = 1;
+    for (size_t i = 0; i < STEGOBMP_PROBE_COUNT && status; i++) {
+        if (!probes[i].plausible) {
+            continue;
+        }
+
         size_t extracted_size = 0;
-        unsigned char *payload_buffer = call_retrieve_quiet(candidates[i].retrieve_fn, bmp, &extracted_size);
+        unsigned char *payload_buffer = lsb_probe_retrieve(bmp, &planes, &probes[i], &extracted_size);
         if (!payload_buffer) {
             continue;
         }
 
         size_t declared_size = 0;
-        const int payload_valid = validate_payload_buffer(payload_buffer, extracted_size, &declared_size);
+        int compressed = 0;
+        int checksum_verified = 0;
+        const int payload_valid = validate_payload_buffer(payload_buffer, extracted_size, &declared_size, &compressed, &checksum_verified);
         if (!payload_valid) {
             free(payload_buffer);
             continue;
         }
 
         result->has_payload = 1;
-        result->method = candidates[i].method;
+        result->method = probe_methods[i];
         result->declared_payload_size = declared_size;
         result->extracted_payload_size = extracted_size;
+        result->compressed = compressed;
+        result->checksum_verified = checksum_verified;
         result->payload = payload_buffer;
-        return 0;
+        status = 0;
     }
 
-    return 1;
+    stego_planes_free(&planes);
+    stego_diag_set_sink(previous_sink);
+    return status;
 }
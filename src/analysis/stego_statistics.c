@@ -0,0 +1,222 @@
+#include "../../include/analysis/stego_statistics.h"
+
+#include <math.h>
+#include <string.h>
+
+/* The three kernels run over blocks of rows this large, so every block is read from memory once */
+#define STEGO_STATISTICS_BLOCK_BYTES (256 * 1024)
+
+/* Fewer groups or pairs than this per channel give no rate estimate (reported as 0) */
+#define STEGO_STATISTICS_MIN_SAMPLES 1024
+
+#define STEGO_STATISTICS_GAMMA_ITERATIONS 500
+#define STEGO_STATISTICS_GAMMA_EPSILON 1e-12
+#define STEGO_STATISTICS_GAMMA_TINY 1e-300
+
+/* Q(a, x) = 1 - P(a, x), by its series below a + 1 and by Lentz's continued fraction above */
+static double regularized_gamma_q(const double a, const double x) {
+    if (x <= 0.0) {
+        return 1.0;
+    }
+    const double log_prefix = a * log(x) - x - lgamma(a);
+
+    if (x < a + 1.0) {
+        double term = 1.0 / a;
+        double sum = term;
+        for (int n = 1; n < STEGO_STATISTICS_GAMMA_ITERATIONS; n++) {
+            term *= x / (a + n);
+            sum += term;
+            if (fabs(term) < fabs(sum) * STEGO_STATISTICS_GAMMA_EPSILON) {
+                break;
+            }
+        }
+        return 1.0 - sum * exp(log_prefix);
+    }
+
+    double b = x + 1.0 - a;
+    double c = 1.0 / STEGO_STATISTICS_GAMMA_TINY;
+    double d = 1.0 / b;
+    double h = d;
+    for (int i = 1; i < STEGO_STATISTICS_GAMMA_ITERATIONS; i++) {
+        const double an = -i * (i - a);
+        b += 2.0;
+        d = an * d + b;
+        if (fabs(d) < STEGO_STATISTICS_GAMMA_TINY) {
+            d = STEGO_STATISTICS_GAMMA_TINY;
+        }
+        c = b + an / c;
+        if (fabs(c) < STEGO_STATISTICS_GAMMA_TINY) {
+            c = STEGO_STATISTICS_GAMMA_TINY;
+        }
+        d = 1.0 / d;
+        const double delta = d * c;
+        h *= delta;
+        if (fabs(delta - 1.0) < STEGO_STATISTICS_GAMMA_EPSILON) {
+            break;
+        }
+    }
+    return exp(log_prefix) * h;
+}
+
+/* Westfeld and Pfitzmann: LSB replacement pulls the counts of 2k and 2k+1 towards their mean */
+static double chi_square_p_value(const uint64_t histogram[STEGOBMP_STAT_LEVELS], double *chi_square) {
+    double statistic = 0.0;
+    size_t categories = 0;
+
+    for (size_t level = 0; level < STEGOBMP_STAT_LEVELS; level += 2) {
+        const uint64_t pair_count = histogram[level] + histogram[level + 1];
+        if (pair_count < STEGO_STATISTICS_CHI_MIN_PAIR_COUNT) {
+            continue;
+        }
+        const double expected = (double) pair_count / 2.0;
+        const double deviation = (double) histogram[level] - expected;
+        statistic += deviation * deviation / expected;
+        categories++;
+    }
+
+    if (chi_square) {
+        *chi_square = statistic;
+    }
+    if (categories < 2) {
+        return 0.0;
+    }
+    return regularized_gamma_q((double) (categories - 1) / 2.0, statistic / 2.0);
+}
+
+static double clamp_rate(const double rate) {
+    if (!(rate > 0.0)) {
+        return 0.0;
+    }
+    return rate > 1.0 ? 1.0 : rate;
+}
+
+/* Root of a*z^2 + b*z + c closest to zero (a negative discriminant is taken as zero) */
+static double root_closest_to_zero(const double a, const double b, const double c) {
+    if (fabs(a) < 1e-12) {
+        return fabs(b) < 1e-12 ? 0.0 : -c / b;
+    }
+    double discriminant = b * b - 4.0 * a * c;
+    if (discriminant < 0.0) {
+        discriminant = 0.0;
+    }
+    const double root_plus = (-b + sqrt(discriminant)) / (2.0 * a);
+    const double root_minus = (-b - sqrt(discriminant)) / (2.0 * a);
+    return fabs(root_plus) < fabs(root_minus) ? root_plus : root_minus;
+}
+
+/* Fridrich, Goljan and Du: regular and singular groups drift apart under F1 and together under F-1 as LSBs randomise */
+static double rs_rate(const StegoRsCounts *counts) {
+    if (counts->groups < STEGO_STATISTICS_MIN_SAMPLES) {
+        return 0.0;
+    }
+    const double groups = (double) counts->groups;
+    const double d0 = ((double) counts->regular[STEGOBMP_RS_POSITIVE] - (double) counts->singular[STEGOBMP_RS_POSITIVE]) / groups;
+    const double d1 = ((double) counts->regular[STEGOBMP_RS_POSITIVE_INVERTED] - (double) counts->singular[STEGOBMP_RS_POSITIVE_INVERTED]) / groups;
+    const double n0 = ((double) counts->regular[STEGOBMP_RS_NEGATIVE] - (double) counts->singular[STEGOBMP_RS_NEGATIVE]) / groups;
+    const double n1 = ((double) counts->regular[STEGOBMP_RS_NEGATIVE_INVERTED] - (double) counts->singular[STEGOBMP_RS_NEGATIVE_INVERTED]) / groups;
+
+    const double z = root_closest_to_zero(2.0 * (d1 + d0), n0 - n1 - d1 - 3.0 * d0, d0 - n0);
+    if (fabs(z - 0.5) < 1e-12) {
+        return 1.0;
+    }
+    return clamp_rate(z / (z - 0.5));
+}
+
+/* Dumitrescu, Wu and Wang: gamma/2 p^2 + (2|X| - |P|) p + |Y| - |X| = 0 */
+static double sample_pair_rate(const StegoSamplePairCounts *counts) {
+    if (counts->pairs < STEGO_STATISTICS_MIN_SAMPLES || !counts->same_msbs) {
+        return 0.0;
+    }
+    const double a = (double) counts->same_msbs / 2.0;
+    const double b = 2.0 * (double) counts->x - (double) counts->pairs;
+    const double c = (double) counts->y - (double) counts->x;
+    return clamp_rate(root_closest_to_zero(a, b, c));
+}
+
+const char *stego_statistics_channel_name(const size_t channel) {
+    switch (channel) {
+        case 0:
+            return "blue";
+        case 1:
+            return "green";
+        case 2:
+            return "red";
+        default:
+            return "unknown";
+    }
+}
+
+int stego_statistics_run(const BMP *bmp, StegoStatisticsResult *result) {
+    if (!bmp || !result || !bmp->data || bmp->width <= 0 || bmp->height <= 0) {
+        return 1;
+    }
+    memset(result, 0, sizeof(*result));
+
+    const size_t width = (size_t) bmp->width;
+    const size_t height = (size_t) bmp->height;
+    const size_t row_bytes = (size_t) bmp->row_bytes;
+    size_t block_rows = STEGO_STATISTICS_BLOCK_BYTES / row_bytes;
+    if (block_rows == 0) {
+        block_rows = 1;
+    }
+
+    uint64_t histogram[STEGOBMP_STAT_CHANNELS][STEGOBMP_STAT_LEVELS];
+    StegoSamplePairCounts pairs[STEGOBMP_STAT_CHANNELS];
+    StegoRsCounts groups[STEGOBMP_STAT_CHANNELS];
+    memset(histogram, 0, sizeof(histogram));
+    memset(pairs, 0, sizeof(pairs));
+    memset(groups, 0, sizeof(groups));
+
+    /* sequential embedders start at the first stored row: the p-value of
+     * growing prefixes stays high until the prefix runs past the payload */
+    size_t embedded_rows[STEGOBMP_STAT_CHANNELS] = {0};
+    int prefix_embedded[STEGOBMP_STAT_CHANNELS] = {1, 1, 1};
+
+    for (size_t segment = 0; segment < STEGO_STATISTICS_SEGMENTS; segment++) {
+        const size_t first_row = height * segment / STEGO_STATISTICS_SEGMENTS;
+        const size_t end_row = height * (segment + 1) / STEGO_STATISTICS_SEGMENTS;
+        if (end_row == first_row) {
+            continue;
+        }
+
+        for (size_t row = first_row; row < end_row; row += block_rows) {
+            const size_t rows = end_row - row < block_rows ? end_row - row : block_rows;
+            const unsigned char *block = bmp->data + row * row_bytes;
+            stegobmp_channel_histograms(block, row_bytes, width, rows, histogram);
+            stegobmp_sample_pairs(block, row_bytes, width, rows, pairs);
+            stegobmp_rs_groups(block, row_bytes, width, rows, groups);
+        }
+
+        for (size_t channel = 0; channel < STEGOBMP_STAT_CHANNELS; channel++) {
+            if (!prefix_embedded[channel]) {
+                continue;
+            }
+            if (chi_square_p_value(histogram[channel], NULL) >= STEGO_STATISTICS_CHI_P_THRESHOLD) {
+                embedded_rows[channel] = end_row;
+            } else {
+                prefix_embedded[channel] = 0;
+            }
+        }
+    }
+
+    /* smooth histograms push short prefixes past the threshold on their own, so
+     * only a full-image p-value that high in every channel counts as a verdict */
+    int chi_square_embedded = 1;
+    for (size_t channel = 0; channel < STEGOBMP_STAT_CHANNELS; channel++) {
+        StegoChannelStatistics *statistics = &result->channels[channel];
+        statistics->chi_square_p_value = chi_square_p_value(histogram[channel], &statistics->chi_square);
+        statistics->chi_square_prefix = (double) embedded_rows[channel] / (double) height;
+        statistics->rs_rate = rs_rate(&groups[channel]);
+        statistics->sample_pair_rate = sample_pair_rate(&pairs[channel]);
+        statistics->embedding_rate = (statistics->rs_rate + statistics->sample_pair_rate) / 2.0;
+
+        if (statistics->chi_square_p_value < STEGO_STATISTICS_CHI_P_THRESHOLD) {
+            chi_square_embedded = 0;
+        }
+        result->embedding_rate += statistics->embedding_rate / STEGOBMP_STAT_CHANNELS;
+        result->chi_square_prefix += statistics->chi_square_prefix / STEGOBMP_STAT_CHANNELS;
+    }
+
+    result->suspicious = result->embedding_rate >= STEGO_STATISTICS_RATE_THRESHOLD || chi_square_embedded;
+    return 0;
+}
@@ -0,0 +1,291 @@
+#include "../../include/batch/batch.h"
+#include "../../include/crypto/crypto.h"
+#include "../../include/diagnostics/diagnostics.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    size_t line_number;
+    char *line;
+    char **argv;
+    int argc;
+    ProgramArguments arguments;
+    int status;
+} BatchJob;
+
+typedef struct {
+    BatchJob *jobs;
+    size_t job_count;
+    size_t next_job;
+    size_t failed_jobs;
+    batch_job_fn run_job;
+    pthread_mutex_t lock;
+} BatchQueue;
+
+/* what one job reported, printed under its result line so concurrent jobs do not interleave */
+typedef struct {
+    char *text;
+    size_t length;
+    size_t capacity;
+} BatchCapture;
+
+/* Splits line in place into whitespace separated tokens, honouring double quotes */
+static int tokenize_line(char *line, char ***argv_out) {
+    const size_t max_tokens = strlen(line) / 2 + 2;
+    char **argv = malloc((max_tokens + 1) * sizeof(char *));
+    if (!argv) {
+        return -1;
+    }
+
+    int argc = 0;
+    argv[argc++] = BATCH_PROGRAM_NAME;
+
+    char *read = line;
+    while (*read) {
+        while (*read && isspace((unsigned char) *read)) {
+            read++;
+        }
+        if (!*read) {
+            break;
+        }
+
+        char *token = read;
+        char *write = read;
+        int quoted = 0;
+        while (*read && (quoted || !isspace((unsigned char) *read))) {
+            if (*read == BATCH_QUOTE_CHARACTER) {
+                quoted = !quoted;
+            } else {
+                *write++ = *read;
+            }
+            read++;
+        }
+        if (quoted) {
+            free(argv);
+            return -1;
+        }
+        if (*read) {
+            read++;
+        }
+        *write = '\0';
+        argv[argc++] = token;
+    }
+
+    argv[argc] = NULL;
+    *argv_out = argv;
+    return argc;
+}
+
+static int is_blank_or_comment(const char *line) {
+    while (*line && isspace((unsigned char) *line)) {
+        line++;
+    }
+    return *line == '\0' || *line == BATCH_COMMENT_CHARACTER;
+}
+
+static void free_jobs(BatchJob *jobs, const size_t job_count) {
+    for (size_t i = 0; i < job_count; i++) {
+        OPENSSL_cleanse(jobs[i].arguments.key, sizeof(jobs[i].arguments.key));
+        free(jobs[i].argv);
+        free(jobs[i].line);
+    }
+    free(jobs);
+}
+
+/* Reads and validates the whole manifest up front so no worker starts on a broken one */
+static BatchJob *load_manifest(const char *manifest_filename, size_t *job_count) {
+    FILE *file = fopen(manifest_filename, "r");
+    if (!file) {
+        printf("Error: Could not open batch manifest %s\n", manifest_filename);
+        return NULL;
+    }
+
+    BatchJob *jobs = NULL;
+    size_t count = 0;
+    size_t allocated = 0;
+    size_t line_number = 0;
+    int failed = 0;
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    while (!failed && getline(&line, &line_capacity, file) >= 0) {
+        line_number++;
+        if (is_blank_or_comment(line)) {
+            continue;
+        }
+
+        if (count == allocated) {
+            const size_t new_allocated = allocated ? allocated * 2 : 16;
+            BatchJob *grown = realloc(jobs, new_allocated * sizeof(BatchJob));
+            if (!grown) {
+                printf("Error: Could not allocate memory for batch jobs\n");
+                failed = 1;
+                break;
+            }
+            jobs = grown;
+            allocated = new_allocated;
+        }
+
+        BatchJob *job = &jobs[count];
+        memset(job, 0, sizeof(*job));
+        job->line_number = line_number;
+        job->line = strdup(line);
+        job->argc = job->line ? tokenize_line(job->line, &job->argv) : -1;
+        count++;
+
+        if (job->argc < 0) {
+            printf("Error: Could not tokenize batch manifest line %zu\n", line_number);
+            failed = 1;
+        } else if (parse_arguments(job->argc, job->argv, &job->arguments)) {
+            printf("Error: Invalid job on batch manifest line %zu\n", line_number);
+            failed = 1;
+        } else if (!job->arguments.embed && !job->arguments.extract) {
+            printf("Error: Batch manifest line %zu: only -embed and -extract jobs can run in a batch\n", line_number);
+            failed = 1;
+        } else if (job->arguments.batch_filename) {
+            printf("Error: Batch manifest line %zu: -batch can not be nested\n", line_number);
+            failed = 1;
+        }
+    }
+
+    free(line);
+    fclose(file);
+
+    if (failed) {
+        free_jobs(jobs, count);
+        return NULL;
+    }
+    if (count == 0) {
+        printf("Error: Batch manifest %s holds no jobs\n", manifest_filename);
+        free(jobs);
+        return NULL;
+    }
+
+    *job_count = count;
+    return jobs;
+}
+
+static void batch_capture_report(void *context, const StegoDiagLevel level, const char *message) {
+    BatchCapture *capture = context;
+    char line[STEGO_DIAG_MESSAGE_SIZE + BATCH_CAPTURE_PREFIX_SIZE];
+    const int line_length = level == STEGO_DIAG_INFO
+        ? snprintf(line, sizeof(line), "  %s\n", message)
+        : snprintf(line, sizeof(line), "  %s: %s\n", stego_diag_level_name(level), message);
+    if (line_length <= 0) {
+        return;
+    }
+    const size_t length = (size_t) line_length < sizeof(line) ? (size_t) line_length : sizeof(line) - 1;
+
+    if (capture->length + length + 1 > capture->capacity) {
+        size_t new_capacity = capture->capacity ? capture->capacity * 2 : BATCH_CAPTURE_INITIAL_SIZE;
+        while (capture->length + length + 1 > new_capacity) {
+            new_capacity *= 2;
+        }
+        char *grown = realloc(capture->text, new_capacity);
+        if (!grown) {
+            return;
+        }
+        capture->text = grown;
+        capture->capacity = new_capacity;
+    }
+    memcpy(capture->text + capture->length, line, length);
+    capture->length += length;
+    capture->text[capture->length] = '\0';
+}
+
+static void *batch_worker(void *context) {
+    BatchQueue *queue = context;
+
+    BatchCapture capture = {0};
+    const StegoDiagSink sink = { batch_capture_report, &capture, STEGO_DIAG_DEBUG, 0 };
+    const StegoDiagSink *previous_sink = stego_diag_set_sink(&sink);
+
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        const size_t index = queue->next_job;
+        if (index < queue->job_count) {
+            queue->next_job++;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        if (index >= queue->job_count) {
+            break;
+        }
+
+        BatchJob *job = &queue->jobs[index];
+        capture.length = 0;
+        job->status = queue->run_job(&job->arguments) ? 1 : 0;
+
+        pthread_mutex_lock(&queue->lock);
+        queue->failed_jobs += (size_t) job->status;
+        printf("Job %zu (line %zu): %s\n", index + 1, job->line_number, job->status ? "failed" : "ok");
+        if (capture.length) {
+            fputs(capture.text, stdout);
+        }
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    stego_diag_set_sink(previous_sink);
+    free(capture.text);
+    return NULL;
+}
+
+int batch_run(const char *manifest_filename, size_t worker_count, const batch_job_fn run_job) {
+    size_t job_count = 0;
+    BatchJob *jobs = load_manifest(manifest_filename, &job_count);
+    if (!jobs) {
+        return 1;
+    }
+
+    if (worker_count == 0) {
+        const long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = online_cpus > 0 ? (size_t) online_cpus : 1;
+    }
+    if (worker_count > job_count) {
+        worker_count = job_count;
+    }
+
+    BatchQueue queue = {
+        .jobs = jobs,
+        .job_count = job_count,
+        .next_job = 0,
+        .failed_jobs = 0,
+        .run_job = run_job
+    };
+    pthread_mutex_init(&queue.lock, NULL);
+
+    pthread_t *workers = malloc(worker_count * sizeof(pthread_t));
+    size_t started = 0;
+    if (workers) {
+        while (started < worker_count && pthread_create(&workers[started], NULL, batch_worker, &queue) == 0) {
+            started++;
+        }
+    }
+    /* with no thread at all the jobs still run, just on the calling one */
+    if (started == 0) {
+        batch_worker(&queue);
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    printf("Batch finished: %zu jobs, %zu failed, %zu workers\n", job_count, queue.failed_jobs, started ? started : 1);
+
+    CryptoKeyCacheStats key_cache_stats;
+    crypto_key_cache_get_stats(&key_cache_stats);
+    printf("Key cache: %llu hits, %llu misses, %llu evictions\n",
+           (unsigned long long) key_cache_stats.hits,
+           (unsigned long long) key_cache_stats.misses,
+           (unsigned long long) key_cache_stats.evictions);
+
+    const int status = queue.failed_jobs ? 1 : 0;
+    pthread_mutex_destroy(&queue.lock);
+    free(workers);
+    free_jobs(jobs, job_count);
+    return status;
+}
@@ -1,63 +1,142 @@
 #include "../../include/bmp/bmp.h"
 #include "../../include/bmp/bmp_utils.h"
+#include "../../include/diagnostics/diagnostics.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-BMP *bmp_read(const char *bmp_filename)
+/* bmp_write goes through a sibling "<output>.tmp<pid>.<n>" file renamed over the output */
+#define BMP_WRITE_TEMP_SUFFIX ".tmp"
+#define BMP_WRITE_TEMP_DIGITS 20
+#define BMP_WRITE_TEMP_ATTEMPTS 16
+
+static int bmp_parse_header(BMP *bmp)
 {
-    FILE *file = fopen(bmp_filename, BMP_FILE_MODE_READ_BINARY);
-    if (!file)
+    bmp->width = read_int32_little_endian(bmp->header + BMP_HEADER_WIDTH_OFFSET);
+    bmp->height = read_int32_little_endian(bmp->header + BMP_HEADER_HEIGHT_OFFSET);
+    bmp->bits_per_pixel = read_int16_little_endian(bmp->header + BMP_HEADER_BITS_PER_PIXEL_OFFSET);
+    bmp->compression = read_int32_little_endian(bmp->header + BMP_HEADER_COMPRESSION_OFFSET);
+    bmp->pixel_data_offset = read_int32_little_endian(bmp->header + BMP_HEADER_PIXEL_DATA_OFFSET);
+
+    if (bmp->bits_per_pixel != BMP_BITS_PER_PIXEL || bmp->compression != BMP_NO_COMPRESSION)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Unsupported BMP format");
+        return 1;
+    }
+
+    // Compute row size with padding to 4-byte boundary
+    int64_t row_bytes = ((int64_t)bmp->width * BMP_BYTES_PER_PIXEL + 3) & ~3LL;
+    if (row_bytes <= 0)
     {
-        printf("Error: Can not open BMP file %s\n", bmp_filename);
+        stego_diag_report(STEGO_DIAG_ERROR, "Invalid BMP dimensions");
+        return 1;
+    }
+    bmp->row_bytes = (int32_t)row_bytes;
+    bmp->data_size = (size_t)row_bytes * (size_t)bmp->height;
+    return 0;
+}
+
+/*
+ * Maps the whole file MAP_PRIVATE and points data straight at the pixel array:
+ * only the pages a method actually decodes are read, and embedding modifies a
+ * copy-on-write view without touching the carrier file.
+ * Returns NULL with *fallback set when mapping is not possible.
+ */
+static BMP *bmp_read_mapped(const char *bmp_filename, int *fallback)
+{
+    *fallback = 1;
+
+    const int fd = open(bmp_filename, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size < BMP_HEADER_SIZE)
+    {
+        close(fd);
         return NULL;
     }
 
-    BMP *bmp = malloc(sizeof(BMP));
+    const size_t mapping_size = (size_t)file_stat.st_size;
+    unsigned char *mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return NULL;
+
+    BMP *bmp = calloc(1, sizeof(BMP));
     if (!bmp)
     {
-        fclose(file);
-        printf("Error: Can not allocate memory for BMP\n");
+        munmap(mapping, mapping_size);
         return NULL;
     }
+    bmp->mapping = mapping;
+    bmp->mapping_size = mapping_size;
 
-    if (fread(bmp->header, BMP_BYTE_SIZE, BMP_HEADER_SIZE, file) != BMP_HEADER_SIZE)
+    /* from here on the file is readable, so failures are real errors */
+    *fallback = 0;
+
+    memcpy(bmp->header, mapping, BMP_HEADER_SIZE);
+    if (bmp_parse_header(bmp))
     {
-        printf("Error: Can not read BMP header\n");
-        fclose(file);
         bmp_free(bmp);
         return NULL;
     }
 
-    bmp->width = read_int32_little_endian(bmp->header + BMP_HEADER_WIDTH_OFFSET);
-    bmp->height = read_int32_little_endian(bmp->header + BMP_HEADER_HEIGHT_OFFSET);
-    bmp->bits_per_pixel = read_int16_little_endian(bmp->header + BMP_HEADER_BITS_PER_PIXEL_OFFSET);
-    bmp->compression = read_int32_little_endian(bmp->header + BMP_HEADER_COMPRESSION_OFFSET);
-    bmp->pixel_data_offset = read_int32_little_endian(bmp->header + BMP_HEADER_PIXEL_DATA_OFFSET);
+    if (bmp->pixel_data_offset < 0 || (size_t)bmp->pixel_data_offset > mapping_size ||
+        bmp->data_size > mapping_size - (size_t)bmp->pixel_data_offset)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not read BMP pixel data");
+        bmp_free(bmp);
+        return NULL;
+    }
 
-    if (bmp->bits_per_pixel != BMP_BITS_PER_PIXEL || bmp->compression != BMP_NO_COMPRESSION)
+    bmp->data = mapping + bmp->pixel_data_offset;
+    return bmp;
+}
+
+static BMP *bmp_read_buffered(const char *bmp_filename)
+{
+    FILE *file = fopen(bmp_filename, BMP_FILE_MODE_READ_BINARY);
+    if (!file)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not open BMP file %s", bmp_filename);
+        return NULL;
+    }
+
+    BMP *bmp = calloc(1, sizeof(BMP));
+    if (!bmp)
+    {
+        fclose(file);
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not allocate memory for BMP");
+        return NULL;
+    }
+
+    if (fread(bmp->header, BMP_BYTE_SIZE, BMP_HEADER_SIZE, file) != BMP_HEADER_SIZE)
     {
-        printf("Error: Unsupported BMP format\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not read BMP header");
         fclose(file);
         bmp_free(bmp);
         return NULL;
     }
 
-    // Compute row size with padding to 4-byte boundary
-    int64_t row_bytes = ((int64_t)bmp->width * BMP_BYTES_PER_PIXEL + 3) & ~3LL;
-    if (row_bytes <= 0)
+    if (bmp_parse_header(bmp))
     {
-        printf("Error: Invalid BMP dimensions\n");
         fclose(file);
         bmp_free(bmp);
         return NULL;
     }
-    bmp->row_bytes = (int32_t)row_bytes;
-    bmp->data_size = (size_t)row_bytes * (size_t)bmp->height;
+
     bmp->data = malloc(bmp->data_size);
     if (!bmp->data)
     {
-        printf("Error: Can not allocate memory for BMP data\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not allocate memory for BMP data");
         fclose(file);
         bmp_free(bmp);
         return NULL;
@@ -66,7 +145,7 @@ BMP *bmp_read(const char *bmp_filename)
     // Seek to pixel array offset and read full rows including padding
     if (fseek(file, bmp->pixel_data_offset, SEEK_SET) != 0)
     {
-        printf("Error: Can not seek to BMP pixel data\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not seek to BMP pixel data");
         fclose(file);
         bmp_free(bmp);
         return NULL;
@@ -74,7 +153,7 @@ BMP *bmp_read(const char *bmp_filename)
 
     if (fread(bmp->data, BMP_BYTE_SIZE, bmp->data_size, file) != bmp->data_size)
     {
-        printf("Error: Can not read BMP pixel data\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not read BMP pixel data");
         fclose(file);
         bmp_free(bmp);
         return NULL;
@@ -84,21 +163,58 @@ BMP *bmp_read(const char *bmp_filename)
     return bmp;
 }
 
-int bmp_write(BMP *bmp, const char *output_bmp_filename)
+BMP *bmp_read(const char *bmp_filename)
 {
-    if (!output_bmp_filename || !bmp)
-    {
-        printf("Error: Can not open BMP\n");
-        return 1;
-    }
+    int fallback = 0;
+    BMP *bmp = bmp_read_mapped(bmp_filename, &fallback);
+    if (bmp || !fallback)
+        return bmp;
 
-    FILE *file = fopen(output_bmp_filename, BMP_FILE_MODE_WRITE_BINARY);
-    if (!file)
+    return bmp_read_buffered(bmp_filename);
+}
+
+BMP *bmp_read_copy(const char *bmp_filename)
+{
+    return bmp_read_buffered(bmp_filename);
+}
+
+/*
+ * Creates "<target><BMP_WRITE_TEMP_SUFFIX><pid>.<n>" next to the target with the
+ * permissions fopen("wb") would give (an existing target keeps its own mode).
+ * Returns the descriptor and the name to rename, or -1.
+ */
+static int bmp_open_temporary(const char *target, char **temp_filename)
+{
+    static atomic_uint temp_counter;
+    const size_t name_size = strlen(target) + sizeof(BMP_WRITE_TEMP_SUFFIX) + 2 * BMP_WRITE_TEMP_DIGITS + 2;
+    char *name = malloc(name_size);
+    if (!name)
+        return -1;
+
+    struct stat target_stat;
+    const int keep_mode = stat(target, &target_stat) == 0 && S_ISREG(target_stat.st_mode);
+
+    for (int attempt = 0; attempt < BMP_WRITE_TEMP_ATTEMPTS; ++attempt)
     {
-        printf("Error: Can not open file for writing: %s\n", output_bmp_filename);
-        return 1;
+        snprintf(name, name_size, "%s" BMP_WRITE_TEMP_SUFFIX "%ld.%u", target, (long)getpid(), atomic_fetch_add(&temp_counter, 1));
+        const int fd = open(name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0)
+        {
+            if (keep_mode)
+                fchmod(fd, target_stat.st_mode & 07777);
+            *temp_filename = name;
+            return fd;
+        }
+        if (errno != EEXIST)
+            break;
     }
 
+    free(name);
+    return -1;
+}
+
+static int bmp_write_stream(BMP *bmp, FILE *file)
+{
     write_int32_little_endian(bmp->header + BMP_HEADER_WIDTH_OFFSET, bmp->width);
     write_int32_little_endian(bmp->header + BMP_HEADER_HEIGHT_OFFSET, bmp->height);
     write_int16_little_endian(bmp->header + BMP_HEADER_BITS_PER_PIXEL_OFFSET, bmp->bits_per_pixel);
@@ -106,8 +222,7 @@ int bmp_write(BMP *bmp, const char *output_bmp_filename)
 
     if (fwrite(bmp->header, BMP_BYTE_SIZE, BMP_HEADER_SIZE, file) != BMP_HEADER_SIZE)
     {
-        printf("Error: Can not write BMP header\n");
-        fclose(file);
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not write BMP header");
         return 1;
     }
 
@@ -123,12 +238,128 @@ int bmp_write(BMP *bmp, const char *output_bmp_filename)
 
     if (fwrite(bmp->data, BMP_BYTE_SIZE, bmp->data_size, file) != bmp->data_size)
     {
-        printf("Error: Can not write BMP pixel data\n");
-        fclose(file);
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not write BMP pixel data");
         return 1;
     }
+    return 0;
+}
 
-    fclose(file);
+/*
+ * The carrier may still be mapped from the output file itself (-out naming the
+ * -p carrier): truncating it in place would fault every page not read yet, so
+ * the image goes to a temporary file in the same directory that then replaces it.
+ */
+int bmp_write(BMP *bmp, const char *output_bmp_filename)
+{
+    if (!output_bmp_filename || !bmp)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not open BMP");
+        return 1;
+    }
+
+    char *temp_filename = NULL;
+    const int fd = bmp_open_temporary(output_bmp_filename, &temp_filename);
+    FILE *file = fd >= 0 ? fdopen(fd, BMP_FILE_MODE_WRITE_BINARY) : NULL;
+    if (!file)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not open file for writing: %s", output_bmp_filename);
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(temp_filename);
+        }
+        free(temp_filename);
+        return 1;
+    }
+
+    int status = bmp_write_stream(bmp, file);
+    if (fclose(file) != 0 && !status)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not write BMP file %s", output_bmp_filename);
+        status = 1;
+    }
+    if (!status && rename(temp_filename, output_bmp_filename) != 0)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not replace BMP file %s", output_bmp_filename);
+        status = 1;
+    }
+    if (status)
+        unlink(temp_filename);
+
+    free(temp_filename);
+    return status;
+}
+
+void bmp_mark_dirty(BMP *bmp, const size_t begin, size_t end)
+{
+    if (!bmp)
+        return;
+    if (end > bmp->data_size)
+        end = bmp->data_size;
+    if (begin >= end)
+        return;
+
+    if (bmp->dirty_begin == bmp->dirty_end)
+    {
+        bmp->dirty_begin = begin;
+        bmp->dirty_end = end;
+        return;
+    }
+    if (begin < bmp->dirty_begin)
+        bmp->dirty_begin = begin;
+    if (end > bmp->dirty_end)
+        bmp->dirty_end = end;
+}
+
+/*
+ * Patches only the modified pixel range back into an existing BMP file (the one
+ * the carrier was read from): header, padding and untouched pixels stay as they are.
+ */
+int bmp_write_dirty_range(const BMP *bmp, const char *bmp_filename, const int sync)
+{
+    if (!bmp || !bmp_filename)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not open BMP");
+        return 1;
+    }
+
+    const int fd = open(bmp_filename, O_WRONLY);
+    if (fd < 0)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not open file for writing: %s", bmp_filename);
+        return 1;
+    }
+
+    const unsigned char *cursor = bmp->data + bmp->dirty_begin;
+    size_t remaining = bmp->dirty_end - bmp->dirty_begin;
+    off_t offset = (off_t)bmp->pixel_data_offset + (off_t)bmp->dirty_begin;
+
+    while (remaining > 0)
+    {
+        const ssize_t written = pwrite(fd, cursor, remaining, offset);
+        if (written <= 0)
+        {
+            stego_diag_report(STEGO_DIAG_ERROR, "Can not write BMP pixel data");
+            close(fd);
+            return 1;
+        }
+        cursor += written;
+        remaining -= (size_t)written;
+        offset += written;
+    }
+
+    if (sync && fsync(fd) != 0)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not sync BMP file %s", bmp_filename);
+        close(fd);
+        return 1;
+    }
+
+    if (close(fd) != 0)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Can not close BMP file %s", bmp_filename);
+        return 1;
+    }
     return 0;
 }
 
@@ -136,7 +367,9 @@ void bmp_free(BMP *bmp)
 {
     if (!bmp)
         return;
-    if (bmp->data)
+    if (bmp->mapping)
+        munmap(bmp->mapping, bmp->mapping_size);
+    else if (bmp->data)
         free(bmp->data);
     free(bmp);
-}
\ No newline at end of file
+}
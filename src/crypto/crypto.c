@@ -1,10 +1,21 @@
 #include "../../include/crypto/crypto.h"
+#include "../../include/diagnostics/diagnostics.h"
 
+#include <openssl/crypto.h>
 #include <openssl/evp.h>
+#include <openssl/hmac.h>
 
-#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <unistd.h>
+
+struct CryptoStream {
+    EVP_CIPHER_CTX *ctx;
+    int encrypt;
+    int aead;
+};
 
 static int is_null_or_empty(const char *value) {
     return !value || value[0] == '\0';
@@ -12,7 +23,7 @@ static int is_null_or_empty(const char *value) {
 
 static int passthrough_copy(unsigned char *destination, const unsigned char *source, int length) {
     if (!destination || !source || length < 0) {
-        printf("Error: Invalid arguments for passthrough copy\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Invalid arguments for passthrough copy");
         return -1;
     }
 
@@ -23,55 +34,290 @@ static int passthrough_copy(unsigned char *destination, const unsigned char *sou
     return length;
 }
 
-static const EVP_CIPHER *resolve_cipher(const char *method, const char *mode) {
+typedef struct {
+    CryptoCipher descriptor;
+    const char *fetch_name;
+    const EVP_CIPHER *(*builtin)(void);
+    EVP_CIPHER *fetched;
+} CryptoCipherEntry;
+
+static CryptoCipherEntry cipher_table[] = {
+    {.descriptor = {.method = "aes128", .mode = "ecb"}, .fetch_name = "AES-128-ECB", .builtin = EVP_aes_128_ecb},
+    {.descriptor = {.method = "aes128", .mode = "cbc"}, .fetch_name = "AES-128-CBC", .builtin = EVP_aes_128_cbc},
+    {.descriptor = {.method = "aes128", .mode = "cfb"}, .fetch_name = "AES-128-CFB", .builtin = EVP_aes_128_cfb128},
+    {.descriptor = {.method = "aes128", .mode = "ofb"}, .fetch_name = "AES-128-OFB", .builtin = EVP_aes_128_ofb},
+    {.descriptor = {.method = "aes192", .mode = "ecb"}, .fetch_name = "AES-192-ECB", .builtin = EVP_aes_192_ecb},
+    {.descriptor = {.method = "aes192", .mode = "cbc"}, .fetch_name = "AES-192-CBC", .builtin = EVP_aes_192_cbc},
+    {.descriptor = {.method = "aes192", .mode = "cfb"}, .fetch_name = "AES-192-CFB", .builtin = EVP_aes_192_cfb128},
+    {.descriptor = {.method = "aes192", .mode = "ofb"}, .fetch_name = "AES-192-OFB", .builtin = EVP_aes_192_ofb},
+    {.descriptor = {.method = "aes256", .mode = "ecb"}, .fetch_name = "AES-256-ECB", .builtin = EVP_aes_256_ecb},
+    {.descriptor = {.method = "aes256", .mode = "cbc"}, .fetch_name = "AES-256-CBC", .builtin = EVP_aes_256_cbc},
+    {.descriptor = {.method = "aes256", .mode = "cfb"}, .fetch_name = "AES-256-CFB", .builtin = EVP_aes_256_cfb128},
+    {.descriptor = {.method = "aes256", .mode = "ofb"}, .fetch_name = "AES-256-OFB", .builtin = EVP_aes_256_ofb},
+    {.descriptor = {.method = "3des", .mode = "ecb"}, .fetch_name = "DES-EDE3-ECB", .builtin = EVP_des_ede3_ecb},
+    {.descriptor = {.method = "3des", .mode = "cbc"}, .fetch_name = "DES-EDE3-CBC", .builtin = EVP_des_ede3_cbc},
+    {.descriptor = {.method = "3des", .mode = "cfb"}, .fetch_name = "DES-EDE3-CFB", .builtin = EVP_des_ede3_cfb64},
+    {.descriptor = {.method = "3des", .mode = "ofb"}, .fetch_name = "DES-EDE3-OFB", .builtin = EVP_des_ede3_ofb},
+    {.descriptor = {.method = "aes128", .mode = "gcm"}, .fetch_name = "AES-128-GCM", .builtin = EVP_aes_128_gcm},
+    {.descriptor = {.method = "aes192", .mode = "gcm"}, .fetch_name = "AES-192-GCM", .builtin = EVP_aes_192_gcm},
+    {.descriptor = {.method = "aes256", .mode = "gcm"}, .fetch_name = "AES-256-GCM", .builtin = EVP_aes_256_gcm},
+    {.descriptor = {.method = "chacha20", .mode = "poly1305"}, .fetch_name = "ChaCha20-Poly1305", .builtin = EVP_chacha20_poly1305},
+};
+
+#define CRYPTO_CIPHER_COUNT (sizeof(cipher_table) / sizeof(cipher_table[0]))
+
+/* Idle contexts kept per thread; they are reset, not freed, between operations */
+typedef struct {
+    EVP_CIPHER_CTX *idle[CRYPTO_CONTEXT_POOL_SIZE];
+    int count;
+} CryptoContextPool;
+
+static pthread_once_t cipher_table_once = PTHREAD_ONCE_INIT;
+static pthread_key_t context_pool_key;
+static int context_pool_ready;
+
+static void cipher_table_release(void) {
+    for (size_t i = 0; i < CRYPTO_CIPHER_COUNT; i++) {
+        EVP_CIPHER_free(cipher_table[i].fetched);
+        cipher_table[i].fetched = NULL;
+    }
+}
+
+static void context_pool_destroy(void *value) {
+    CryptoContextPool *pool = value;
+    for (int i = 0; i < pool->count; i++) {
+        EVP_CIPHER_CTX_free(pool->idle[i]);
+    }
+    free(pool);
+}
+
+/* Explicitly fetched ciphers skip the provider lookup implicit EVP_aes_*() objects do on every init */
+static void cipher_table_init(void) {
+    for (size_t i = 0; i < CRYPTO_CIPHER_COUNT; i++) {
+        CryptoCipherEntry *entry = &cipher_table[i];
+        const EVP_CIPHER *cipher = NULL;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        entry->fetched = EVP_CIPHER_fetch(NULL, entry->fetch_name, NULL);
+        cipher = entry->fetched;
+#endif
+        if (!cipher) {
+            cipher = entry->builtin();
+        }
+        entry->descriptor.cipher = cipher;
+        entry->descriptor.key_length = EVP_CIPHER_key_length(cipher);
+        entry->descriptor.iv_length = EVP_CIPHER_iv_length(cipher);
+        entry->descriptor.block_size = EVP_CIPHER_block_size(cipher);
+        entry->descriptor.aead = (EVP_CIPHER_flags(cipher) & EVP_CIPH_FLAG_AEAD_CIPHER) != 0;
+        entry->descriptor.tag_length = entry->descriptor.aead ? CRYPTO_AEAD_TAG_SIZE : 0;
+    }
+    atexit(cipher_table_release);
+
+    context_pool_ready = pthread_key_create(&context_pool_key, context_pool_destroy) == 0;
+}
+
+static EVP_CIPHER_CTX *context_acquire(void) {
+    CryptoContextPool *pool = context_pool_ready ? pthread_getspecific(context_pool_key) : NULL;
+    if (pool && pool->count > 0) {
+        return pool->idle[--pool->count];
+    }
+    return EVP_CIPHER_CTX_new();
+}
+
+static void context_release(EVP_CIPHER_CTX *ctx) {
+    if (!ctx) {
+        return;
+    }
+
+    /* reset wipes the key schedule, so a pooled context holds no secrets */
+    EVP_CIPHER_CTX_reset(ctx);
+
+    CryptoContextPool *pool = context_pool_ready ? pthread_getspecific(context_pool_key) : NULL;
+    if (!pool && context_pool_ready) {
+        pool = calloc(1, sizeof(CryptoContextPool));
+        if (pool && pthread_setspecific(context_pool_key, pool) != 0) {
+            free(pool);
+            pool = NULL;
+        }
+    }
+
+    if (pool && pool->count < CRYPTO_CONTEXT_POOL_SIZE) {
+        pool->idle[pool->count++] = ctx;
+    } else {
+        EVP_CIPHER_CTX_free(ctx);
+    }
+}
+
+const CryptoCipher *crypto_cipher_lookup(const char *method, const char *mode) {
     if (is_null_or_empty(method) || is_null_or_empty(mode)) {
         return NULL;
     }
 
-    const int method_is_aes128 = strcasecmp(method, "aes128") == 0;
-    const int method_is_aes192 = strcasecmp(method, "aes192") == 0;
-    const int method_is_aes256 = strcasecmp(method, "aes256") == 0;
-    const int method_is_3des = strcasecmp(method, "3des") == 0;
-
-    if (method_is_aes128) {
-        if (strcasecmp(mode, "ecb") == 0) return EVP_aes_128_ecb();
-        if (strcasecmp(mode, "cbc") == 0) return EVP_aes_128_cbc();
-        if (strcasecmp(mode, "cfb") == 0) return EVP_aes_128_cfb128();
-        if (strcasecmp(mode, "ofb") == 0) return EVP_aes_128_ofb();
-    } else if (method_is_aes192) {
-        if (strcasecmp(mode, "ecb") == 0) return EVP_aes_192_ecb();
-        if (strcasecmp(mode, "cbc") == 0) return EVP_aes_192_cbc();
-        if (strcasecmp(mode, "cfb") == 0) return EVP_aes_192_cfb128();
-        if (strcasecmp(mode, "ofb") == 0) return EVP_aes_192_ofb();
-    } else if (method_is_aes256) {
-        if (strcasecmp(mode, "ecb") == 0) return EVP_aes_256_ecb();
-        if (strcasecmp(mode, "cbc") == 0) return EVP_aes_256_cbc();
-        if (strcasecmp(mode, "cfb") == 0) return EVP_aes_256_cfb128();
-        if (strcasecmp(mode, "ofb") == 0) return EVP_aes_256_ofb();
-    } else if (method_is_3des) {
-        if (strcasecmp(mode, "ecb") == 0) return EVP_des_ede3_ecb();
-        if (strcasecmp(mode, "cbc") == 0) return EVP_des_ede3_cbc();
-        if (strcasecmp(mode, "cfb") == 0) return EVP_des_ede3_cfb64();
-        if (strcasecmp(mode, "ofb") == 0) return EVP_des_ede3_ofb();
+    pthread_once(&cipher_table_once, cipher_table_init);
+
+    for (size_t i = 0; i < CRYPTO_CIPHER_COUNT; i++) {
+        const CryptoCipher *descriptor = &cipher_table[i].descriptor;
+        if (strcasecmp(method, descriptor->method) == 0 && strcasecmp(mode, descriptor->mode) == 0) {
+            return descriptor;
+        }
     }
 
     return NULL;
 }
 
-static int derive_key(const EVP_CIPHER *cipher, const char *password, const unsigned char *salt, unsigned char *key_buffer) {
-    if (!cipher || is_null_or_empty(password) || !key_buffer) {
+/*
+ * The PBKDF2 salt is fixed, so (password, key length) always yields the same
+ * key. Derived keys are cached under the SHA-256 of the password; the slot
+ * used longest ago is evicted when the table is full. Every slot is wiped on
+ * eviction, on crypto_key_cache_clear and at exit.
+ */
+typedef struct {
+    int used;
+    int key_length;
+    uint64_t last_use;
+    unsigned char password_digest[CRYPTO_KEY_CACHE_DIGEST_SIZE];
+    unsigned char key[EVP_MAX_KEY_LENGTH];
+} CryptoKeyCacheEntry;
+
+static CryptoKeyCacheEntry key_cache[CRYPTO_KEY_CACHE_CAPACITY];
+static CryptoKeyCacheStats key_cache_stats;
+static uint64_t key_cache_clock;
+static pthread_mutex_t key_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_cache_once = PTHREAD_ONCE_INIT;
+
+static void key_cache_register_cleanup(void) {
+    atexit(crypto_key_cache_clear);
+}
+
+static void key_cache_wipe(CryptoKeyCacheEntry *entry) {
+    OPENSSL_cleanse(entry, sizeof(*entry));
+}
+
+static int key_cache_lookup(const unsigned char *password_digest, const int key_length, unsigned char *key_buffer) {
+    int found = 0;
+
+    pthread_mutex_lock(&key_cache_lock);
+    for (int i = 0; i < CRYPTO_KEY_CACHE_CAPACITY; i++) {
+        CryptoKeyCacheEntry *entry = &key_cache[i];
+        if (entry->used && entry->key_length == key_length &&
+            CRYPTO_memcmp(entry->password_digest, password_digest, CRYPTO_KEY_CACHE_DIGEST_SIZE) == 0) {
+            memcpy(key_buffer, entry->key, (size_t) key_length);
+            entry->last_use = ++key_cache_clock;
+            found = 1;
+            break;
+        }
+    }
+    if (found) {
+        key_cache_stats.hits++;
+    } else {
+        key_cache_stats.misses++;
+    }
+    pthread_mutex_unlock(&key_cache_lock);
+
+    return found;
+}
+
+static void key_cache_store(const unsigned char *password_digest, const int key_length, const unsigned char *key) {
+    pthread_once(&key_cache_once, key_cache_register_cleanup);
+
+    pthread_mutex_lock(&key_cache_lock);
+    CryptoKeyCacheEntry *slot = NULL;
+    for (int i = 0; i < CRYPTO_KEY_CACHE_CAPACITY; i++) {
+        CryptoKeyCacheEntry *entry = &key_cache[i];
+        /* another thread may have derived the same key meanwhile */
+        if (entry->used && entry->key_length == key_length &&
+            CRYPTO_memcmp(entry->password_digest, password_digest, CRYPTO_KEY_CACHE_DIGEST_SIZE) == 0) {
+            slot = entry;
+            break;
+        }
+        if (!slot || (slot->used && (!entry->used || entry->last_use < slot->last_use))) {
+            slot = entry;
+        }
+    }
+
+    if (slot->used && (slot->key_length != key_length ||
+                       CRYPTO_memcmp(slot->password_digest, password_digest, CRYPTO_KEY_CACHE_DIGEST_SIZE) != 0)) {
+        key_cache_stats.evictions++;
+    }
+    if (!slot->used) {
+        key_cache_stats.entries++;
+    }
+    key_cache_wipe(slot);
+    slot->used = 1;
+    slot->key_length = key_length;
+    slot->last_use = ++key_cache_clock;
+    memcpy(slot->password_digest, password_digest, CRYPTO_KEY_CACHE_DIGEST_SIZE);
+    memcpy(slot->key, key, (size_t) key_length);
+    pthread_mutex_unlock(&key_cache_lock);
+}
+
+void crypto_key_cache_clear(void) {
+    pthread_mutex_lock(&key_cache_lock);
+    for (int i = 0; i < CRYPTO_KEY_CACHE_CAPACITY; i++) {
+        key_cache_wipe(&key_cache[i]);
+    }
+    key_cache_stats.entries = 0;
+    pthread_mutex_unlock(&key_cache_lock);
+}
+
+void crypto_key_cache_get_stats(CryptoKeyCacheStats *stats) {
+    pthread_mutex_lock(&key_cache_lock);
+    *stats = key_cache_stats;
+    pthread_mutex_unlock(&key_cache_lock);
+}
+
+CryptoSecret crypto_secret_password(const char *password) {
+    const CryptoSecret secret = { password, NULL, 0 };
+    return secret;
+}
+
+CryptoSecret crypto_secret_key(const unsigned char *key, const size_t key_length) {
+    const CryptoSecret secret = { NULL, key, key_length };
+    return secret;
+}
+
+int crypto_secret_is_set(const CryptoSecret *secret) {
+    return secret && (secret->key ? secret->key_length > 0 : !is_null_or_empty(secret->password));
+}
+
+int crypto_secret_is_raw_key(const CryptoSecret *secret) {
+    return secret && secret->key != NULL;
+}
+
+static int derive_key(const CryptoCipher *cipher, const CryptoSecret *secret, const unsigned char *salt, unsigned char *key_buffer) {
+    if (!cipher || !crypto_secret_is_set(secret) || !key_buffer) {
         return 0;
     }
 
     (void) salt; /* PBKDF2 salt is fixed by TP spec */
 
-    const int expected_key_length = EVP_CIPHER_key_length(cipher);
+    const int expected_key_length = cipher->key_length;
+
+    /* a supplied key is used as is, PBKDF2 and the cache are skipped altogether */
+    if (secret->key) {
+        if (secret->key_length != (size_t) expected_key_length) {
+            stego_diag_report(STEGO_DIAG_ERROR, "%s-%s needs a %d-byte key, %zu bytes were supplied", cipher->method, cipher->mode, expected_key_length, secret->key_length);
+            return 0;
+        }
+        memcpy(key_buffer, secret->key, secret->key_length);
+        return 1;
+    }
+
+    const char *password = secret->password;
+    const size_t password_length = strlen(password);
+
+    unsigned char password_digest[CRYPTO_KEY_CACHE_DIGEST_SIZE];
+    const int cacheable = EVP_Digest(password, password_length, password_digest, NULL, EVP_sha256(), NULL) == 1;
+    if (cacheable && key_cache_lookup(password_digest, expected_key_length, key_buffer)) {
+        OPENSSL_cleanse(password_digest, sizeof(password_digest));
+        return 1;
+    }
+
     unsigned char fixed_salt[8] = {0}; /* 0x0000000000000000 */
     const int iterations = 10000;
 
     const int ok = PKCS5_PBKDF2_HMAC(
         password,
-        (int) strlen(password),
+        (int) password_length,
         fixed_salt,
         (int) sizeof fixed_salt,
         iterations,
@@ -81,53 +327,54 @@ static int derive_key(const EVP_CIPHER *cipher, const char *password, const unsi
     );
 
     if (ok != 1) {
-        printf("Error: Could not derive key from password using PBKDF2\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not derive key from password using PBKDF2");
+        OPENSSL_cleanse(password_digest, sizeof(password_digest));
         return 0;
     }
 
+    if (cacheable) {
+        key_cache_store(password_digest, expected_key_length, key_buffer);
+    }
+    OPENSSL_cleanse(password_digest, sizeof(password_digest));
     return 1;
 }
 
-int crypto_encrypt(
-    const unsigned char *plain_text,
-    int plain_tex_lenght,
-    const char *method,
-    const char *mode,
-    const char *password,
+int crypto_derive_key(const CryptoCipher *cipher, const CryptoSecret *secret, const unsigned char *salt, unsigned char *key) {
+    return derive_key(cipher, secret, salt, key) ? 0 : 1;
+}
+
+/* One-shot encryption or decryption on a pooled context */
+static int cipher_run(
+    const CryptoCipher *cipher,
+    const int encrypt,
+    const unsigned char *input,
+    const int input_length,
+    const CryptoSecret *secret,
     const unsigned char *salt,
     const unsigned char *iv,
-    unsigned char *ciphertext) {
-
-    if (!plain_text || !ciphertext || plain_tex_lenght < 0) {
-        printf("Error: Invalid arguments for encryption\n");
-        return -1;
-    }
+    unsigned char *output) {
 
-    if (is_null_or_empty(method) || is_null_or_empty(mode) || is_null_or_empty(password)) {
-        return passthrough_copy(ciphertext, plain_text, plain_tex_lenght);
-    }
+    const char *operation = encrypt ? "encryption" : "decryption";
 
-    const EVP_CIPHER *cipher = resolve_cipher(method, mode);
-    if (!cipher) {
-        printf("Error: Unsupported cipher method (%s) or mode (%s)\n", method ? method : "null", mode ? mode : "null");
+    if (cipher->aead) {
+        stego_diag_report(STEGO_DIAG_ERROR, "%s-%s is authenticated, use crypto_aead_encrypt/crypto_aead_decrypt", cipher->method, cipher->mode);
         return -1;
     }
 
-    const int iv_length = EVP_CIPHER_iv_length(cipher);
-    if (iv_length > 0 && !iv) {
-        printf("Error: Selected cipher mode requires an IV\n");
+    if (cipher->iv_length > 0 && !iv) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Selected cipher mode requires an IV");
         return -1;
     }
 
     unsigned char key_buffer[EVP_MAX_KEY_LENGTH];
-    if (!derive_key(cipher, password, salt, key_buffer)) {
+    if (!derive_key(cipher, secret, salt, key_buffer)) {
         memset(key_buffer, 0, sizeof(key_buffer));
         return -1;
     }
 
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    EVP_CIPHER_CTX *ctx = context_acquire();
     if (!ctx) {
-        printf("Error: Could not allocate cipher context\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate cipher context");
         memset(key_buffer, 0, sizeof(key_buffer));
         return -1;
     }
@@ -136,24 +383,23 @@ int crypto_encrypt(
     int current_length = 0;
     int total_length = 0;
 
-    if (EVP_EncryptInit_ex(ctx, cipher, NULL, NULL, NULL) != 1) {
-        printf("Error: Could not initialise encryption operation\n");
+    if (EVP_CipherInit_ex(ctx, cipher->cipher, NULL, key_buffer, cipher->iv_length > 0 ? iv : NULL, encrypt) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not initialise %s operation", operation);
         goto cleanup;
     }
 
-    if (EVP_EncryptInit_ex(ctx, NULL, NULL, key_buffer, iv_length > 0 ? iv : NULL) != 1) {
-        printf("Error: Could not set key and IV for encryption\n");
-        goto cleanup;
-    }
-
-    if (EVP_EncryptUpdate(ctx, ciphertext, &current_length, plain_text, plain_tex_lenght) != 1) {
-        printf("Error: Could not encrypt data\n");
+    if (EVP_CipherUpdate(ctx, output, &current_length, input, input_length) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not %s data", encrypt ? "encrypt" : "decrypt");
         goto cleanup;
     }
     total_length = current_length;
 
-    if (EVP_EncryptFinal_ex(ctx, ciphertext + total_length, &current_length) != 1) {
-        printf("Error: Could not finalise encryption\n");
+    if (EVP_CipherFinal_ex(ctx, output + total_length, &current_length) != 1) {
+        if (encrypt) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not finalise encryption");
+        } else {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not finalise decryption (padding mismatch?)");
+        }
         goto cleanup;
     }
     total_length += current_length;
@@ -161,25 +407,255 @@ int crypto_encrypt(
     status = total_length;
 
 cleanup:
+    context_release(ctx);
+    memset(key_buffer, 0, sizeof(key_buffer));
+    return status;
+}
+
+int crypto_cipher_encrypt(
+    const CryptoCipher *cipher,
+    const unsigned char *plain_text,
+    const int plain_text_length,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    unsigned char *ciphertext) {
+
+    if (!cipher || !plain_text || !ciphertext || plain_text_length < 0) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Invalid arguments for encryption");
+        return -1;
+    }
+    if (!crypto_secret_is_set(secret)) {
+        return passthrough_copy(ciphertext, plain_text, plain_text_length);
+    }
+    return cipher_run(cipher, 1, plain_text, plain_text_length, secret, salt, iv, ciphertext);
+}
+
+/*
+ * ECB, CBC and CFB decryption of a block only needs the key and the previous
+ * ciphertext block, so the ciphertext can be cut at block boundaries and every
+ * chunk decrypted on its own thread, seeded with the block before it as IV.
+ * Only the last chunk keeps padding enabled; the others are exact multiples of
+ * the block size and decrypt to exactly their own length.
+ */
+typedef struct {
+    const CryptoCipher *cipher;
+    const unsigned char *key;
+    const unsigned char *input;
+    int input_length;
+    const unsigned char *iv;
+    int last;
+    unsigned char *output;
+    int output_length;
+} DecryptChunk;
+
+static int cipher_supports_parallel_decrypt(const CryptoCipher *cipher) {
+    const int mode = EVP_CIPHER_mode(cipher->cipher);
+    return mode == EVP_CIPH_ECB_MODE || mode == EVP_CIPH_CBC_MODE || mode == EVP_CIPH_CFB_MODE;
+}
+
+/* CFB reports a block size of 1; its feedback unit is the full IV-sized segment */
+static int chunk_unit(const CryptoCipher *cipher) {
+    return EVP_CIPHER_mode(cipher->cipher) == EVP_CIPH_CFB_MODE ? cipher->iv_length : cipher->block_size;
+}
+
+static void *decrypt_chunk_worker(void *context) {
+    DecryptChunk *chunk = context;
+    chunk->output_length = -1;
+
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        return NULL;
+    }
+
+    int update_length = 0;
+    int final_length = 0;
+    if (EVP_DecryptInit_ex(ctx, chunk->cipher->cipher, NULL, chunk->key, chunk->cipher->iv_length > 0 ? chunk->iv : NULL) == 1 &&
+        EVP_CIPHER_CTX_set_padding(ctx, chunk->last) == 1 &&
+        EVP_DecryptUpdate(ctx, chunk->output, &update_length, chunk->input, chunk->input_length) == 1 &&
+        EVP_DecryptFinal_ex(ctx, chunk->output + update_length, &final_length) == 1) {
+        chunk->output_length = update_length + final_length;
+    }
+
     EVP_CIPHER_CTX_free(ctx);
+    return NULL;
+}
+
+static int decrypt_parallel(
+    const CryptoCipher *cipher,
+    const unsigned char *ciphertext,
+    const int cipher_text_length,
+    const unsigned char *key,
+    const unsigned char *iv,
+    unsigned char *plain_text,
+    const int thread_count) {
+
+    const size_t block_size = (size_t) chunk_unit(cipher);
+    const size_t total_blocks = (size_t) cipher_text_length / block_size;
+    const size_t blocks_per_chunk = total_blocks / (size_t) thread_count;
+
+    DecryptChunk chunks[CRYPTO_PARALLEL_MAX_THREADS];
+    pthread_t threads[CRYPTO_PARALLEL_MAX_THREADS];
+    int started[CRYPTO_PARALLEL_MAX_THREADS] = {0};
+
+    for (int i = 0; i < thread_count; i++) {
+        const size_t start = (size_t) i * blocks_per_chunk * block_size;
+        const int last = i == thread_count - 1;
+        const size_t end = last ? (size_t) cipher_text_length : start + blocks_per_chunk * block_size;
+
+        chunks[i].cipher = cipher;
+        chunks[i].key = key;
+        chunks[i].input = ciphertext + start;
+        chunks[i].input_length = (int) (end - start);
+        chunks[i].iv = i == 0 ? iv : ciphertext + start - block_size;
+        chunks[i].last = last;
+        chunks[i].output = plain_text + start;
+        chunks[i].output_length = -1;
+    }
+
+    /* the calling thread takes the last chunk itself */
+    for (int i = 0; i < thread_count - 1; i++) {
+        started[i] = pthread_create(&threads[i], NULL, decrypt_chunk_worker, &chunks[i]) == 0;
+        if (!started[i]) {
+            decrypt_chunk_worker(&chunks[i]);
+        }
+    }
+    decrypt_chunk_worker(&chunks[thread_count - 1]);
+
+    int total_length = 0;
+    int failed = 0;
+    for (int i = 0; i < thread_count; i++) {
+        if (i < thread_count - 1 && started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+        if (chunks[i].output_length < 0) {
+            failed = 1;
+        } else {
+            total_length += chunks[i].output_length;
+        }
+    }
+
+    if (failed) {
+        if (chunks[thread_count - 1].output_length < 0) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not finalise decryption (padding mismatch?)");
+        } else {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not decrypt data");
+        }
+        return -1;
+    }
+    return total_length;
+}
+
+int crypto_cipher_decrypt_parallel(
+    const CryptoCipher *cipher,
+    const unsigned char *ciphertext,
+    const int cipher_text_length,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    unsigned char *plain_text,
+    int thread_count) {
+
+    if (!cipher || !ciphertext || !plain_text || cipher_text_length < 0) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Invalid arguments for decryption");
+        return -1;
+    }
+    if (!crypto_secret_is_set(secret)) {
+        return passthrough_copy(plain_text, ciphertext, cipher_text_length);
+    }
+
+    /* sized first: the CPU count query costs more than decrypting a short payload */
+    const int max_by_size = cipher_text_length / CRYPTO_PARALLEL_MIN_CHUNK_SIZE;
+    if (thread_count <= 0 && max_by_size > 1) {
+        const long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online_cpus > 0 ? (int) online_cpus : 1;
+    }
+    if (thread_count > max_by_size) {
+        thread_count = max_by_size;
+    }
+    if (thread_count > CRYPTO_PARALLEL_MAX_THREADS) {
+        thread_count = CRYPTO_PARALLEL_MAX_THREADS;
+    }
+
+    if (thread_count <= 1 || !cipher_supports_parallel_decrypt(cipher) ||
+        (EVP_CIPHER_mode(cipher->cipher) != EVP_CIPH_CFB_MODE && cipher_text_length % cipher->block_size != 0)) {
+        return cipher_run(cipher, 0, ciphertext, cipher_text_length, secret, salt, iv, plain_text);
+    }
+
+    if (cipher->iv_length > 0 && !iv) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Selected cipher mode requires an IV");
+        return -1;
+    }
+
+    unsigned char key_buffer[EVP_MAX_KEY_LENGTH];
+    if (!derive_key(cipher, secret, salt, key_buffer)) {
+        memset(key_buffer, 0, sizeof(key_buffer));
+        return -1;
+    }
+
+    const int status = decrypt_parallel(cipher, ciphertext, cipher_text_length, key_buffer, iv, plain_text, thread_count);
     memset(key_buffer, 0, sizeof(key_buffer));
     return status;
 }
 
+int crypto_cipher_decrypt(
+    const CryptoCipher *cipher,
+    const unsigned char *ciphertext,
+    const int cipher_text_length,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    unsigned char *plain_text) {
+
+    if (!cipher || !ciphertext || !plain_text || cipher_text_length < 0) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Invalid arguments for decryption");
+        return -1;
+    }
+    return cipher_run(cipher, 0, ciphertext, cipher_text_length, secret, salt, iv, plain_text);
+}
+
+int crypto_encrypt(
+    const unsigned char *plain_text,
+    int plain_tex_lenght,
+    const char *method,
+    const char *mode,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    unsigned char *ciphertext) {
+
+    if (!plain_text || !ciphertext || plain_tex_lenght < 0) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Invalid arguments for encryption");
+        return -1;
+    }
+
+    if (is_null_or_empty(method) || is_null_or_empty(mode) || !crypto_secret_is_set(secret)) {
+        return passthrough_copy(ciphertext, plain_text, plain_tex_lenght);
+    }
+
+    const CryptoCipher *cipher = crypto_cipher_lookup(method, mode);
+    if (!cipher) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Unsupported cipher method (%s) or mode (%s)", method ? method : "null", mode ? mode : "null");
+        return -1;
+    }
+
+    return cipher_run(cipher, 1, plain_text, plain_tex_lenght, secret, salt, iv, ciphertext);
+}
+
 int crypto_get_iv_length(const char *method, const char *mode) {
-    const EVP_CIPHER *cipher = resolve_cipher(method, mode);
+    const CryptoCipher *cipher = crypto_cipher_lookup(method, mode);
     if (!cipher) {
         return -1;
     }
-    return EVP_CIPHER_iv_length(cipher);
+    return cipher->iv_length;
 }
 
 int crypto_get_block_size(const char *method, const char *mode) {
-    const EVP_CIPHER *cipher = resolve_cipher(method, mode);
+    const CryptoCipher *cipher = crypto_cipher_lookup(method, mode);
     if (!cipher) {
         return -1;
     }
-    return EVP_CIPHER_block_size(cipher);
+    return cipher->block_size;
 }
 
 int crypto_decrypt(
@@ -187,75 +663,374 @@ int crypto_decrypt(
     int cipher_text_length,
     const char *method,
     const char *mode,
-    const char *password,
+    const CryptoSecret *secret,
     const unsigned char *salt,
     const unsigned char *iv,
     unsigned char *plain_text) {
 
     if (!ciphertext || !plain_text || cipher_text_length < 0) {
-        printf("Error: Invalid arguments for decryption\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Invalid arguments for decryption");
         return -1;
     }
 
-    if (is_null_or_empty(method) || is_null_or_empty(mode) || is_null_or_empty(password)) {
+    if (is_null_or_empty(method) || is_null_or_empty(mode) || !crypto_secret_is_set(secret)) {
         return passthrough_copy(plain_text, ciphertext, cipher_text_length);
     }
 
-    const EVP_CIPHER *cipher = resolve_cipher(method, mode);
+    const CryptoCipher *cipher = crypto_cipher_lookup(method, mode);
     if (!cipher) {
-        printf("Error: Unsupported cipher method (%s) or mode (%s)\n", method ? method : "null", mode ? mode : "null");
+        stego_diag_report(STEGO_DIAG_ERROR, "Unsupported cipher method (%s) or mode (%s)", method ? method : "null", mode ? mode : "null");
         return -1;
     }
 
-    const int iv_length = EVP_CIPHER_iv_length(cipher);
-    if (iv_length > 0 && !iv) {
-        printf("Error: Selected cipher mode requires an IV\n");
-        return -1;
+    return cipher_run(cipher, 0, ciphertext, cipher_text_length, secret, salt, iv, plain_text);
+}
+
+CryptoStream *crypto_cipher_stream_new(
+    const CryptoCipher *cipher,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    const int encrypt) {
+
+    if (!cipher || !crypto_secret_is_set(secret)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Streaming encryption requires method, mode and a password or key");
+        return NULL;
+    }
+
+    if (cipher->iv_length > 0 && !iv) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Selected cipher mode requires an IV");
+        return NULL;
     }
 
     unsigned char key_buffer[EVP_MAX_KEY_LENGTH];
-    if (!derive_key(cipher, password, salt, key_buffer)) {
+    if (!derive_key(cipher, secret, salt, key_buffer)) {
         memset(key_buffer, 0, sizeof(key_buffer));
-        return -1;
+        return NULL;
     }
 
-    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
-    if (!ctx) {
-        printf("Error: Could not allocate cipher context\n");
+    CryptoStream *stream = malloc(sizeof(CryptoStream));
+    if (!stream) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate cipher stream");
         memset(key_buffer, 0, sizeof(key_buffer));
+        return NULL;
+    }
+    stream->encrypt = encrypt ? 1 : 0;
+    stream->aead = cipher->aead;
+    stream->ctx = context_acquire();
+    if (!stream->ctx) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate cipher context");
+        memset(key_buffer, 0, sizeof(key_buffer));
+        free(stream);
+        return NULL;
+    }
+
+    if (EVP_CipherInit_ex(stream->ctx, cipher->cipher, NULL, key_buffer, cipher->iv_length > 0 ? iv : NULL, stream->encrypt) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not initialise cipher stream");
+        memset(key_buffer, 0, sizeof(key_buffer));
+        crypto_stream_free(stream);
+        return NULL;
+    }
+
+    memset(key_buffer, 0, sizeof(key_buffer));
+    return stream;
+}
+
+CryptoStream *crypto_stream_new(
+    const char *method,
+    const char *mode,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    const int encrypt) {
+
+    if (is_null_or_empty(method) || is_null_or_empty(mode) || !crypto_secret_is_set(secret)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Streaming encryption requires method, mode and a password or key");
+        return NULL;
+    }
+
+    const CryptoCipher *cipher = crypto_cipher_lookup(method, mode);
+    if (!cipher) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Unsupported cipher method (%s) or mode (%s)", method, mode);
+        return NULL;
+    }
+
+    return crypto_cipher_stream_new(cipher, secret, salt, iv, encrypt);
+}
+
+int crypto_stream_update(CryptoStream *stream, const unsigned char *input, const int input_length, unsigned char *output) {
+    if (!stream || !input || !output || input_length < 0) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Invalid arguments for cipher stream");
         return -1;
     }
 
-    int status = -1;
-    int current_length = 0;
-    int total_length = 0;
+    int output_length = 0;
+    if (EVP_CipherUpdate(stream->ctx, output, &output_length, input, input_length) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not %s data", stream->encrypt ? "encrypt" : "decrypt");
+        return -1;
+    }
+    return output_length;
+}
 
-    if (EVP_DecryptInit_ex(ctx, cipher, NULL, NULL, NULL) != 1) {
-        printf("Error: Could not initialise decryption operation\n");
-        goto cleanup;
+int crypto_stream_final(CryptoStream *stream, unsigned char *output) {
+    if (!stream || !output) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Invalid arguments for cipher stream");
+        return -1;
     }
 
-    if (EVP_DecryptInit_ex(ctx, NULL, NULL, key_buffer, iv_length > 0 ? iv : NULL) != 1) {
-        printf("Error: Could not set key and IV for decryption\n");
-        goto cleanup;
+    int output_length = 0;
+    if (EVP_CipherFinal_ex(stream->ctx, output, &output_length) != 1) {
+        if (stream->aead && !stream->encrypt) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Authentication failed (wrong password or key, or tampered payload)");
+        } else if (stream->encrypt) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not finalise encryption");
+        } else {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not finalise decryption (padding mismatch?)");
+        }
+        return -1;
     }
+    return output_length;
+}
 
-    if (EVP_DecryptUpdate(ctx, plain_text, &current_length, ciphertext, cipher_text_length) != 1) {
-        printf("Error: Could not decrypt data\n");
-        goto cleanup;
+int crypto_stream_set_aad(CryptoStream *stream, const unsigned char *aad, const int aad_length) {
+    int ignored = 0;
+    if (!stream || !stream->aead || !aad || aad_length < 0 ||
+        EVP_CipherUpdate(stream->ctx, NULL, &ignored, aad, aad_length) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not authenticate associated data");
+        return 1;
     }
-    total_length = current_length;
+    return 0;
+}
 
-    if (EVP_DecryptFinal_ex(ctx, plain_text + total_length, &current_length) != 1) {
-        printf("Error: Could not finalise decryption (padding mismatch?)\n");
-        goto cleanup;
+int crypto_stream_get_tag(CryptoStream *stream, unsigned char *tag) {
+    if (!stream || !stream->aead || !stream->encrypt || !tag ||
+        EVP_CIPHER_CTX_ctrl(stream->ctx, EVP_CTRL_AEAD_GET_TAG, CRYPTO_AEAD_TAG_SIZE, tag) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not read authentication tag");
+        return 1;
     }
-    total_length += current_length;
+    return 0;
+}
 
-    status = total_length;
+int crypto_stream_set_tag(CryptoStream *stream, const unsigned char *tag) {
+    unsigned char tag_copy[CRYPTO_AEAD_TAG_SIZE];
+    if (!stream || !stream->aead || stream->encrypt || !tag) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not set authentication tag");
+        return 1;
+    }
+    memcpy(tag_copy, tag, CRYPTO_AEAD_TAG_SIZE);
+    if (EVP_CIPHER_CTX_ctrl(stream->ctx, EVP_CTRL_AEAD_SET_TAG, CRYPTO_AEAD_TAG_SIZE, tag_copy) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not set authentication tag");
+        return 1;
+    }
+    return 0;
+}
+
+/* One-shot AEAD on top of the stream API; input and output may be the same buffer */
+static int aead_run(
+    const CryptoCipher *cipher,
+    const int encrypt,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    const unsigned char *aad,
+    const int aad_length,
+    const unsigned char *input,
+    const int input_length,
+    unsigned char *output,
+    unsigned char *tag) {
+
+    if (!cipher || !cipher->aead || !input || !output || !tag || input_length < 0) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Invalid arguments for authenticated %s", encrypt ? "encryption" : "decryption");
+        return -1;
+    }
+
+    CryptoStream *stream = crypto_cipher_stream_new(cipher, secret, salt, iv, encrypt);
+    if (!stream) {
+        return -1;
+    }
+
+    int status = -1;
+    if (aad && aad_length > 0 && crypto_stream_set_aad(stream, aad, aad_length)) {
+        goto cleanup;
+    }
+    const int update_length = crypto_stream_update(stream, input, input_length, output);
+    if (update_length < 0) {
+        goto cleanup;
+    }
+    if (!encrypt && crypto_stream_set_tag(stream, tag)) {
+        goto cleanup;
+    }
+    const int final_length = crypto_stream_final(stream, output + update_length);
+    if (final_length < 0) {
+        goto cleanup;
+    }
+    if (encrypt && crypto_stream_get_tag(stream, tag)) {
+        goto cleanup;
+    }
+    status = update_length + final_length;
 
 cleanup:
-    EVP_CIPHER_CTX_free(ctx);
-    memset(key_buffer, 0, sizeof(key_buffer));
+    crypto_stream_free(stream);
+    return status;
+}
+
+int crypto_aead_encrypt(
+    const CryptoCipher *cipher,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    const unsigned char *aad,
+    const int aad_length,
+    const unsigned char *plain_text,
+    const int plain_text_length,
+    unsigned char *ciphertext,
+    unsigned char *tag) {
+    return aead_run(cipher, 1, secret, salt, iv, aad, aad_length, plain_text, plain_text_length, ciphertext, tag);
+}
+
+int crypto_aead_decrypt(
+    const CryptoCipher *cipher,
+    const CryptoSecret *secret,
+    const unsigned char *salt,
+    const unsigned char *iv,
+    const unsigned char *aad,
+    const int aad_length,
+    const unsigned char *ciphertext,
+    const int cipher_text_length,
+    const unsigned char *tag,
+    unsigned char *plain_text) {
+    return aead_run(cipher, 0, secret, salt, iv, aad, aad_length, ciphertext, cipher_text_length, plain_text, (unsigned char *) tag);
+}
+
+int crypto_key_check_value(const CryptoCipher *cipher, const CryptoSecret *secret, const unsigned char *salt, const unsigned char *iv, const size_t iv_length, unsigned char *key_check) {
+    unsigned char key_buffer[EVP_MAX_KEY_LENGTH];
+    if (!cipher || !salt || !key_check || iv_length > CRYPTO_MAX_IV_SIZE || (iv_length && !iv) ||
+        !derive_key(cipher, secret, salt, key_buffer)) {
+        OPENSSL_cleanse(key_buffer, sizeof(key_buffer));
+        return 1;
+    }
+
+    /* label || salt || iv: the value is bound to this container, not just to the key */
+    unsigned char message[sizeof(CRYPTO_KEY_CHECK_LABEL) - 1 + CRYPTO_SALT_SIZE + CRYPTO_MAX_IV_SIZE];
+    size_t message_length = sizeof(CRYPTO_KEY_CHECK_LABEL) - 1;
+    memcpy(message, CRYPTO_KEY_CHECK_LABEL, message_length);
+    memcpy(message + message_length, salt, CRYPTO_SALT_SIZE);
+    message_length += CRYPTO_SALT_SIZE;
+    if (iv_length) {
+        memcpy(message + message_length, iv, iv_length);
+        message_length += iv_length;
+    }
+
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int mac_length = 0;
+    const unsigned char *result = HMAC(EVP_sha256(), key_buffer, cipher->key_length,
+                                       message, message_length, mac, &mac_length);
+    OPENSSL_cleanse(key_buffer, sizeof(key_buffer));
+    if (!result || mac_length < CRYPTO_KEY_CHECK_SIZE) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not compute key check value");
+        return 1;
+    }
+
+    memcpy(key_check, mac, CRYPTO_KEY_CHECK_SIZE);
+    OPENSSL_cleanse(mac, sizeof(mac));
+    return 0;
+}
+
+int crypto_key_check_matches(const CryptoCipher *cipher, const CryptoSecret *secret, const unsigned char *salt, const unsigned char *iv, const size_t iv_length, const unsigned char *stored_key_check) {
+    unsigned char key_check[CRYPTO_KEY_CHECK_SIZE];
+    if (crypto_key_check_value(cipher, secret, salt, iv, iv_length, key_check)) {
+        return 0;
+    }
+    const int matches = CRYPTO_memcmp(key_check, stored_key_check, CRYPTO_KEY_CHECK_SIZE) == 0;
+    OPENSSL_cleanse(key_check, sizeof(key_check));
+    return matches;
+}
+
+/* Per-slot key encryption key: PBKDF2 salted with the slot's own random salt, never cached */
+static int derive_wrap_key(const char *password, const unsigned char *salt, unsigned char *wrap_key) {
+    if (is_null_or_empty(password) || !salt) {
+        return 0;
+    }
+    if (PKCS5_PBKDF2_HMAC(password, (int) strlen(password), salt, CRYPTO_WRAP_SALT_SIZE, CRYPTO_WRAP_KDF_ITERATIONS,
+                          EVP_sha256(), CRYPTO_WRAP_KEY_SIZE, wrap_key) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not derive key wrapping key from password using PBKDF2");
+        return 0;
+    }
+    return 1;
+}
+
+/* AES-256 key wrap (RFC 3394); unwrapping fails on its integrity check rather than returning a wrong key */
+static int key_wrap_run(const int wrap, const unsigned char *wrap_key, const unsigned char *input, const size_t input_length, unsigned char *output) {
+    EVP_CIPHER_CTX *ctx = context_acquire();
+    if (!ctx) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate cipher context");
+        return -1;
+    }
+    EVP_CIPHER_CTX_set_flags(ctx, EVP_CIPHER_CTX_FLAG_WRAP_ALLOW);
+
+    int status = -1;
+    int update_length = 0;
+    int final_length = 0;
+    if (EVP_CipherInit_ex(ctx, EVP_aes_256_wrap(), NULL, wrap_key, NULL, wrap) == 1 &&
+        EVP_CipherUpdate(ctx, output, &update_length, input, (int) input_length) == 1 &&
+        EVP_CipherFinal_ex(ctx, output + update_length, &final_length) == 1) {
+        status = update_length + final_length;
+    }
+
+    context_release(ctx);
     return status;
 }
+
+int crypto_key_wrap(const char *password, const unsigned char *salt, const unsigned char *key, const size_t key_length, unsigned char *wrapped_key) {
+    if (!key || !wrapped_key || key_length == 0 || key_length > CRYPTO_MAX_KEY_SIZE || key_length % CRYPTO_WRAP_OVERHEAD != 0) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Invalid arguments for key wrapping");
+        return -1;
+    }
+
+    unsigned char wrap_key[CRYPTO_WRAP_KEY_SIZE];
+    if (!derive_wrap_key(password, salt, wrap_key)) {
+        OPENSSL_cleanse(wrap_key, sizeof(wrap_key));
+        return -1;
+    }
+
+    const int wrapped_length = key_wrap_run(1, wrap_key, key, key_length, wrapped_key);
+    OPENSSL_cleanse(wrap_key, sizeof(wrap_key));
+    if (wrapped_length != (int) (key_length + CRYPTO_WRAP_OVERHEAD)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not wrap data key");
+        return -1;
+    }
+    return wrapped_length;
+}
+
+int crypto_key_unwrap(const char *password, const unsigned char *salt, const unsigned char *wrapped_key, const size_t wrapped_length, unsigned char *key) {
+    if (!wrapped_key || !key || wrapped_length <= CRYPTO_WRAP_OVERHEAD || wrapped_length > CRYPTO_MAX_KEY_SIZE + CRYPTO_WRAP_OVERHEAD) {
+        return -1;
+    }
+
+    unsigned char wrap_key[CRYPTO_WRAP_KEY_SIZE];
+    if (!derive_wrap_key(password, salt, wrap_key)) {
+        OPENSSL_cleanse(wrap_key, sizeof(wrap_key));
+        return -1;
+    }
+
+    /* unwrapping needs room for a full extra semiblock in the output */
+    unsigned char unwrapped[CRYPTO_MAX_KEY_SIZE + CRYPTO_WRAP_OVERHEAD];
+    const int key_length = key_wrap_run(0, wrap_key, wrapped_key, wrapped_length, unwrapped);
+    OPENSSL_cleanse(wrap_key, sizeof(wrap_key));
+    if (key_length != (int) (wrapped_length - CRYPTO_WRAP_OVERHEAD)) {
+        OPENSSL_cleanse(unwrapped, sizeof(unwrapped));
+        return -1;
+    }
+
+    memcpy(key, unwrapped, (size_t) key_length);
+    OPENSSL_cleanse(unwrapped, sizeof(unwrapped));
+    return key_length;
+}
+
+void crypto_stream_free(CryptoStream *stream) {
+    if (!stream) {
+        return;
+    }
+    context_release(stream->ctx);
+    free(stream);
+}
@@ -0,0 +1,52 @@
+#include "../../include/diagnostics/diagnostics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+static _Thread_local const StegoDiagSink *current_sink = NULL;
+
+const StegoDiagSink *stego_diag_set_sink(const StegoDiagSink *sink) {
+    const StegoDiagSink *previous = current_sink;
+    current_sink = sink;
+    return previous;
+}
+
+int stego_diag_enabled(const StegoDiagLevel level) {
+    const StegoDiagSink *sink = current_sink;
+    return !sink || (!sink->silent && level >= sink->min_level);
+}
+
+void stego_diag_report(const StegoDiagLevel level, const char *format, ...) {
+    const StegoDiagSink *sink = current_sink;
+    if (sink && (sink->silent || level < sink->min_level)) {
+        return;
+    }
+
+    va_list arguments;
+    va_start(arguments, format);
+    if (sink && sink->callback) {
+        char message[STEGO_DIAG_MESSAGE_SIZE];
+        vsnprintf(message, sizeof(message), format, arguments);
+        sink->callback(sink->context, level, message);
+    } else {
+        if (level != STEGO_DIAG_INFO) {
+            printf("%s: ", stego_diag_level_name(level));
+        }
+        vprintf(format, arguments);
+        putchar('\n');
+    }
+    va_end(arguments);
+}
+
+const char *stego_diag_level_name(const StegoDiagLevel level) {
+    switch (level) {
+        case STEGO_DIAG_DEBUG:
+            return "Debug";
+        case STEGO_DIAG_INFO:
+            return "Info";
+        case STEGO_DIAG_WARNING:
+            return "Warning";
+        default:
+            return "Error";
+    }
+}
@@ -1,13 +1,76 @@
 #include "../../include/parser/parser.h"
 #include "../../include/stegobmp/stegobmp_utils.h"
+#include "../../include/stegobmp/stegobmp_compress.h"
 
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 
+static int hex_digit_value(const char digit) {
+    if (digit >= '0' && digit <= '9') {
+        return digit - '0';
+    }
+    if (digit >= 'a' && digit <= 'f') {
+        return digit - 'a' + 10;
+    }
+    if (digit >= 'A' && digit <= 'F') {
+        return digit - 'A' + 10;
+    }
+    return -1;
+}
+
+static int parse_hex_key(const char *hex, ProgramArguments *arguments) {
+    const size_t digits = strlen(hex);
+    if (digits == 0 || digits % 2 != 0 || digits / 2 > CRYPTO_MAX_KEY_SIZE) {
+        printf("Error: -key expects an even number of hex digits (at most %d)\n", 2 * CRYPTO_MAX_KEY_SIZE);
+        return 1;
+    }
+
+    for (size_t i = 0; i < digits / 2; i++) {
+        const int high = hex_digit_value(hex[2 * i]);
+        const int low = hex_digit_value(hex[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            printf("Error: -key contains a non-hex character\n");
+            OPENSSL_cleanse(arguments->key, sizeof(arguments->key));
+            return 1;
+        }
+        arguments->key[i] = (unsigned char) (high << 4 | low);
+    }
+    arguments->key_length = digits / 2;
+    return 0;
+}
+
+/* The key file holds the raw key bytes, nothing else */
+static int read_key_file(const char *key_filename, ProgramArguments *arguments) {
+    FILE *file = fopen(key_filename, "rb");
+    if (!file) {
+        printf("Error: Could not open key file %s\n", key_filename);
+        return 1;
+    }
+
+    unsigned char spare;
+    const size_t read_bytes = fread(arguments->key, 1, sizeof(arguments->key), file);
+    const int too_long = read_bytes == sizeof(arguments->key) && fread(&spare, 1, 1, file) == 1;
+    const int failed = ferror(file);
+    fclose(file);
+
+    if (failed || read_bytes == 0 || too_long) {
+        printf("Error: Key file %s must hold 1 to %d raw key bytes\n", key_filename, CRYPTO_MAX_KEY_SIZE);
+        OPENSSL_cleanse(arguments->key, sizeof(arguments->key));
+        return 1;
+    }
+    arguments->key_length = read_bytes;
+    return 0;
+}
+
 static void print_usage(const char *program_name) {
-    printf("Usage: %s -embed -in <input> -p <bmp> -out <bmp_out> -steg <LSB1|LSB4|LSBI> [-a <aes128|aes192|aes256|3des>] [-m <ecb|cfb|ofb|cbc>] [-pass <password>]\n", program_name);
-    printf("Usage: %s -extract -p <bmp> -out <file_out> -steg <LSB1|LSB4|LSBI> [-a <aes128|aes192|aes256|3des>] [-m <ecb|cfb|ofb|cbc>] [-pass <password>]\n", program_name);
-    printf("Usage: %s -analyze -p <bmp> -out <file_out>\n", program_name);
+    printf("Usage: %s -embed [-stream] [-compress <1-9>] [-checksum] -in <input> -p <bmp> -out <bmp_out> -steg <LSB1|LSB4|LSBI> [-a <aes128|aes192|aes256|3des|chacha20>] [-m <ecb|cfb|ofb|cbc|gcm|poly1305>] [-pass <password> [-pass <password> ...] | -key <hex> | -keyfile <path>]\n", program_name);
+    printf("Usage: %s -embed -inplace [-fsync] [-stream] [-compress <1-9>] [-checksum] -in <input> -p <bmp> -steg <LSB1|LSB4|LSBI> [-a <aes128|aes192|aes256|3des|chacha20>] [-m <ecb|cfb|ofb|cbc|gcm|poly1305>] [-pass <password> [-pass <password> ...] | -key <hex> | -keyfile <path>]\n", program_name);
+    printf("Usage: %s -extract [-stream] -p <bmp> -out <file_out> -steg <LSB1|LSB4|LSBI> [-a <aes128|aes192|aes256|3des|chacha20>] [-m <ecb|cfb|ofb|cbc|gcm|poly1305>] [-pass <password> | -key <hex> | -keyfile <path>]\n", program_name);
+    printf("Usage: %s -analyze [-statistics] -p <bmp> -out <file_out>\n", program_name);
+    printf("Usage: %s -analyze -scan <dir> [-statistics] [-threads <n>] [-out <payload_dir>]   (one JSON line per BMP)\n", program_name);
+    printf("Usage: %s -batch <manifest> [-threads <n>]   (one -embed/-extract option line per job)\n", program_name);
 }
 
 int parse_arguments(const int argc, char *argv[], ProgramArguments *arguments) {
@@ -24,6 +87,76 @@ int parse_arguments(const int argc, char *argv[], ProgramArguments *arguments) {
             arguments->extract = 1;
         } else if (strcmp(argv[i], "-analyze") == 0) {
             arguments->analyze = 1;
+        } else if (strcmp(argv[i], "-inplace") == 0) {
+            arguments->inplace = 1;
+        } else if (strcmp(argv[i], "-fsync") == 0) {
+            arguments->fsync = 1;
+        } else if (strcmp(argv[i], "-stream") == 0) {
+            arguments->stream = 1;
+        } else if (strcmp(argv[i], "-checksum") == 0) {
+            arguments->checksum = 1;
+        } else if (strcmp(argv[i], "-statistics") == 0) {
+            arguments->statistics = 1;
+        } else if (strcmp(argv[i], "-batch") == 0) {
+            if (i + 1 < argc) {
+                arguments->batch_filename = argv[i + 1];
+                i++;
+            } else {
+                printf("Error: Missing argument for -batch\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-scan") == 0) {
+            if (i + 1 < argc) {
+                arguments->scan_directory = argv[i + 1];
+                i++;
+            } else {
+                printf("Error: Missing argument for -scan\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-threads") == 0) {
+            if (i + 1 < argc) {
+                char *end = NULL;
+                const long threads = strtol(argv[i + 1], &end, 10);
+                if (!end || *end != '\0' || threads <= 0 || threads > PARSER_MAX_THREADS) {
+                    printf("Error: -threads expects a number between 1 and %d\n", PARSER_MAX_THREADS);
+                    return 1;
+                }
+                arguments->threads = (int) threads;
+                i++;
+            } else {
+                printf("Error: Missing argument for -threads\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-compress") == 0) {
+            if (i + 1 < argc) {
+                char *end = NULL;
+                const long level = strtol(argv[i + 1], &end, 10);
+                if (!end || *end != '\0' || level < STEGOBMP_COMPRESSION_MIN_LEVEL || level > STEGOBMP_COMPRESSION_MAX_LEVEL) {
+                    printf("Error: -compress expects a level between %d and %d\n", STEGOBMP_COMPRESSION_MIN_LEVEL, STEGOBMP_COMPRESSION_MAX_LEVEL);
+                    return 1;
+                }
+                arguments->compression_level = (int) level;
+                i++;
+            } else {
+                printf("Error: Missing argument for -compress\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-key") == 0 || strcmp(argv[i], "-keyfile") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: Missing argument for %s\n", argv[i]);
+                return 1;
+            }
+            if (arguments->key_length > 0) {
+                printf("Error: Only one of -key and -keyfile can be given\n");
+                return 1;
+            }
+            const int key_status = strcmp(argv[i], "-key") == 0
+                ? parse_hex_key(argv[i + 1], arguments)
+                : read_key_file(argv[i + 1], arguments);
+            if (key_status) {
+                return 1;
+            }
+            i++;
         } else if (strcmp(argv[i], "-in") == 0) {
             if (i + 1 < argc) {
                 arguments->input_filename = argv[i + 1];
@@ -74,7 +207,15 @@ int parse_arguments(const int argc, char *argv[], ProgramArguments *arguments) {
             }
         } else if (strcmp(argv[i], "-pass") == 0) {
             if (i + 1 < argc) {
-                arguments->password = argv[i + 1];
+                /* each repeat adds a recipient; the first one doubles as the single password */
+                if (arguments->recipients.count == STEGOBMP_MAX_RECIPIENTS) {
+                    printf("Error: At most %d -pass recipients are supported\n", STEGOBMP_MAX_RECIPIENTS);
+                    return 1;
+                }
+                if (arguments->recipients.count == 0) {
+                    arguments->password = argv[i + 1];
+                }
+                arguments->recipients.passwords[arguments->recipients.count++] = argv[i + 1];
                 i++;
             } else {
                 printf("Error: Missing argument for -pass\n");
@@ -84,6 +225,19 @@ int parse_arguments(const int argc, char *argv[], ProgramArguments *arguments) {
     }
 
     const int actions_selected = arguments->embed + arguments->extract + arguments->analyze;
+
+    if (arguments->batch_filename) {
+        if (actions_selected > 0) {
+            printf("Error: -batch takes its actions from the manifest\n");
+            return 1;
+        }
+        return 0;
+    }
+    if (arguments->threads && !arguments->scan_directory) {
+        printf("Error: -threads is only valid with -batch or -scan\n");
+        return 1;
+    }
+
     if (actions_selected == 0) {
         printf("Error: Missing required action (-embed | -extract | -analyze)\n");
         print_usage(argv[0]);
@@ -94,7 +248,16 @@ int parse_arguments(const int argc, char *argv[], ProgramArguments *arguments) {
         return 1;
     }
 
-    if (!arguments->bmp_filename) {
+    if (arguments->scan_directory) {
+        if (!arguments->analyze) {
+            printf("Error: -scan is only valid with -analyze\n");
+            return 1;
+        }
+        if (arguments->bmp_filename) {
+            printf("Error: -scan takes its carriers from the directory, -p can not be used with it\n");
+            return 1;
+        }
+    } else if (!arguments->bmp_filename) {
         printf("Error: Missing required argument -p\n");
         return 1;
     }
@@ -105,8 +268,42 @@ int parse_arguments(const int argc, char *argv[], ProgramArguments *arguments) {
         return 1;
     }
 
+    if ((arguments->inplace || arguments->fsync) && !arguments->embed) {
+        printf("Error: -inplace and -fsync are only valid with -embed\n");
+        return 1;
+    }
+
+    if (arguments->stream && !arguments->embed && !arguments->extract) {
+        printf("Error: -stream is only valid with -embed or -extract\n");
+        return 1;
+    }
+
+    if (arguments->compression_level && !arguments->embed) {
+        printf("Error: -compress is only valid with -embed (extraction inflates transparently)\n");
+        return 1;
+    }
+
+    if (arguments->checksum && !arguments->embed) {
+        printf("Error: -checksum is only valid with -embed (extraction verifies transparently)\n");
+        return 1;
+    }
+
+    if (arguments->statistics && !arguments->analyze) {
+        printf("Error: -statistics is only valid with -analyze\n");
+        return 1;
+    }
+
+    if (arguments->fsync && !arguments->inplace) {
+        printf("Error: -fsync requires -inplace\n");
+        return 1;
+    }
+
     if (arguments->embed) {
-        if (!arguments->input_filename || !arguments->output_bmp_filename || !arguments->steganography_method) {
+        if (arguments->inplace && arguments->output_bmp_filename) {
+            printf("Error: -inplace modifies the -p carrier, -out can not be used with it\n");
+            return 1;
+        }
+        if (!arguments->input_filename || (!arguments->output_bmp_filename && !arguments->inplace) || !arguments->steganography_method) {
             printf("Error: Missing required arguments for embedding\n");
             return 1;
         }
@@ -116,7 +313,7 @@ int parse_arguments(const int argc, char *argv[], ProgramArguments *arguments) {
             return 1;
         }
     } else if (arguments->analyze) {
-        if (!arguments->output_bmp_filename) {
+        if (!arguments->output_bmp_filename && !arguments->scan_directory) {
             printf("Error: Missing required argument -out for analysis\n");
             return 1;
         }
@@ -127,19 +324,39 @@ int parse_arguments(const int argc, char *argv[], ProgramArguments *arguments) {
 
     int encryption_method_provided = arguments->encryption_method && arguments->encryption_method[0] != '\0';
     int encryption_mode_provided = arguments->encryption_mode && arguments->encryption_mode[0] != '\0';
-    const int password_provided = arguments->password && arguments->password[0] != '\0';
+    const int key_provided = arguments->key_length > 0;
+    const int password_provided = (arguments->password && arguments->password[0] != '\0') || key_provided;
+
+    if (key_provided && arguments->password && arguments->password[0] != '\0') {
+        printf("Error: -pass can not be combined with -key or -keyfile\n");
+        return 1;
+    }
+
+    if (arguments->recipients.count > 1) {
+        if (!arguments->embed) {
+            printf("Error: -pass can only be repeated with -embed (extraction takes one of the passwords)\n");
+            return 1;
+        }
+        for (size_t r = 0; r < arguments->recipients.count; r++) {
+            if (arguments->recipients.passwords[r][0] == '\0') {
+                printf("Error: Recipient passwords can not be empty\n");
+                return 1;
+            }
+        }
+    }
 
-    /* Defaults when password is present:
-     *  - method + password, no mode    => mode = "cbc"
-     *  - mode + password, no method    => method = "aes128"
+    /* Defaults when password (or key) is present:
+     *  - method + password, no mode    => mode = "cbc" ("poly1305" for chacha20)
+     *  - mode + password, no method    => method = "aes128" ("chacha20" for poly1305)
      *  - only password                 => method = "aes128", mode = "cbc"
      */
     if (password_provided) {
         if (encryption_method_provided && !encryption_mode_provided) {
-            arguments->encryption_mode = "cbc";
+            /* ChaCha20 only comes as ChaCha20-Poly1305 */
+            arguments->encryption_mode = strcasecmp(arguments->encryption_method, "chacha20") == 0 ? "poly1305" : "cbc";
             encryption_mode_provided = 1;
         } else if (!encryption_method_provided && encryption_mode_provided) {
-            arguments->encryption_method = "aes128";
+            arguments->encryption_method = strcasecmp(arguments->encryption_mode, "poly1305") == 0 ? "chacha20" : "aes128";
             encryption_method_provided = 1;
         } else if (!encryption_method_provided && !encryption_mode_provided) {
             arguments->encryption_method = "aes128";
@@ -156,5 +373,19 @@ int parse_arguments(const int argc, char *argv[], ProgramArguments *arguments) {
         return 1;
     }
 
+    /* a supplied key is used as is, so it has to fit the cipher exactly */
+    if (key_provided) {
+        const CryptoCipher *cipher = crypto_cipher_lookup(arguments->encryption_method, arguments->encryption_mode);
+        if (!cipher) {
+            printf("Error: Unsupported cipher method (%s) or mode (%s)\n", arguments->encryption_method, arguments->encryption_mode);
+            return 1;
+        }
+        if (arguments->key_length != (size_t) cipher->key_length) {
+            printf("Error: %s-%s needs a %d-byte key (%d hex digits), got %zu bytes\n",
+                   cipher->method, cipher->mode, cipher->key_length, 2 * cipher->key_length, arguments->key_length);
+            return 1;
+        }
+    }
+
     return 0;
 }
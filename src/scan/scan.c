@@ -0,0 +1,510 @@
+#include "../../include/scan/scan.h"
+#include "../../include/analysis/stego_analysis.h"
+#include "../../include/analysis/stego_statistics.h"
+#include "../../include/stegobmp/stegobmp_utils.h"
+#include "../../include/diagnostics/diagnostics.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SCAN_PATH_SEPARATOR '/'
+#define SCAN_PAYLOAD_DIRECTORY_MODE 0755
+#define SCAN_LINE_INITIAL_CAPACITY 256
+#define SCAN_NANOSECONDS_PER_MILLISECOND 1e6
+
+typedef struct {
+    char *path;
+    /* discovery order, which also names the saved payload */
+    size_t index;
+} ScanEntry;
+
+/* First library error reported while the current file is analysed */
+typedef struct {
+    char message[STEGO_DIAG_MESSAGE_SIZE];
+    int captured;
+} ScanCapture;
+
+typedef struct {
+    const ScanOptions *options;
+
+    /* bounded ring of discovered paths, filled by the walker and drained by the workers */
+    ScanEntry *entries;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    size_t discovered;
+    int walk_finished;
+    /* no worker thread could start: the walker analyses every file itself */
+    int inline_analysis;
+    ScanCapture inline_capture;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+
+    /* one JSON line at a time, and the totals of the summary */
+    pthread_mutex_t output_lock;
+    size_t analysed;
+    size_t detected;
+    size_t failed;
+} ScanQueue;
+
+/* One JSON object, built before the output lock is taken */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int failed;
+} ScanLine;
+
+static void line_reserve(ScanLine *line, const size_t extra) {
+    if (line->failed || line->length + extra + 1 <= line->capacity) {
+        return;
+    }
+    size_t capacity = line->capacity ? line->capacity : SCAN_LINE_INITIAL_CAPACITY;
+    while (capacity < line->length + extra + 1) {
+        capacity *= 2;
+    }
+    char *grown = realloc(line->data, capacity);
+    if (!grown) {
+        line->failed = 1;
+        return;
+    }
+    line->data = grown;
+    line->capacity = capacity;
+}
+
+static void line_append_format(ScanLine *line, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void line_append_format(ScanLine *line, const char *format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    const int needed = vsnprintf(NULL, 0, format, arguments);
+    va_end(arguments);
+    if (needed < 0) {
+        line->failed = 1;
+        return;
+    }
+
+    line_reserve(line, (size_t) needed);
+    if (line->failed) {
+        return;
+    }
+    va_start(arguments, format);
+    vsnprintf(line->data + line->length, line->capacity - line->length, format, arguments);
+    va_end(arguments);
+    line->length += (size_t) needed;
+}
+
+/* Quotes and backslashes are escaped and control bytes become \u00XX; other bytes pass through */
+static void line_append_string(ScanLine *line, const char *value, const size_t length) {
+    line_reserve(line, length * 6 + 2);
+    if (line->failed) {
+        return;
+    }
+
+    char *out = line->data + line->length;
+    *out++ = '"';
+    for (size_t i = 0; i < length; i++) {
+        const unsigned char character = (unsigned char) value[i];
+        if (character == '"' || character == '\\') {
+            *out++ = '\\';
+            *out++ = (char) character;
+        } else if (character < 0x20) {
+            out += sprintf(out, "\\u%04x", character);
+        } else {
+            *out++ = (char) character;
+        }
+    }
+    *out++ = '"';
+    *out = '\0';
+    line->length = (size_t) (out - line->data);
+}
+
+static void line_append_message(ScanLine *line, const ScanCapture *capture, const char *fallback) {
+    const char *message = capture->captured ? capture->message : fallback;
+    line_append_string(line, message, strlen(message));
+}
+
+static void scan_capture_report(void *context, const StegoDiagLevel level, const char *message) {
+    (void) level;
+    ScanCapture *capture = context;
+    if (!capture->captured) {
+        snprintf(capture->message, sizeof(capture->message), "%s", message);
+        capture->captured = 1;
+    }
+}
+
+static double elapsed_milliseconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) * 1e3 + (double) (now.tv_nsec - start->tv_nsec) / SCAN_NANOSECONDS_PER_MILLISECOND;
+}
+
+static void scan_emit(ScanQueue *queue, ScanLine *line, const char *path, const int detected, const int failed) {
+    pthread_mutex_lock(&queue->output_lock);
+    if (line->failed) {
+        fprintf(stderr, "Error: Could not format the scan result of %s\n", path);
+    } else {
+        fputs(line->data, stdout);
+    }
+    queue->analysed++;
+    queue->detected += (size_t) detected;
+    queue->failed += (size_t) (failed || line->failed);
+    pthread_mutex_unlock(&queue->output_lock);
+    free(line->data);
+}
+
+static void scan_report_error(ScanQueue *queue, const char *path, const char *message) {
+    ScanLine line = {0};
+    line_append_format(&line, "{\"path\":");
+    line_append_string(&line, path, strlen(path));
+    line_append_format(&line, ",\"status\":\"error\",\"error\":");
+    line_append_string(&line, message, strlen(message));
+    line_append_format(&line, "}\n");
+    scan_emit(queue, &line, path, 0, 1);
+}
+
+/* Saves the payload as <payload_directory>/<index><extension> and reports where it went */
+static void scan_save_payload(ScanLine *line, const ScanOptions *options, const ScanEntry *entry, const StegoAnalysisResult *result,
+                              const size_t extension_offset, const size_t extension_length, ScanCapture *capture) {
+    const size_t base_length = (size_t) snprintf(NULL, 0, "%s%c%zu", options->payload_directory, SCAN_PATH_SEPARATOR, entry->index);
+    char *saved_path = malloc(base_length + extension_length + STEGOBMP_NULL_CHARACTER_SIZE);
+    if (!saved_path) {
+        line_append_format(line, ",\"payload_error\":\"Could not allocate memory for the payload path\"");
+        return;
+    }
+    snprintf(saved_path, base_length + STEGOBMP_NULL_CHARACTER_SIZE, "%s%c%zu", options->payload_directory, SCAN_PATH_SEPARATOR, entry->index);
+
+    capture->captured = 0;
+    if (save_extracted_file(result->payload, result->extracted_payload_size, saved_path) == 0) {
+        memcpy(saved_path + base_length, result->payload + extension_offset, extension_length);
+        saved_path[base_length + extension_length] = STEGOBMP_NULL_CHARACTER;
+        line_append_format(line, ",\"payload\":");
+        line_append_string(line, saved_path, strlen(saved_path));
+    } else {
+        line_append_format(line, ",\"payload_error\":");
+        line_append_message(line, capture, "Could not save the payload");
+    }
+    free(saved_path);
+}
+
+static void scan_append_payload(ScanLine *line, const ScanOptions *options, const ScanEntry *entry, const StegoAnalysisResult *result, ScanCapture *capture) {
+    line_append_format(line, ",\"method\":\"%s\",\"declared_size\":%zu", stego_analysis_method_to_string(result->method), result->declared_payload_size);
+
+    size_t extension_offset = 0;
+    size_t extension_length = 0;
+    const int has_extension = stego_payload_locate_extension(result->payload, result->extracted_payload_size, result->declared_payload_size,
+                                                             &extension_offset, &extension_length);
+    if (has_extension) {
+        line_append_format(line, ",\"extension\":");
+        line_append_string(line, (const char *) result->payload + extension_offset, extension_length);
+    }
+    line_append_format(line, ",\"compressed\":%s,\"checksum_verified\":%s",
+                       result->compressed ? "true" : "false", result->checksum_verified ? "true" : "false");
+
+    if (options->payload_directory && has_extension) {
+        scan_save_payload(line, options, entry, result, extension_offset, extension_length, capture);
+    }
+}
+
+static void scan_file(ScanQueue *queue, const ScanEntry *entry, ScanCapture *capture) {
+    const ScanOptions *options = queue->options;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    capture->captured = 0;
+
+    ScanLine line = {0};
+    line_append_format(&line, "{\"path\":");
+    line_append_string(&line, entry->path, strlen(entry->path));
+
+    int detected = 0;
+    int failed = 0;
+    BMP *bmp = bmp_read_copy(entry->path);
+    if (!bmp) {
+        failed = 1;
+        line_append_format(&line, ",\"status\":\"error\",\"error\":");
+        line_append_message(&line, capture, "Can not read BMP file");
+    } else {
+        line_append_format(&line, ",\"status\":\"ok\"");
+
+        StegoAnalysisResult result;
+        stego_analysis_run(bmp, &result);
+        if (result.has_payload) {
+            detected = 1;
+            scan_append_payload(&line, options, entry, &result, capture);
+        } else {
+            line_append_format(&line, ",\"method\":null");
+        }
+        stego_analysis_result_free(&result);
+
+        StegoStatisticsResult statistics;
+        if (options->statistics && stego_statistics_run(bmp, &statistics) == 0) {
+            line_append_format(&line, ",\"embedding_rate\":%.4f,\"suspicious\":%s",
+                               statistics.embedding_rate, statistics.suspicious ? "true" : "false");
+        }
+        bmp_free(bmp);
+    }
+
+    line_append_format(&line, ",\"elapsed_ms\":%.3f}\n", elapsed_milliseconds(&start));
+    scan_emit(queue, &line, entry->path, detected, failed);
+}
+
+static int scan_queue_pop(ScanQueue *queue, ScanEntry *entry) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->walk_finished) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    if (queue->count == 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return 0;
+    }
+    *entry = queue->entries[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+}
+
+static void *scan_worker(void *context) {
+    ScanQueue *queue = context;
+
+    ScanCapture capture;
+    const StegoDiagSink sink = { scan_capture_report, &capture, STEGO_DIAG_ERROR, 0 };
+    const StegoDiagSink *previous_sink = stego_diag_set_sink(&sink);
+
+    ScanEntry entry;
+    while (scan_queue_pop(queue, &entry)) {
+        scan_file(queue, &entry, &capture);
+        free(entry.path);
+    }
+
+    stego_diag_set_sink(previous_sink);
+    return NULL;
+}
+
+/* Starts reading a file into the page cache while it waits in the queue */
+static void scan_readahead(const char *path, const int whole_file) {
+#ifdef POSIX_FADV_WILLNEED
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    posix_fadvise(fd, 0, whole_file ? 0 : SCAN_READAHEAD_BYTES, POSIX_FADV_WILLNEED);
+    close(fd);
+#else
+    (void) path;
+    (void) whole_file;
+#endif
+}
+
+/* Takes ownership of path */
+static void scan_enqueue(ScanQueue *queue, char *path) {
+    const ScanEntry entry = { path, queue->discovered++ };
+
+    if (queue->inline_analysis) {
+        scan_file(queue, &entry, &queue->inline_capture);
+        free(path);
+        return;
+    }
+
+    scan_readahead(path, queue->options->statistics);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->capacity) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    queue->entries[(queue->head + queue->count) % queue->capacity] = entry;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static char *scan_join_path(const char *directory, const char *name) {
+    const size_t directory_length = strlen(directory);
+    const int needs_separator = directory_length > 0 && directory[directory_length - 1] != SCAN_PATH_SEPARATOR;
+    const size_t length = directory_length + (size_t) needs_separator + strlen(name);
+
+    char *path = malloc(length + STEGOBMP_NULL_CHARACTER_SIZE);
+    if (!path) {
+        return NULL;
+    }
+    if (needs_separator) {
+        snprintf(path, length + STEGOBMP_NULL_CHARACTER_SIZE, "%s%c%s", directory, SCAN_PATH_SEPARATOR, name);
+    } else {
+        snprintf(path, length + STEGOBMP_NULL_CHARACTER_SIZE, "%s%s", directory, name);
+    }
+    return path;
+}
+
+static int has_bmp_extension(const char *name) {
+    const size_t length = strlen(name);
+    const size_t extension_length = strlen(SCAN_BMP_EXTENSION);
+    return length > extension_length && strcasecmp(name + length - extension_length, SCAN_BMP_EXTENSION) == 0;
+}
+
+static void scan_walk(ScanQueue *queue, const char *directory) {
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        scan_report_error(queue, directory, strerror(errno));
+        return;
+    }
+
+    const struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL) {
+        const char *name = dirent->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        char *child = scan_join_path(directory, name);
+        if (!child) {
+            scan_report_error(queue, directory, "Could not allocate memory for a path");
+            continue;
+        }
+
+        int is_directory = 0;
+        int is_file = 0;
+#ifdef DT_UNKNOWN
+        if (dirent->d_type != DT_UNKNOWN) {
+            is_directory = dirent->d_type == DT_DIR;
+            is_file = dirent->d_type == DT_REG;
+        } else
+#endif
+        {
+            /* lstat, so symlinked directories are not followed into loops */
+            struct stat child_stat;
+            if (lstat(child, &child_stat) == 0) {
+                is_directory = S_ISDIR(child_stat.st_mode);
+                is_file = S_ISREG(child_stat.st_mode);
+            }
+        }
+
+        if (is_directory) {
+            scan_walk(queue, child);
+            free(child);
+        } else if (is_file && has_bmp_extension(name)) {
+            scan_enqueue(queue, child);
+        } else {
+            free(child);
+        }
+    }
+
+    closedir(dir);
+}
+
+static int prepare_payload_directory(const char *payload_directory) {
+    struct stat directory_stat;
+    if (stat(payload_directory, &directory_stat) == 0) {
+        if (!S_ISDIR(directory_stat.st_mode)) {
+            printf("Error: Payload output %s is not a directory\n", payload_directory);
+            return 1;
+        }
+        return 0;
+    }
+    if (mkdir(payload_directory, SCAN_PAYLOAD_DIRECTORY_MODE) != 0) {
+        printf("Error: Could not create payload directory %s (%s)\n", payload_directory, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+int scan_run(const ScanOptions *options) {
+    struct stat root_stat;
+    if (!options || !options->root || stat(options->root, &root_stat) != 0) {
+        printf("Error: Can not access scan root %s\n", options && options->root ? options->root : "(null)");
+        return 1;
+    }
+    if (!S_ISDIR(root_stat.st_mode) && !S_ISREG(root_stat.st_mode)) {
+        printf("Error: Scan root %s is neither a directory nor a file\n", options->root);
+        return 1;
+    }
+    if (options->payload_directory && prepare_payload_directory(options->payload_directory)) {
+        return 1;
+    }
+
+    size_t worker_count = options->worker_count;
+    if (worker_count == 0) {
+        const long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = online_cpus > 0 ? (size_t) online_cpus : 1;
+    }
+
+    ScanQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    queue.options = options;
+    queue.capacity = worker_count * SCAN_QUEUE_DEPTH_PER_WORKER;
+    queue.entries = malloc(queue.capacity * sizeof(ScanEntry));
+    pthread_t *workers = malloc(worker_count * sizeof(pthread_t));
+    if (!queue.entries || !workers) {
+        printf("Error: Could not allocate memory for the scan queue\n");
+        free(queue.entries);
+        free(workers);
+        return 1;
+    }
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_mutex_init(&queue.output_lock, NULL);
+    pthread_cond_init(&queue.not_empty, NULL);
+    pthread_cond_init(&queue.not_full, NULL);
+
+    size_t started = 0;
+    while (started < worker_count && pthread_create(&workers[started], NULL, scan_worker, &queue) == 0) {
+        started++;
+    }
+
+    /* with no thread at all the files are still analysed, just on the calling one */
+    const StegoDiagSink inline_sink = { scan_capture_report, &queue.inline_capture, STEGO_DIAG_ERROR, 0 };
+    const StegoDiagSink *previous_sink = NULL;
+    if (started == 0) {
+        queue.inline_analysis = 1;
+        previous_sink = stego_diag_set_sink(&inline_sink);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (S_ISDIR(root_stat.st_mode)) {
+        scan_walk(&queue, options->root);
+    } else {
+        char *root_path = strdup(options->root);
+        if (root_path) {
+            scan_enqueue(&queue, root_path);
+        } else {
+            scan_report_error(&queue, options->root, "Could not allocate memory for a path");
+        }
+    }
+
+    pthread_mutex_lock(&queue.lock);
+    queue.walk_finished = 1;
+    pthread_cond_broadcast(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    if (started == 0) {
+        stego_diag_set_sink(previous_sink);
+    }
+    fflush(stdout);
+
+    fprintf(stderr, "Scan finished: %zu entries, %zu with a payload, %zu failed, %zu workers, %.3f s\n",
+            queue.analysed, queue.detected, queue.failed, started ? started : 1, elapsed_milliseconds(&start) / 1e3);
+
+    const int status = queue.failed ? 1 : 0;
+    pthread_cond_destroy(&queue.not_full);
+    pthread_cond_destroy(&queue.not_empty);
+    pthread_mutex_destroy(&queue.output_lock);
+    pthread_mutex_destroy(&queue.lock);
+    free(workers);
+    free(queue.entries);
+    return status;
+}
@@ -2,6 +2,7 @@
 #include "../../include/stegobmp/stegobmp_lsb.h"
 #include "../../include/stegobmp/stegobmp_utils.h"
 #include "../../include/crypto/crypto.h"
+#include "../../include/diagnostics/diagnostics.h"
 #include "../../include/bmp/bmp_utils.h"
 
 #include <openssl/evp.h>
@@ -16,163 +17,226 @@ static int string_has_value(const char *value) {
     return value && value[0] != '\0';
 }
 
-int hide_file_in_bmp(const char *input_filename, BMP *bmp, const char *output_bmp_filename, const char *steganography_method, const char *encryption_method, const char *encryption_mode, const char *password) {
-    size_t payload_size;
-    char *payload_extension;
-    unsigned char *payload_buffer = build_payload_buffer(input_filename, &payload_size, &payload_extension);
-    if (!payload_buffer) {
-        printf("Error: Could not prepare buffer\n");
-        return 1;
-    }
-
-    const int encryption_enabled = string_has_value(encryption_method) && string_has_value(encryption_mode) && string_has_value(password);
-
-    if (encryption_enabled) {
-        unsigned char salt[CRYPTO_SALT_SIZE];
-        if (RAND_bytes(salt, CRYPTO_SALT_SIZE) != 1) {
-            printf("Error: Could not generate salt for encryption\n");
-            free(payload_buffer);
-            free(payload_extension);
+static int hide_payload_in_bmp(BMP *bmp, const char *steganography_method, const unsigned char *payload_buffer, const size_t payload_size) {
+    if (strcmp(steganography_method, STEGOBMP_LSB1_METHOD) == 0) {
+        if (lsb_1_hide(bmp, payload_buffer, payload_size)) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not hide payload using LSB1");
             return 1;
         }
-
-        const int iv_length = crypto_get_iv_length(encryption_method, encryption_mode);
-        if (iv_length < 0 || iv_length > CRYPTO_MAX_IV_SIZE) {
-            printf("Error: Unsupported cipher or mode for IV generation\n");
-            free(payload_buffer);
-            free(payload_extension);
+    } else if (strcmp(steganography_method, STEGOBMP_LSB4_METHOD) == 0) {
+        if (lsb_4_hide(bmp, payload_buffer, payload_size)) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not hide payload using LSB4");
             return 1;
         }
-
-        unsigned char iv[CRYPTO_MAX_IV_SIZE] = {0};
-        if (iv_length > 0 && RAND_bytes(iv, iv_length) != 1) {
-            printf("Error: Could not generate IV for encryption\n");
-            free(payload_buffer);
-            free(payload_extension);
+    } else if (strcmp(steganography_method, STEGOBMP_LSBI_METHOD) == 0) {
+        if (lsb_i_hide(bmp, payload_buffer, payload_size)) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not hide payload using LSBI");
             return 1;
         }
+    }
 
-        if (payload_size > (size_t) INT_MAX) {
-            printf("Error: Payload too large to encrypt\n");
-            free(payload_buffer);
-            free(payload_extension);
+    return 0;
+}
+
+int hide_file_in_bmp(const char *input_filename, BMP *bmp, const char *output_bmp_filename, const char *steganography_method, const char *encryption_method, const char *encryption_mode, const CryptoSecret *secret, const StegoRecipients *recipients, const int compression_level, const int checksum) {
+    const size_t recipient_count = recipients ? recipients->count : 0;
+    const int encryption_enabled = string_has_value(encryption_method) && string_has_value(encryption_mode) &&
+                                   (crypto_secret_is_set(secret) || recipient_count > 0);
+
+    if (!encryption_enabled) {
+        size_t payload_size;
+        char *payload_extension;
+        unsigned char *payload_buffer = build_payload_buffer_reserved(input_filename, 0, 0, compression_level, checksum, &payload_size, &payload_extension);
+        if (!payload_buffer) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not prepare buffer");
             return 1;
         }
 
-        const int block_size = crypto_get_block_size(encryption_method, encryption_mode);
-        if (block_size < 0) {
-            printf("Error: Unsupported cipher or mode for block size calculation\n");
-            free(payload_buffer);
-            free(payload_extension);
-            return 1;
+        const int status = hide_payload_in_bmp(bmp, steganography_method, payload_buffer, payload_size);
+        free(payload_buffer);
+        free(payload_extension);
+        return status;
+    }
+
+    unsigned char salt[CRYPTO_SALT_SIZE];
+    if (RAND_bytes(salt, CRYPTO_SALT_SIZE) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not generate salt for encryption");
+        return 1;
+    }
+
+    const CryptoCipher *cipher = crypto_cipher_lookup(encryption_method, encryption_mode);
+    const int iv_length = cipher ? cipher->iv_length : -1;
+    if (iv_length < 0 || iv_length > CRYPTO_MAX_IV_SIZE) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Unsupported cipher or mode for IV generation");
+        return 1;
+    }
+
+    unsigned char iv[CRYPTO_MAX_IV_SIZE] = {0};
+    if (iv_length > 0 && RAND_bytes(iv, iv_length) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not generate IV for encryption");
+        return 1;
+    }
+
+    /*
+     * One buffer laid out as size || salt || ivlen || iv [|| recipients] [|| key check] || cipherlen || ciphertext [|| tag] || NUL.
+     * The plain container is read (or deflated) straight into the ciphertext slot
+     * and encrypted in place; the tail room absorbs the padding block or the tag.
+     */
+    const size_t metadata_size = stego_encryption_metadata_size(cipher, recipient_count);
+    const size_t cipher_offset = BMP_INT_SIZE_BYTES + metadata_size;
+    const size_t tail_room = (size_t) cipher->block_size + (size_t) cipher->tag_length + STEGOBMP_NULL_CHARACTER_SIZE;
+
+    size_t plain_size;
+    char *payload_extension;
+    unsigned char *payload_buffer = build_payload_buffer_reserved(input_filename, cipher_offset, tail_room, compression_level, checksum, &plain_size, &payload_extension);
+    if (!payload_buffer) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not prepare buffer");
+        return 1;
+    }
+
+    int status = 1;
+    StegoEncryptionHeader header = {0};
+    unsigned char data_key[CRYPTO_MAX_KEY_SIZE];
+    CryptoSecret bulk_secret = recipient_count ? crypto_secret_key(data_key, (size_t) cipher->key_length) : *secret;
+
+    if (plain_size > (size_t) INT_MAX - CRYPTO_MAX_BLOCK_SIZE) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Payload too large to encrypt");
+        goto cleanup;
+    }
+
+    memcpy(header.salt, salt, CRYPTO_SALT_SIZE);
+    header.iv_length = (unsigned char) iv_length;
+    memcpy(header.iv, iv, (size_t) iv_length);
+    /* several recipients: the bulk is encrypted once under a random key wrapped for each of them */
+    if (recipient_count) {
+        if (stego_recipients_seal(cipher, recipients, &header, data_key)) {
+            goto cleanup;
         }
+    } else {
+        header.raw_key = crypto_secret_is_raw_key(secret);
+    }
 
-        const size_t cipher_buffer_capacity = payload_size + (size_t) block_size;
-        unsigned char *cipher_buffer = malloc(cipher_buffer_capacity);
-        if (!cipher_buffer) {
-            printf("Error: Could not allocate memory for cipher buffer\n");
-            free(payload_buffer);
-            free(payload_extension);
-            return 1;
+    unsigned char *ciphertext = payload_buffer + cipher_offset;
+    int cipher_length;
+    if (cipher->aead) {
+        /* lengths are known up front, so the header is final before it is authenticated */
+        header.cipher_length = (uint32_t) plain_size;
+        header.encrypted_section_size = (uint32_t) (metadata_size + plain_size + (size_t) cipher->tag_length);
+        if (crypto_key_check_value(cipher, &bulk_secret, header.salt, header.iv, header.iv_length, header.key_check)) {
+            goto cleanup;
         }
+        stego_encryption_header_write(payload_buffer, cipher, &header);
 
-        const int cipher_length = crypto_encrypt(
+        cipher_length = crypto_aead_encrypt(
+            cipher,
+            &bulk_secret,
+            salt,
+            iv,
             payload_buffer,
-            (int) payload_size,
-            encryption_method,
-            encryption_mode,
-            password,
+            (int) cipher_offset,
+            ciphertext,
+            (int) plain_size,
+            ciphertext,
+            ciphertext + plain_size
+        );
+    } else {
+        cipher_length = crypto_cipher_encrypt(
+            cipher,
+            ciphertext,
+            (int) plain_size,
+            &bulk_secret,
             salt,
             iv_length > 0 ? iv : NULL,
-            cipher_buffer
+            ciphertext
         );
+    }
 
-        if (cipher_length < 0) {
-            printf("Error: Encryption failed\n");
-            free(cipher_buffer);
-            free(payload_buffer);
-            free(payload_extension);
-            return 1;
-        }
+    if (cipher_length < 0) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Encryption failed");
+        goto cleanup;
+    }
 
-        const size_t metadata_size = CRYPTO_SALT_SIZE + CRYPTO_METADATA_IV_LEN_SIZE + (size_t) iv_length + BMP_INT_SIZE_BYTES;
-        const size_t encrypted_section_size = metadata_size + (size_t) cipher_length;
-        const size_t final_payload_size = BMP_INT_SIZE_BYTES + encrypted_section_size + STEGOBMP_NULL_CHARACTER_SIZE;
+    const size_t sealed_length = (size_t) cipher_length + (size_t) cipher->tag_length;
+    const size_t encrypted_section_size = metadata_size + sealed_length;
+    if (encrypted_section_size > UINT32_MAX) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Encrypted payload too large to embed");
+        goto cleanup;
+    }
 
-        if (encrypted_section_size > UINT32_MAX) {
-            printf("Error: Encrypted payload too large to embed\n");
-            free(cipher_buffer);
-            free(payload_buffer);
-            free(payload_extension);
-            return 1;
-        }
+    if (!cipher->aead) {
+        header.cipher_length = (uint32_t) cipher_length;
+        header.encrypted_section_size = (uint32_t) encrypted_section_size;
+        stego_encryption_header_write(payload_buffer, cipher, &header);
+    }
+    ciphertext[sealed_length] = STEGOBMP_NULL_CHARACTER;
 
-        unsigned char *encrypted_payload = malloc(final_payload_size);
-        if (!encrypted_payload) {
-            printf("Error: Could not allocate memory for encrypted payload\n");
-            free(cipher_buffer);
-            free(payload_buffer);
-            free(payload_extension);
-            return 1;
-        }
+    const size_t payload_size = cipher_offset + sealed_length + STEGOBMP_NULL_CHARACTER_SIZE;
+    status = hide_payload_in_bmp(bmp, steganography_method, payload_buffer, payload_size);
 
-        write_uint32_big_endian(encrypted_payload, (uint32_t) encrypted_section_size);
+cleanup:
+    OPENSSL_cleanse(data_key, sizeof(data_key));
+    free(payload_buffer);
+    free(payload_extension);
+    return status;
+}
 
-        unsigned char *cursor = encrypted_payload + BMP_INT_SIZE_BYTES;
-        memcpy(cursor, salt, CRYPTO_SALT_SIZE);
-        cursor += CRYPTO_SALT_SIZE;
-        *cursor = (unsigned char) iv_length;
-        cursor += CRYPTO_METADATA_IV_LEN_SIZE;
-        if (iv_length > 0) {
-            memcpy(cursor, iv, (size_t) iv_length);
-            cursor += iv_length;
-        }
-        write_uint32_big_endian(cursor, (uint32_t) cipher_length);
-        cursor += BMP_INT_SIZE_BYTES;
-        memcpy(cursor, cipher_buffer, (size_t) cipher_length);
-        cursor += cipher_length;
-        *cursor = STEGOBMP_NULL_CHARACTER;
+/* Authenticated container: the key check value rejects a wrong password before any decryption */
+static unsigned char *open_aead_payload(const unsigned char *payload_buffer, const size_t payload_size, const CryptoCipher *cipher, const CryptoSecret *secret, size_t *plain_size) {
+    StegoEncryptionHeader header;
+    size_t header_size = 0;
+    if (stego_encryption_header_parse(payload_buffer, payload_size, cipher, &header, &header_size) ||
+        (uint64_t) BMP_INT_SIZE_BYTES + header.encrypted_section_size > payload_size) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Encrypted payload size inconsistent");
+        return NULL;
+    }
 
-        free(cipher_buffer);
-        free(payload_buffer);
+    unsigned char data_key[CRYPTO_MAX_KEY_SIZE];
+    CryptoSecret resolved;
+    unsigned char *plain_buffer = NULL;
+    if (stego_resolve_secret(cipher, &header, secret, data_key, &resolved)) {
+        goto cleanup;
+    }
+    if (!crypto_key_check_matches(cipher, &resolved, header.salt, header.iv, header.iv_length, header.key_check)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Wrong password or key (key check value mismatch)");
+        goto cleanup;
+    }
 
-        payload_buffer = encrypted_payload;
-        payload_size = final_payload_size;
+    plain_buffer = malloc((size_t) header.cipher_length + STEGOBMP_NULL_CHARACTER_SIZE);
+    if (!plain_buffer) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate memory for decrypted payload");
+        goto cleanup;
     }
 
-    if (strcmp(steganography_method, STEGOBMP_LSB1_METHOD) == 0) {
-        if (lsb_1_hide(bmp, payload_buffer, payload_size)) {
-            printf("Error: Could not hide payload using LSB1\n");
-            free(payload_buffer);
-            free(payload_extension);
-            return 1;
-        }
-    } else if (strcmp(steganography_method, STEGOBMP_LSB4_METHOD) == 0) {
-        if (lsb_4_hide(bmp, payload_buffer, payload_size)) {
-            printf("Error: Could not hide payload using LSB4\n");
-            free(payload_buffer);
-            free(payload_extension);
-            return 1;
-        }
-    } else if (strcmp(steganography_method, STEGOBMP_LSBI_METHOD) == 0) {
-        if (lsb_i_hide(bmp, payload_buffer, payload_size)) {
-            printf("Error: Could not hide payload using LSBI\n");
-            free(payload_buffer);
-            free(payload_extension);
-            return 1;
-        }
+    const unsigned char *ciphertext = payload_buffer + header_size;
+    const int plain_length = crypto_aead_decrypt(
+        cipher,
+        &resolved,
+        header.salt,
+        header.iv,
+        payload_buffer,
+        (int) header_size,
+        ciphertext,
+        (int) header.cipher_length,
+        ciphertext + header.cipher_length,
+        plain_buffer
+    );
+    if (plain_length < 0) {
+        free(plain_buffer);
+        plain_buffer = NULL;
+        goto cleanup;
     }
+    *plain_size = (size_t) plain_length;
 
-    free(payload_buffer);
-    free(payload_extension);
-    return 0;
+cleanup:
+    OPENSSL_cleanse(data_key, sizeof(data_key));
+    return plain_buffer;
 }
 
-int extract_file_from_bmp(const BMP *bmp, const char *output_filename, const char *steganography_method, const char *encryption_method, const char *encryption_mode, const char *password) {
+int extract_file_from_bmp(const BMP *bmp, const char *output_filename, const char *steganography_method, const char *encryption_method, const char *encryption_mode, const CryptoSecret *secret, const int decrypt_threads) {
     unsigned char *payload_buffer = NULL;
     size_t extracted_payload_size = 0;
 
-    const int encryption_enabled = string_has_value(encryption_method) && string_has_value(encryption_mode) && string_has_value(password);
+    const int encryption_enabled = string_has_value(encryption_method) && string_has_value(encryption_mode) && crypto_secret_is_set(secret);
 
     if (strcmp(steganography_method, STEGOBMP_LSB1_METHOD) == 0) {
         if (encryption_enabled) {
@@ -181,19 +245,19 @@ int extract_file_from_bmp(const BMP *bmp, const char *output_filename, const cha
             payload_buffer = lsb_1_retrieve(bmp, &extracted_payload_size);
         }
         if (!payload_buffer) {
-            printf("Error: Could not retrieve payload using LSB1\n");
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not retrieve payload using LSB1");
             return 1;
         }
     } else if (strcmp(steganography_method, STEGOBMP_LSB4_METHOD) == 0) {
         payload_buffer = lsb_4_retrieve(bmp, &extracted_payload_size);
         if (!payload_buffer) {
-            printf("Error: Could not retrieve payload using LSB4\n");
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not retrieve payload using LSB4");
             return 1;
         }
     } else if (strcmp(steganography_method, STEGOBMP_LSBI_METHOD) == 0) {
         payload_buffer = lsb_i_retrieve(bmp, &extracted_payload_size);
         if (!payload_buffer) {
-            printf("Error: Could not retrieve payload using LSBI\n");
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not retrieve payload using LSBI");
             return 1;
         }
     }
@@ -203,98 +267,86 @@ int extract_file_from_bmp(const BMP *bmp, const char *output_filename, const cha
 
     if (encryption_enabled) {
         if (extracted_payload_size < BMP_INT_SIZE_BYTES + 1) {
-            printf("Error: Payload too small to contain encrypted data\n");
+            stego_diag_report(STEGO_DIAG_ERROR, "Payload too small to contain encrypted data");
+            free(payload_buffer);
+            return 1;
+        }
+
+        const CryptoCipher *cipher = crypto_cipher_lookup(encryption_method, encryption_mode);
+        if (cipher && cipher->aead) {
+            size_t plain_size = 0;
+            unsigned char *plain_buffer = open_aead_payload(payload_buffer, extracted_payload_size, cipher, secret, &plain_size);
+            free(payload_buffer);
+            if (!plain_buffer) {
+                stego_diag_report(STEGO_DIAG_ERROR, "Decryption failed");
+                return 1;
+            }
+            const int save_status = save_extracted_file(plain_buffer, plain_size, output_filename);
+            free(plain_buffer);
+            if (save_status == 1) {
+                stego_diag_report(STEGO_DIAG_ERROR, "Could not save extracted file");
+                return 1;
+            }
+            return 0;
+        }
+
+        if (!cipher) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Unsupported cipher or mode for decryption");
             free(payload_buffer);
             return 1;
         }
 
         const uint32_t header_length = read_uint32_big_endian(payload_buffer);
         if (header_length == 0 || (size_t)header_length > extracted_payload_size - BMP_INT_SIZE_BYTES) {
-            printf("Error: Encrypted payload size inconsistent\n");
+            stego_diag_report(STEGO_DIAG_ERROR, "Encrypted payload size inconsistent");
             free(payload_buffer);
             return 1;
         }
 
+        /* payloads without metadata are bare ciphertext under a password-derived key */
+        StegoEncryptionHeader header;
+        size_t header_size = 0;
         const unsigned char *ciphertext = NULL;
         uint32_t cipher_length = 0;
-        unsigned char iv[CRYPTO_MAX_IV_SIZE] = {0};
-        unsigned char iv_length = 0;
-        unsigned char salt_buffer[CRYPTO_SALT_SIZE] = {0};
-        const unsigned char *salt_ptr = salt_buffer;
-
-        int use_metadata_format = 0;
-
-        if (header_length >= CRYPTO_SALT_SIZE + CRYPTO_METADATA_IV_LEN_SIZE + BMP_INT_SIZE_BYTES &&
-            extracted_payload_size >= BMP_INT_SIZE_BYTES + header_length) {
-
-            const unsigned char *cursor = payload_buffer + BMP_INT_SIZE_BYTES;
-            const unsigned char *candidate_salt = cursor;
-            cursor += CRYPTO_SALT_SIZE;
-
-            const unsigned char candidate_iv_length = *cursor;
-
-            if (candidate_iv_length <= CRYPTO_MAX_IV_SIZE) {
-                iv_length = candidate_iv_length;
-                cursor += CRYPTO_METADATA_IV_LEN_SIZE;
-
-                const size_t metadata_size = CRYPTO_SALT_SIZE + CRYPTO_METADATA_IV_LEN_SIZE + (size_t)iv_length + BMP_INT_SIZE_BYTES;
-
-                if ((size_t)header_length >= metadata_size) {
-                    const unsigned char *meta_cursor = cursor;
-
-                    if (iv_length > 0) {
-                        memcpy(iv, meta_cursor, (size_t)iv_length);
-                        meta_cursor += iv_length;
-                    }
-
-                    const uint32_t candidate_cipher_length = read_uint32_big_endian(meta_cursor);
-                    meta_cursor += BMP_INT_SIZE_BYTES;
-
-                    if (candidate_cipher_length > 0 &&
-                        (size_t)candidate_cipher_length == (size_t)header_length - metadata_size) {
-
-                        memcpy(salt_buffer, candidate_salt, CRYPTO_SALT_SIZE);
-                        cipher_length = candidate_cipher_length;
-                        ciphertext = meta_cursor;
-                        use_metadata_format = 1;
-                    }
-                }
-            }
-        }
-
-        if (!use_metadata_format) {
-            cipher_length = header_length;
+        if (stego_encryption_header_parse(payload_buffer, extracted_payload_size, cipher, &header, &header_size) == 0) {
+            ciphertext = payload_buffer + header_size;
+            cipher_length = header.cipher_length;
+        } else {
+            memset(&header, 0, sizeof(header));
             ciphertext = payload_buffer + BMP_INT_SIZE_BYTES;
-            iv_length = 0;
+            cipher_length = header_length;
         }
 
-        const int block_size = crypto_get_block_size(encryption_method, encryption_mode);
-        if (block_size < 0) {
-            printf("Error: Unsupported cipher or mode for decryption\n");
+        unsigned char data_key[CRYPTO_MAX_KEY_SIZE];
+        CryptoSecret resolved;
+        if (stego_resolve_secret(cipher, &header, secret, data_key, &resolved)) {
+            OPENSSL_cleanse(data_key, sizeof(data_key));
             free(payload_buffer);
             return 1;
         }
 
-        unsigned char *decrypted_buffer = malloc((size_t)cipher_length + (size_t)block_size);
+        unsigned char *decrypted_buffer = malloc((size_t)cipher_length + (size_t)cipher->block_size);
         if (!decrypted_buffer) {
-            printf("Error: Could not allocate memory for decrypted payload\n");
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate memory for decrypted payload");
+            OPENSSL_cleanse(data_key, sizeof(data_key));
             free(payload_buffer);
             return 1;
         }
 
-        const int plain_length = crypto_decrypt(
+        const int plain_length = crypto_cipher_decrypt_parallel(
+            cipher,
             ciphertext,
             (int)cipher_length,
-            encryption_method,
-            encryption_mode,
-            password,
-            salt_ptr,
-            iv_length > 0 ? iv : NULL,
-            decrypted_buffer
+            &resolved,
+            header.salt,
+            header.iv_length > 0 ? header.iv : NULL,
+            decrypted_buffer,
+            decrypt_threads
         );
+        OPENSSL_cleanse(data_key, sizeof(data_key));
 
         if (plain_length < 0) {
-            printf("Error: Decryption failed\n");
+            stego_diag_report(STEGO_DIAG_ERROR, "Decryption failed");
             free(decrypted_buffer);
             free(payload_buffer);
             return 1;
@@ -306,7 +358,7 @@ int extract_file_from_bmp(const BMP *bmp, const char *output_filename, const cha
     }
 
     if (save_extracted_file(data_to_save, data_to_save_size, output_filename) == 1) {
-        printf("Error: Could not save extracted file\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not save extracted file");
         if (encryption_enabled) {
             free(data_to_save);
         } else {
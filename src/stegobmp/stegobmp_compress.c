@@ -0,0 +1,225 @@
+#include "../../include/stegobmp/stegobmp_compress.h"
+#include "../../include/bmp/bmp_utils.h"
+#include "../../include/diagnostics/diagnostics.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* receives each piece of deflated output; returns 0 to keep going */
+typedef int (*deflate_output_fn)(void *context, const unsigned char *bytes, size_t length);
+
+typedef struct {
+    unsigned char *output;
+    size_t capacity;
+    size_t used;
+} BufferOutput;
+
+static int buffer_output(void *context, const unsigned char *bytes, const size_t length) {
+    BufferOutput *buffer = context;
+    if (length > buffer->capacity - buffer->used) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Compressed payload exceeds its reserved buffer");
+        return 1;
+    }
+    memcpy(buffer->output + buffer->used, bytes, length);
+    buffer->used += length;
+    return 0;
+}
+
+static int file_output(void *context, const unsigned char *bytes, const size_t length) {
+    if (fwrite(bytes, BMP_BYTE_SIZE, length, context) != length) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not write compressed payload");
+        return 1;
+    }
+    return 0;
+}
+
+size_t stego_compress_bound(const uint32_t input_size) {
+    return (size_t) compressBound((uLong) input_size);
+}
+
+static int deflate_file(FILE *input, const uint32_t input_size, const int level, const deflate_output_fn output, void *context) {
+    if (level < STEGOBMP_COMPRESSION_MIN_LEVEL || level > STEGOBMP_COMPRESSION_MAX_LEVEL) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Unsupported compression level %d", level);
+        return 1;
+    }
+
+    unsigned char *in_chunk = malloc(STEGOBMP_COMPRESSION_CHUNK_SIZE);
+    unsigned char *out_chunk = malloc(STEGOBMP_COMPRESSION_CHUNK_SIZE);
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (!in_chunk || !out_chunk || deflateInit(&stream, level) != Z_OK) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not initialize compression");
+        free(in_chunk);
+        free(out_chunk);
+        return 1;
+    }
+
+    int status = 0;
+    uint64_t total_read = 0;
+    int flush = Z_NO_FLUSH;
+    while (!status && flush != Z_FINISH) {
+        const size_t read_bytes = fread(in_chunk, BMP_BYTE_SIZE, STEGOBMP_COMPRESSION_CHUNK_SIZE, input);
+        total_read += read_bytes;
+        if (ferror(input) || total_read > input_size) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not read input file (size changed while reading?)");
+            status = 1;
+            break;
+        }
+        flush = read_bytes < STEGOBMP_COMPRESSION_CHUNK_SIZE ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = in_chunk;
+        stream.avail_in = (uInt) read_bytes;
+
+        do {
+            stream.next_out = out_chunk;
+            stream.avail_out = STEGOBMP_COMPRESSION_CHUNK_SIZE;
+            if (deflate(&stream, flush) == Z_STREAM_ERROR) {
+                stego_diag_report(STEGO_DIAG_ERROR, "Compression failed");
+                status = 1;
+                break;
+            }
+            status = output(context, out_chunk, STEGOBMP_COMPRESSION_CHUNK_SIZE - stream.avail_out);
+        } while (!status && stream.avail_out == 0);
+    }
+
+    if (!status && total_read != input_size) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not read input file (size changed while reading?)");
+        status = 1;
+    }
+
+    deflateEnd(&stream);
+    free(in_chunk);
+    free(out_chunk);
+    return status;
+}
+
+int stego_compress_file_to_buffer(FILE *input, const uint32_t input_size, const int level, unsigned char *output, const size_t output_capacity, size_t *output_size) {
+    BufferOutput buffer = { output, output_capacity, 0 };
+    if (deflate_file(input, input_size, level, buffer_output, &buffer)) {
+        return 1;
+    }
+    *output_size = buffer.used;
+    return 0;
+}
+
+FILE *stego_compress_file_to_temporary(FILE *input, const uint32_t input_size, const int level, uint32_t *output_size) {
+    FILE *temporary = tmpfile();
+    if (!temporary) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not create temporary file for compression");
+        return NULL;
+    }
+
+    if (deflate_file(input, input_size, level, file_output, temporary)) {
+        fclose(temporary);
+        return NULL;
+    }
+
+    const long size = ftell(temporary);
+    if (size < 0 || (unsigned long) size > STEGOBMP_SIZE_LENGTH_MASK || fflush(temporary) != 0) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Compressed payload too large to embed");
+        fclose(temporary);
+        return NULL;
+    }
+    rewind(temporary);
+
+    *output_size = (uint32_t) size;
+    return temporary;
+}
+
+int stego_payload_writer_init(StegoPayloadWriter *writer, FILE *file, const int compressed) {
+    memset(writer, 0, sizeof(*writer));
+    writer->file = file;
+    writer->compressed = compressed;
+    if (!compressed) {
+        return 0;
+    }
+
+    writer->buffer = malloc(STEGOBMP_COMPRESSION_CHUNK_SIZE);
+    if (!writer->buffer || inflateInit(&writer->stream) != Z_OK) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not initialize decompression");
+        free(writer->buffer);
+        writer->buffer = NULL;
+        writer->compressed = 0;
+        return 1;
+    }
+    return 0;
+}
+
+int stego_payload_writer_write(StegoPayloadWriter *writer, const unsigned char *bytes, const size_t length) {
+    if (!writer->compressed) {
+        if (fwrite(bytes, BMP_BYTE_SIZE, length, writer->file) != length) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not write extracted data");
+            return 1;
+        }
+        return 0;
+    }
+
+    if (length > 0 && writer->stream_ended) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Compressed payload is corrupt (data after end of stream)");
+        return 1;
+    }
+
+    writer->stream.next_in = (Bytef *) bytes;
+    writer->stream.avail_in = (uInt) length;
+    while (writer->stream.avail_in > 0) {
+        writer->stream.next_out = writer->buffer;
+        writer->stream.avail_out = STEGOBMP_COMPRESSION_CHUNK_SIZE;
+
+        const int result = inflate(&writer->stream, Z_NO_FLUSH);
+        if (result != Z_OK && result != Z_STREAM_END) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Compressed payload is corrupt");
+            return 1;
+        }
+
+        const size_t produced = STEGOBMP_COMPRESSION_CHUNK_SIZE - writer->stream.avail_out;
+        if (fwrite(writer->buffer, BMP_BYTE_SIZE, produced, writer->file) != produced) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not write extracted data");
+            return 1;
+        }
+
+        if (result == Z_STREAM_END) {
+            writer->stream_ended = 1;
+            if (writer->stream.avail_in > 0) {
+                stego_diag_report(STEGO_DIAG_ERROR, "Compressed payload is corrupt (data after end of stream)");
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int stego_payload_writer_finish(StegoPayloadWriter *writer) {
+    if (!writer->compressed) {
+        return 0;
+    }
+
+    /* output still held back by zlib once all input went in */
+    while (!writer->stream_ended) {
+        writer->stream.next_in = NULL;
+        writer->stream.avail_in = 0;
+        writer->stream.next_out = writer->buffer;
+        writer->stream.avail_out = STEGOBMP_COMPRESSION_CHUNK_SIZE;
+
+        const int result = inflate(&writer->stream, Z_FINISH);
+        const size_t produced = STEGOBMP_COMPRESSION_CHUNK_SIZE - writer->stream.avail_out;
+        if (produced > 0 && fwrite(writer->buffer, BMP_BYTE_SIZE, produced, writer->file) != produced) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not write extracted data");
+            return 1;
+        }
+        if (result == Z_STREAM_END) {
+            writer->stream_ended = 1;
+        } else if (produced == 0) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Compressed payload is truncated");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void stego_payload_writer_free(StegoPayloadWriter *writer) {
+    if (writer->compressed) {
+        inflateEnd(&writer->stream);
+    }
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->compressed = 0;
+}
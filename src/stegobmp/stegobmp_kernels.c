@@ -0,0 +1,1635 @@
+#include "../../include/stegobmp/stegobmp_kernels.h"
+#include "../../include/stegobmp/stegobmp_lsb.h"
+#include "../../include/diagnostics/diagnostics.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define STEGOBMP_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+#define STEGOBMP_SELF_CHECK_MAX_PAYLOAD 257
+#define STEGOBMP_SELF_CHECK_MAX_OFFSET 3
+/* tall enough for the steganalysis lane counters to spill more than once */
+#define STEGOBMP_SELF_CHECK_STAT_WIDTH 160
+#define STEGOBMP_SELF_CHECK_STAT_ROWS 36
+#define STEGOBMP_SELF_CHECK_STAT_ROW_BYTES (STEGOBMP_SELF_CHECK_STAT_WIDTH * STEGOBMP_STAT_CHANNELS + 3)
+
+/* CRC32C (Castagnoli), reflected polynomial */
+#define STEGOBMP_CRC32C_POLYNOMIAL 0x82F63B78u
+#define STEGOBMP_CRC32C_CHECK_INPUT "123456789"
+#define STEGOBMP_CRC32C_CHECK_VALUE 0xE3069283u
+
+/* Vector steps between spills of the 8/16-bit steganalysis lane counters */
+#define STEGOBMP_STAT_FLUSH_INTERVAL 255
+#define STEGOBMP_STAT_MAX_LANES 32
+
+typedef uint32_t (*stego_crc32c_fn)(uint32_t, const unsigned char *, size_t);
+
+typedef struct {
+    StegoKernelLevel level;
+    void (*lsb1_spread)(unsigned char *, const unsigned char *, size_t);
+    void (*lsb1_gather)(unsigned char *, const unsigned char *, size_t);
+    void (*lsb4_spread)(unsigned char *, const unsigned char *, size_t);
+    void (*lsb4_gather)(unsigned char *, const unsigned char *, size_t);
+    void (*pattern_gather)(unsigned char *, const unsigned char *, size_t);
+    void (*lsbi_costs)(const unsigned char *, const unsigned char *, size_t, uint64_t *, uint64_t *);
+    void (*lsbi_apply)(unsigned char *, const unsigned char *, size_t, const int *);
+    void (*lsbi_decode)(unsigned char *, const unsigned char *, size_t, const int *);
+    void (*sample_pairs)(const unsigned char *, size_t, size_t, size_t, StegoSamplePairCounts *);
+    void (*rs_groups)(const unsigned char *, size_t, size_t, size_t, StegoRsCounts *);
+} StegoKernelTable;
+
+/* Every LSBI payload byte lives in 12 consecutive carrier bytes (4 pixels minus
+ * their red channel). These are the offsets of its bits, MSB first. */
+static const unsigned char lsbi_bit_offsets[8] = {0, 2, 3, 5, 6, 8, 9, 11};
+
+/* ---------------------------------------------------------------------- */
+/* Scalar reference kernels                                                */
+/* ---------------------------------------------------------------------- */
+
+static void lsb1_spread_scalar(unsigned char *carrier, const unsigned char *payload, const size_t payload_size)
+{
+    for (size_t payload_index = 0; payload_index < payload_size; payload_index++)
+    {
+        for (int bit_index = STEGOBMP_LSB1_MOST_SIGNIFICANT_BIT; bit_index >= 0; bit_index--)
+        {
+            const unsigned char bit = (unsigned char)((payload[payload_index] >> bit_index) & STEGOBMP_LSB1_BIT_MASK_1);
+            *carrier = (unsigned char)((*carrier & STEGOBMP_LSB1_MASK) | bit);
+            carrier++;
+        }
+    }
+}
+
+static void lsb1_gather_scalar(unsigned char *payload, const unsigned char *carrier, const size_t payload_size)
+{
+    for (size_t payload_index = 0; payload_index < payload_size; payload_index++)
+    {
+        unsigned char acc = 0;
+        for (int b = STEGOBMP_LSB1_MOST_SIGNIFICANT_BIT; b >= 0; --b)
+        {
+            acc |= (unsigned char)((*carrier++ & STEGOBMP_LSB1_BIT_MASK_1) << b);
+        }
+        payload[payload_index] = acc;
+    }
+}
+
+static void lsb4_spread_scalar(unsigned char *carrier, const unsigned char *payload, const size_t payload_size)
+{
+    for (size_t payload_index = 0; payload_index < payload_size; payload_index++)
+    {
+        const unsigned char payload_high_nibble = payload[payload_index] >> STEGOBMP_LSB4_NIBBLE_SIZE_BITS & STEGOBMP_LSB4_BIT_MASK_4;
+        const unsigned char payload_low_nibble = payload[payload_index] & STEGOBMP_LSB4_BIT_MASK_4;
+
+        carrier[0] = carrier[0] & STEGOBMP_LSB4_MASK | payload_high_nibble;
+        carrier[1] = carrier[1] & STEGOBMP_LSB4_MASK | payload_low_nibble;
+        carrier += STEGOBMP_LSB4_BYTES_PER_PAYLOAD;
+    }
+}
+
+static void lsb4_gather_scalar(unsigned char *payload, const unsigned char *carrier, const size_t payload_size)
+{
+    for (size_t payload_index = 0; payload_index < payload_size; payload_index++)
+    {
+        const unsigned char msn = carrier[0] & STEGOBMP_LSB4_BIT_MASK_4;
+        const unsigned char lsn = carrier[1] & STEGOBMP_LSB4_BIT_MASK_4;
+        payload[payload_index] = (unsigned char)(msn << STEGOBMP_LSB4_NIBBLE_SIZE_BITS | lsn);
+        carrier += STEGOBMP_LSB4_BYTES_PER_PAYLOAD;
+    }
+}
+
+static void pattern_gather_scalar(unsigned char *plane, const unsigned char *carrier, const size_t plane_size)
+{
+    for (size_t plane_index = 0; plane_index < plane_size; plane_index++)
+    {
+        unsigned char acc = 0;
+        for (int c = 0; c < STEGOBMP_PATTERNS_PER_PLANE_BYTE; ++c)
+        {
+            acc = (unsigned char)((acc << 2) | ((*carrier++ & STEGOBMP_LSBI_PATTERN_MASK) >> STEGOBMP_LSBI_PATTERN_SHIFT));
+        }
+        plane[plane_index] = acc;
+    }
+}
+
+/* The LSBI kernels take block = carrier + STEGOBMP_LSBI_CONTROL_BYTES + 12 * first payload byte */
+static void lsbi_costs_scalar(const unsigned char *block, const unsigned char *payload, const size_t payload_size, uint64_t *cost0, uint64_t *cost1)
+{
+    for (size_t payload_index = 0; payload_index < payload_size; payload_index++)
+    {
+        for (int b = 0; b < 8; ++b)
+        {
+            const unsigned char pix = block[lsbi_bit_offsets[b]];
+            const int pattern = (pix & STEGOBMP_LSBI_PATTERN_MASK) >> STEGOBMP_LSBI_PATTERN_SHIFT;
+            const int orig = pix & 1;
+            const int desired = (payload[payload_index] >> (7 - b)) & 1;
+            if (orig != desired)
+                cost0[pattern]++;
+            if (orig != (desired ^ 1))
+                cost1[pattern]++;
+        }
+        block += STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD;
+    }
+}
+
+static void lsbi_apply_scalar(unsigned char *block, const unsigned char *payload, const size_t payload_size, const int *must_change)
+{
+    for (size_t payload_index = 0; payload_index < payload_size; payload_index++)
+    {
+        for (int b = 0; b < 8; ++b)
+        {
+            unsigned char *pix = block + lsbi_bit_offsets[b];
+            int desired = (payload[payload_index] >> (7 - b)) & 1;
+            if (must_change[(*pix & STEGOBMP_LSBI_PATTERN_MASK) >> STEGOBMP_LSBI_PATTERN_SHIFT])
+                desired ^= 1;
+            *pix = (unsigned char)((*pix & STEGOBMP_LSBI_MASK) | desired);
+        }
+        block += STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD;
+    }
+}
+
+static void lsbi_decode_scalar(unsigned char *payload, const unsigned char *block, const size_t payload_size, const int *must_change)
+{
+    for (size_t payload_index = 0; payload_index < payload_size; payload_index++)
+    {
+        unsigned char acc = 0;
+        for (int b = 0; b < 8; ++b)
+        {
+            const unsigned char pix = block[lsbi_bit_offsets[b]];
+            int bit = pix & 1;
+            if (must_change[(pix & STEGOBMP_LSBI_PATTERN_MASK) >> STEGOBMP_LSBI_PATTERN_SHIFT])
+                bit ^= 1;
+            acc = (unsigned char)((acc << 1) | (unsigned char)bit);
+        }
+        payload[payload_index] = acc;
+        block += STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD;
+    }
+}
+
+/* Slice-by-8: table[k][b] is the CRC of byte b followed by k zero bytes */
+static uint32_t crc32c_table[8][256];
+
+static void crc32c_table_init(void)
+{
+    for (uint32_t b = 0; b < 256; b++)
+    {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ ((crc & 1) ? STEGOBMP_CRC32C_POLYNOMIAL : 0);
+        crc32c_table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++)
+        for (int k = 1; k < 8; k++)
+            crc32c_table[k][b] = (crc32c_table[k - 1][b] >> 8) ^ crc32c_table[0][crc32c_table[k - 1][b] & 0xFF];
+}
+
+/* Works on the inverted register; the public wrapper inverts in and out */
+static uint32_t crc32c_scalar(uint32_t crc, const unsigned char *data, size_t length)
+{
+    while (length >= 8)
+    {
+        const uint32_t low = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+        const uint32_t high = (uint32_t)data[4] | (uint32_t)data[5] << 8 | (uint32_t)data[6] << 16 | (uint32_t)data[7] << 24;
+        crc = crc32c_table[7][low & 0xFF] ^ crc32c_table[6][(low >> 8) & 0xFF] ^
+              crc32c_table[5][(low >> 16) & 0xFF] ^ crc32c_table[4][low >> 24] ^
+              crc32c_table[3][high & 0xFF] ^ crc32c_table[2][(high >> 8) & 0xFF] ^
+              crc32c_table[1][(high >> 16) & 0xFF] ^ crc32c_table[0][high >> 24];
+        data += 8;
+        length -= 8;
+    }
+    while (length--)
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *data++) & 0xFF];
+    return crc;
+}
+
+/* Byte j of a row is channel j % 3 and the same channel of the next pixel sits
+ * 3 bytes further, so every byte that has a successor starts a pair (or group) */
+static size_t stat_pair_bytes(const size_t pixel_count)
+{
+    return pixel_count > 1 ? (pixel_count - 1) * STEGOBMP_STAT_CHANNELS : 0;
+}
+
+static size_t stat_group_bytes(const size_t pixel_count)
+{
+    return pixel_count >= STEGOBMP_RS_GROUP_SIZE ? (pixel_count - (STEGOBMP_RS_GROUP_SIZE - 1)) * STEGOBMP_STAT_CHANNELS : 0;
+}
+
+static void sample_pairs_bytes(const unsigned char *row, size_t begin, const size_t end, StegoSamplePairCounts *counts)
+{
+    size_t channel = begin % STEGOBMP_STAT_CHANNELS;
+    for (; begin < end; begin++)
+    {
+        const unsigned char u = row[begin];
+        const unsigned char v = row[begin + STEGOBMP_STAT_CHANNELS];
+        StegoSamplePairCounts *count = &counts[channel];
+        count->pairs++;
+        if (u != v)
+        {
+            if (((v & 1) == 0) == (u < v))
+                count->x++;
+            else
+                count->y++;
+        }
+        if ((u >> 1) == (v >> 1))
+            count->same_msbs++;
+        if (++channel == STEGOBMP_STAT_CHANNELS)
+            channel = 0;
+    }
+}
+
+/* F-1 swaps 2k - 1 and 2k, so 0 becomes -1 and 255 becomes 256 */
+static inline int rs_flip_negative(const int value)
+{
+    return ((value + 1) ^ 1) - 1;
+}
+
+static inline int rs_smoothness(const int a, const int b, const int c, const int d)
+{
+    return abs(b - a) + abs(c - b) + abs(d - c);
+}
+
+static inline void rs_classify(StegoRsCounts *count, const StegoRsCase rs_case, const int before, const int after)
+{
+    count->regular[rs_case] += after > before;
+    count->singular[rs_case] += after < before;
+}
+
+static void rs_groups_bytes(const unsigned char *row, size_t begin, const size_t end, StegoRsCounts *counts)
+{
+    size_t channel = begin % STEGOBMP_STAT_CHANNELS;
+    for (; begin < end; begin++)
+    {
+        const int a = row[begin];
+        const int b = row[begin + STEGOBMP_STAT_CHANNELS];
+        const int c = row[begin + 2 * STEGOBMP_STAT_CHANNELS];
+        const int d = row[begin + 3 * STEGOBMP_STAT_CHANNELS];
+        const int smoothness = rs_smoothness(a, b, c, d);
+        const int inverted_smoothness = rs_smoothness(a ^ 1, b ^ 1, c ^ 1, d ^ 1);
+
+        StegoRsCounts *count = &counts[channel];
+        count->groups++;
+        rs_classify(count, STEGOBMP_RS_POSITIVE, smoothness, rs_smoothness(a, b ^ 1, c ^ 1, d));
+        rs_classify(count, STEGOBMP_RS_NEGATIVE, smoothness, rs_smoothness(a, rs_flip_negative(b), rs_flip_negative(c), d));
+        rs_classify(count, STEGOBMP_RS_POSITIVE_INVERTED, inverted_smoothness, rs_smoothness(a ^ 1, b, c, d ^ 1));
+        rs_classify(count, STEGOBMP_RS_NEGATIVE_INVERTED, inverted_smoothness, rs_smoothness(a ^ 1, rs_flip_negative(b ^ 1), rs_flip_negative(c ^ 1), d ^ 1));
+        if (++channel == STEGOBMP_STAT_CHANNELS)
+            channel = 0;
+    }
+}
+
+static void sample_pairs_scalar(const unsigned char *pixels, const size_t row_bytes, const size_t pixel_count, const size_t row_count, StegoSamplePairCounts *counts)
+{
+    for (size_t row = 0; row < row_count; row++)
+        sample_pairs_bytes(pixels + row * row_bytes, 0, stat_pair_bytes(pixel_count), counts);
+}
+
+static void rs_groups_scalar(const unsigned char *pixels, const size_t row_bytes, const size_t pixel_count, const size_t row_count, StegoRsCounts *counts)
+{
+    for (size_t row = 0; row < row_count; row++)
+        rs_groups_bytes(pixels + row * row_bytes, 0, stat_group_bytes(pixel_count), counts);
+}
+
+/*
+ * The vector kernels step through a row in chunks of 3 vectors. Lane l of the
+ * vector at chunk offset phase * lanes always holds channel (phase * lanes + l) % 3,
+ * so each phase keeps its own lane counters and they are folded into channels
+ * once, at the end. Narrow lane counters are spilled into these every
+ * STEGOBMP_STAT_FLUSH_INTERVAL steps.
+ */
+typedef struct {
+    uint64_t x[STEGOBMP_STAT_CHANNELS][STEGOBMP_STAT_MAX_LANES];
+    uint64_t y[STEGOBMP_STAT_CHANNELS][STEGOBMP_STAT_MAX_LANES];
+    uint64_t same_msbs[STEGOBMP_STAT_CHANNELS][STEGOBMP_STAT_MAX_LANES];
+} StegoPairLanes;
+
+typedef struct {
+    uint64_t regular[STEGOBMP_STAT_CHANNELS][STEGOBMP_RS_CASES][STEGOBMP_STAT_MAX_LANES];
+    uint64_t singular[STEGOBMP_STAT_CHANNELS][STEGOBMP_RS_CASES][STEGOBMP_STAT_MAX_LANES];
+} StegoRsLanes;
+
+static void stat_lanes_add8(uint64_t *totals, const unsigned char *lanes, const size_t lane_count)
+{
+    for (size_t lane = 0; lane < lane_count; lane++)
+        totals[lane] += lanes[lane];
+}
+
+static void stat_lanes_add16(uint64_t *totals, const uint16_t *lanes, const size_t lane_count)
+{
+    for (size_t lane = 0; lane < lane_count; lane++)
+        totals[lane] += lanes[lane];
+}
+
+static void sample_pairs_fold(const StegoPairLanes *lanes, const size_t lane_count, const uint64_t full_chunks, StegoSamplePairCounts *counts)
+{
+    for (size_t phase = 0; phase < STEGOBMP_STAT_CHANNELS; phase++)
+    {
+        for (size_t lane = 0; lane < lane_count; lane++)
+        {
+            StegoSamplePairCounts *count = &counts[(phase * lane_count + lane) % STEGOBMP_STAT_CHANNELS];
+            count->x += lanes->x[phase][lane];
+            count->y += lanes->y[phase][lane];
+            count->same_msbs += lanes->same_msbs[phase][lane];
+        }
+    }
+    /* a chunk holds lane_count pairs of every channel */
+    for (size_t channel = 0; channel < STEGOBMP_STAT_CHANNELS; channel++)
+        counts[channel].pairs += full_chunks * lane_count;
+}
+
+static void rs_groups_fold(const StegoRsLanes *lanes, const size_t lane_count, const uint64_t full_chunks, StegoRsCounts *counts)
+{
+    for (size_t phase = 0; phase < STEGOBMP_STAT_CHANNELS; phase++)
+    {
+        for (size_t lane = 0; lane < lane_count; lane++)
+        {
+            StegoRsCounts *count = &counts[(phase * lane_count + lane) % STEGOBMP_STAT_CHANNELS];
+            for (int rs_case = 0; rs_case < STEGOBMP_RS_CASES; rs_case++)
+            {
+                count->regular[rs_case] += lanes->regular[phase][rs_case][lane];
+                count->singular[rs_case] += lanes->singular[phase][rs_case][lane];
+            }
+        }
+    }
+    for (size_t channel = 0; channel < STEGOBMP_STAT_CHANNELS; channel++)
+        counts[channel].groups += full_chunks * lane_count;
+}
+
+static void stat_histograms_flush(uint32_t tables[2][STEGOBMP_STAT_CHANNELS][STEGOBMP_STAT_LEVELS], uint64_t histogram[STEGOBMP_STAT_CHANNELS][STEGOBMP_STAT_LEVELS])
+{
+    for (size_t channel = 0; channel < STEGOBMP_STAT_CHANNELS; channel++)
+        for (size_t level = 0; level < STEGOBMP_STAT_LEVELS; level++)
+            histogram[channel][level] += (uint64_t)tables[0][channel][level] + tables[1][channel][level];
+    memset(tables, 0, 2 * sizeof(tables[0]));
+}
+
+static const StegoKernelTable scalar_table = {
+    STEGOBMP_KERNEL_SCALAR,
+    lsb1_spread_scalar,
+    lsb1_gather_scalar,
+    lsb4_spread_scalar,
+    lsb4_gather_scalar,
+    pattern_gather_scalar,
+    lsbi_costs_scalar,
+    lsbi_apply_scalar,
+    lsbi_decode_scalar,
+    sample_pairs_scalar,
+    rs_groups_scalar
+};
+
+#ifdef STEGOBMP_KERNELS_X86
+
+/* ---------------------------------------------------------------------- */
+/* SSE2 kernels                                                             */
+/* ---------------------------------------------------------------------- */
+
+__attribute__((target("sse2")))
+static inline __m128i lsb1_expand_sse2(const __m128i replicated, const __m128i bit_select, const __m128i carrier)
+{
+    /* every lane keeps one payload bit: 0x80 for carrier byte 0 ... 0x01 for byte 7 */
+    const __m128i bits = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(replicated, bit_select), bit_select), _mm_set1_epi8(STEGOBMP_LSB1_BIT_MASK_1));
+    return _mm_or_si128(_mm_and_si128(carrier, _mm_set1_epi8((char)STEGOBMP_LSB1_MASK)), bits);
+}
+
+/* 8 payload bytes -> 64 carrier bytes per step */
+__attribute__((target("sse2")))
+static void lsb1_spread_sse2(unsigned char *carrier, const unsigned char *payload, const size_t payload_size)
+{
+    const __m128i bit_select = _mm_set_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80,
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80);
+
+    size_t payload_index = 0;
+    for (; payload_index + 8 <= payload_size; payload_index += 8)
+    {
+        const __m128i source = _mm_loadl_epi64((const __m128i *)(payload + payload_index));
+        const __m128i pairs = _mm_unpacklo_epi8(source, source);
+        const __m128i quads_low = _mm_unpacklo_epi16(pairs, pairs);
+        const __m128i quads_high = _mm_unpackhi_epi16(pairs, pairs);
+
+        unsigned char *out = carrier + payload_index * STEGOBMP_LSB1_BYTES_PER_PAYLOAD;
+        const __m128i replicated[4] = {
+            _mm_unpacklo_epi32(quads_low, quads_low),
+            _mm_unpackhi_epi32(quads_low, quads_low),
+            _mm_unpacklo_epi32(quads_high, quads_high),
+            _mm_unpackhi_epi32(quads_high, quads_high)
+        };
+        for (int i = 0; i < 4; i++)
+        {
+            __m128i *lane = (__m128i *)(out + 16 * i);
+            _mm_storeu_si128(lane, lsb1_expand_sse2(replicated[i], bit_select, _mm_loadu_si128(lane)));
+        }
+    }
+
+    lsb1_spread_scalar(carrier + payload_index * STEGOBMP_LSB1_BYTES_PER_PAYLOAD, payload + payload_index, payload_size - payload_index);
+}
+
+/* 16 carrier bytes -> 2 payload bytes per step */
+__attribute__((target("sse2")))
+static void lsb1_gather_sse2(unsigned char *payload, const unsigned char *carrier, const size_t payload_size)
+{
+    size_t payload_index = 0;
+    for (; payload_index + 2 <= payload_size; payload_index += 2)
+    {
+        __m128i lane = _mm_loadu_si128((const __m128i *)(carrier + payload_index * STEGOBMP_LSB1_BYTES_PER_PAYLOAD));
+        /* reverse the byte order of each 8-byte group so the first carrier byte becomes bit 7 */
+        lane = _mm_shufflelo_epi16(lane, _MM_SHUFFLE(0, 1, 2, 3));
+        lane = _mm_shufflehi_epi16(lane, _MM_SHUFFLE(0, 1, 2, 3));
+        lane = _mm_or_si128(_mm_slli_epi16(lane, 8), _mm_srli_epi16(lane, 8));
+        const int mask = _mm_movemask_epi8(_mm_slli_epi16(lane, 7));
+        payload[payload_index] = (unsigned char)(mask & 0xFF);
+        payload[payload_index + 1] = (unsigned char)((mask >> 8) & 0xFF);
+    }
+
+    lsb1_gather_scalar(payload + payload_index, carrier + payload_index * STEGOBMP_LSB1_BYTES_PER_PAYLOAD, payload_size - payload_index);
+}
+
+/* 16 payload bytes <-> 32 carrier bytes per step */
+__attribute__((target("sse2")))
+static void lsb4_spread_sse2(unsigned char *carrier, const unsigned char *payload, const size_t payload_size)
+{
+    const __m128i nibble = _mm_set1_epi8(STEGOBMP_LSB4_BIT_MASK_4);
+    const __m128i keep = _mm_set1_epi8((char)STEGOBMP_LSB4_MASK);
+
+    size_t payload_index = 0;
+    for (; payload_index + 16 <= payload_size; payload_index += 16)
+    {
+        const __m128i source = _mm_loadu_si128((const __m128i *)(payload + payload_index));
+        const __m128i high = _mm_and_si128(_mm_srli_epi16(source, STEGOBMP_LSB4_NIBBLE_SIZE_BITS), nibble);
+        const __m128i low = _mm_and_si128(source, nibble);
+
+        __m128i *lane = (__m128i *)(carrier + payload_index * STEGOBMP_LSB4_BYTES_PER_PAYLOAD);
+        _mm_storeu_si128(lane, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(lane), keep), _mm_unpacklo_epi8(high, low)));
+        _mm_storeu_si128(lane + 1, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(lane + 1), keep), _mm_unpackhi_epi8(high, low)));
+    }
+
+    lsb4_spread_scalar(carrier + payload_index * STEGOBMP_LSB4_BYTES_PER_PAYLOAD, payload + payload_index, payload_size - payload_index);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i lsb4_merge_sse2(const __m128i lane)
+{
+    /* each 16-bit word holds (high nibble, low nibble): fold them into its low byte */
+    const __m128i nibbles = _mm_and_si128(lane, _mm_set1_epi8(STEGOBMP_LSB4_BIT_MASK_4));
+    const __m128i merged = _mm_or_si128(_mm_slli_epi16(nibbles, STEGOBMP_LSB4_NIBBLE_SIZE_BITS), _mm_srli_epi16(nibbles, 8));
+    return _mm_and_si128(merged, _mm_set1_epi16(0x00FF));
+}
+
+__attribute__((target("sse2")))
+static void lsb4_gather_sse2(unsigned char *payload, const unsigned char *carrier, const size_t payload_size)
+{
+    size_t payload_index = 0;
+    for (; payload_index + 16 <= payload_size; payload_index += 16)
+    {
+        const __m128i *lane = (const __m128i *)(carrier + payload_index * STEGOBMP_LSB4_BYTES_PER_PAYLOAD);
+        const __m128i first = lsb4_merge_sse2(_mm_loadu_si128(lane));
+        const __m128i second = lsb4_merge_sse2(_mm_loadu_si128(lane + 1));
+        _mm_storeu_si128((__m128i *)(payload + payload_index), _mm_packus_epi16(first, second));
+    }
+
+    lsb4_gather_scalar(payload + payload_index, carrier + payload_index * STEGOBMP_LSB4_BYTES_PER_PAYLOAD, payload_size - payload_index);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i pattern_merge_sse2(const __m128i lane)
+{
+    /* every 32-bit word ends up holding its 4 patterns, first byte on top, in its low byte */
+    const __m128i patterns = _mm_and_si128(_mm_srli_epi16(lane, STEGOBMP_LSBI_PATTERN_SHIFT), _mm_set1_epi8(0x03));
+    const __m128i pairs = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(patterns, _mm_set1_epi16(0x00FF)), 2), _mm_srli_epi16(patterns, 8));
+    return _mm_or_si128(_mm_slli_epi32(_mm_and_si128(pairs, _mm_set1_epi32(0x0000FFFF)), 4), _mm_srli_epi32(pairs, 16));
+}
+
+/* 64 carrier bytes -> 16 plane bytes per step */
+__attribute__((target("sse2")))
+static void pattern_gather_sse2(unsigned char *plane, const unsigned char *carrier, const size_t plane_size)
+{
+    size_t plane_index = 0;
+    for (; plane_index + 16 <= plane_size; plane_index += 16)
+    {
+        const __m128i *lane = (const __m128i *)(carrier + plane_index * STEGOBMP_PATTERNS_PER_PLANE_BYTE);
+        const __m128i low = _mm_packs_epi32(pattern_merge_sse2(_mm_loadu_si128(lane)), pattern_merge_sse2(_mm_loadu_si128(lane + 1)));
+        const __m128i high = _mm_packs_epi32(pattern_merge_sse2(_mm_loadu_si128(lane + 2)), pattern_merge_sse2(_mm_loadu_si128(lane + 3)));
+        _mm_storeu_si128((__m128i *)(plane + plane_index), _mm_packus_epi16(low, high));
+    }
+
+    pattern_gather_scalar(plane + plane_index, carrier + plane_index * STEGOBMP_PATTERNS_PER_PLANE_BYTE, plane_size - plane_index);
+}
+
+__attribute__((target("sse2")))
+static inline void sample_pairs_flush_sse2(StegoPairLanes *lanes, const size_t phase, __m128i *x, __m128i *y, __m128i *same_msbs)
+{
+    unsigned char spill[16];
+    _mm_storeu_si128((__m128i *)spill, *x);
+    stat_lanes_add8(lanes->x[phase], spill, 16);
+    _mm_storeu_si128((__m128i *)spill, *y);
+    stat_lanes_add8(lanes->y[phase], spill, 16);
+    _mm_storeu_si128((__m128i *)spill, *same_msbs);
+    stat_lanes_add8(lanes->same_msbs[phase], spill, 16);
+    *x = _mm_setzero_si128();
+    *y = _mm_setzero_si128();
+    *same_msbs = _mm_setzero_si128();
+}
+
+/* 16 pairs per vector, 48-byte chunks */
+__attribute__((target("sse2")))
+static void sample_pairs_sse2(const unsigned char *pixels, const size_t row_bytes, const size_t pixel_count, const size_t row_count, StegoSamplePairCounts *counts)
+{
+    const size_t lanes_per_vector = 16;
+    const size_t chunk_bytes = lanes_per_vector * STEGOBMP_STAT_CHANNELS;
+    const size_t pair_bytes = stat_pair_bytes(pixel_count);
+    const size_t chunks = pair_bytes / chunk_bytes;
+    /* bytes are unsigned and SSE2 only compares signed ones */
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i msbs = _mm_set1_epi8((char)0xFE);
+
+    StegoPairLanes lanes;
+    memset(&lanes, 0, sizeof(lanes));
+
+    for (size_t row = 0; row < row_count; row++)
+    {
+        const unsigned char *line = pixels + row * row_bytes;
+        for (size_t phase = 0; phase < STEGOBMP_STAT_CHANNELS; phase++)
+        {
+            __m128i x = _mm_setzero_si128();
+            __m128i y = _mm_setzero_si128();
+            __m128i same_msbs = _mm_setzero_si128();
+            size_t pending = 0;
+
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+            {
+                const unsigned char *sample = line + chunk * chunk_bytes + phase * lanes_per_vector;
+                const __m128i u = _mm_loadu_si128((const __m128i *)sample);
+                const __m128i v = _mm_loadu_si128((const __m128i *)(sample + STEGOBMP_STAT_CHANNELS));
+                const __m128i less = _mm_cmpgt_epi8(_mm_xor_si128(v, bias), _mm_xor_si128(u, bias));
+                const __m128i greater = _mm_cmpgt_epi8(_mm_xor_si128(u, bias), _mm_xor_si128(v, bias));
+                const __m128i odd = _mm_cmpeq_epi8(_mm_and_si128(v, one), one);
+
+                /* compare masks are -1, so subtracting them counts */
+                x = _mm_sub_epi8(x, _mm_or_si128(_mm_andnot_si128(odd, less), _mm_and_si128(odd, greater)));
+                y = _mm_sub_epi8(y, _mm_or_si128(_mm_andnot_si128(odd, greater), _mm_and_si128(odd, less)));
+                same_msbs = _mm_sub_epi8(same_msbs, _mm_cmpeq_epi8(_mm_and_si128(u, msbs), _mm_and_si128(v, msbs)));
+
+                if (++pending == STEGOBMP_STAT_FLUSH_INTERVAL)
+                {
+                    sample_pairs_flush_sse2(&lanes, phase, &x, &y, &same_msbs);
+                    pending = 0;
+                }
+            }
+            sample_pairs_flush_sse2(&lanes, phase, &x, &y, &same_msbs);
+        }
+        sample_pairs_bytes(line, chunks * chunk_bytes, pair_bytes, counts);
+    }
+
+    sample_pairs_fold(&lanes, lanes_per_vector, (uint64_t)chunks * row_count, counts);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i rs_absdiff_sse2(const __m128i a, const __m128i b)
+{
+    const __m128i difference = _mm_sub_epi16(a, b);
+    return _mm_max_epi16(difference, _mm_sub_epi16(_mm_setzero_si128(), difference));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i rs_smoothness_sse2(const __m128i a, const __m128i b, const __m128i c, const __m128i d)
+{
+    return _mm_add_epi16(_mm_add_epi16(rs_absdiff_sse2(b, a), rs_absdiff_sse2(c, b)), rs_absdiff_sse2(d, c));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i rs_flip_negative_sse2(const __m128i value, const __m128i one)
+{
+    return _mm_sub_epi16(_mm_xor_si128(_mm_add_epi16(value, one), one), one);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i rs_load_sse2(const unsigned char *samples)
+{
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)samples), _mm_setzero_si128());
+}
+
+__attribute__((target("sse2")))
+static inline void rs_groups_flush_sse2(StegoRsLanes *lanes, const size_t phase, __m128i *regular, __m128i *singular)
+{
+    uint16_t spill[8];
+    for (int rs_case = 0; rs_case < STEGOBMP_RS_CASES; rs_case++)
+    {
+        _mm_storeu_si128((__m128i *)spill, regular[rs_case]);
+        stat_lanes_add16(lanes->regular[phase][rs_case], spill, 8);
+        _mm_storeu_si128((__m128i *)spill, singular[rs_case]);
+        stat_lanes_add16(lanes->singular[phase][rs_case], spill, 8);
+        regular[rs_case] = _mm_setzero_si128();
+        singular[rs_case] = _mm_setzero_si128();
+    }
+}
+
+/* 8 groups per vector, widened to 16 bits since the smoothness reaches 3 * 257; 24-byte chunks */
+__attribute__((target("sse2")))
+static void rs_groups_sse2(const unsigned char *pixels, const size_t row_bytes, const size_t pixel_count, const size_t row_count, StegoRsCounts *counts)
+{
+    const size_t lanes_per_vector = 8;
+    const size_t chunk_bytes = lanes_per_vector * STEGOBMP_STAT_CHANNELS;
+    const size_t group_bytes = stat_group_bytes(pixel_count);
+    const size_t chunks = group_bytes / chunk_bytes;
+    const __m128i one = _mm_set1_epi16(1);
+
+    StegoRsLanes lanes;
+    memset(&lanes, 0, sizeof(lanes));
+
+    for (size_t row = 0; row < row_count; row++)
+    {
+        const unsigned char *line = pixels + row * row_bytes;
+        for (size_t phase = 0; phase < STEGOBMP_STAT_CHANNELS; phase++)
+        {
+            __m128i regular[STEGOBMP_RS_CASES];
+            __m128i singular[STEGOBMP_RS_CASES];
+            for (int rs_case = 0; rs_case < STEGOBMP_RS_CASES; rs_case++)
+                regular[rs_case] = singular[rs_case] = _mm_setzero_si128();
+            size_t pending = 0;
+
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+            {
+                const unsigned char *sample = line + chunk * chunk_bytes + phase * lanes_per_vector;
+                const __m128i a = rs_load_sse2(sample);
+                const __m128i b = rs_load_sse2(sample + STEGOBMP_STAT_CHANNELS);
+                const __m128i c = rs_load_sse2(sample + 2 * STEGOBMP_STAT_CHANNELS);
+                const __m128i d = rs_load_sse2(sample + 3 * STEGOBMP_STAT_CHANNELS);
+                const __m128i a1 = _mm_xor_si128(a, one);
+                const __m128i b1 = _mm_xor_si128(b, one);
+                const __m128i c1 = _mm_xor_si128(c, one);
+                const __m128i d1 = _mm_xor_si128(d, one);
+
+                const __m128i smoothness = rs_smoothness_sse2(a, b, c, d);
+                const __m128i inverted_smoothness = rs_smoothness_sse2(a1, b1, c1, d1);
+                const __m128i after[STEGOBMP_RS_CASES] = {
+                    rs_smoothness_sse2(a, b1, c1, d),
+                    rs_smoothness_sse2(a, rs_flip_negative_sse2(b, one), rs_flip_negative_sse2(c, one), d),
+                    rs_smoothness_sse2(a1, b, c, d1),
+                    rs_smoothness_sse2(a1, rs_flip_negative_sse2(b1, one), rs_flip_negative_sse2(c1, one), d1)
+                };
+                for (int rs_case = 0; rs_case < STEGOBMP_RS_CASES; rs_case++)
+                {
+                    const __m128i before = rs_case < STEGOBMP_RS_POSITIVE_INVERTED ? smoothness : inverted_smoothness;
+                    regular[rs_case] = _mm_sub_epi16(regular[rs_case], _mm_cmpgt_epi16(after[rs_case], before));
+                    singular[rs_case] = _mm_sub_epi16(singular[rs_case], _mm_cmpgt_epi16(before, after[rs_case]));
+                }
+
+                if (++pending == STEGOBMP_STAT_FLUSH_INTERVAL)
+                {
+                    rs_groups_flush_sse2(&lanes, phase, regular, singular);
+                    pending = 0;
+                }
+            }
+            rs_groups_flush_sse2(&lanes, phase, regular, singular);
+        }
+        rs_groups_bytes(line, chunks * chunk_bytes, group_bytes, counts);
+    }
+
+    rs_groups_fold(&lanes, lanes_per_vector, (uint64_t)chunks * row_count, counts);
+}
+
+static const StegoKernelTable sse2_table = {
+    STEGOBMP_KERNEL_SSE2,
+    lsb1_spread_sse2,
+    lsb1_gather_sse2,
+    lsb4_spread_sse2,
+    lsb4_gather_sse2,
+    pattern_gather_sse2,
+    /* LSBI needs byte shuffles, which SSE2 lacks */
+    lsbi_costs_scalar,
+    lsbi_apply_scalar,
+    lsbi_decode_scalar,
+    sample_pairs_sse2,
+    rs_groups_sse2
+};
+
+/* ---------------------------------------------------------------------- */
+/* AVX2 kernels                                                             */
+/* ---------------------------------------------------------------------- */
+
+/* 4 payload bytes <-> 32 carrier bytes per step */
+__attribute__((target("avx2")))
+static void lsb1_spread_avx2(unsigned char *carrier, const unsigned char *payload, const size_t payload_size)
+{
+    const __m256i bit_select = _mm256_set1_epi64x((long long)0x0102040810204080ULL);
+    const __m256i replicate = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i one = _mm256_set1_epi8(STEGOBMP_LSB1_BIT_MASK_1);
+    const __m256i keep = _mm256_set1_epi8((char)STEGOBMP_LSB1_MASK);
+
+    size_t payload_index = 0;
+    for (; payload_index + 4 <= payload_size; payload_index += 4)
+    {
+        int32_t word;
+        memcpy(&word, payload + payload_index, sizeof(word));
+        const __m256i replicated = _mm256_shuffle_epi8(_mm256_set1_epi32(word), replicate);
+        const __m256i bits = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(replicated, bit_select), bit_select), one);
+
+        __m256i *lane = (__m256i *)(carrier + payload_index * STEGOBMP_LSB1_BYTES_PER_PAYLOAD);
+        _mm256_storeu_si256(lane, _mm256_or_si256(_mm256_and_si256(_mm256_loadu_si256(lane), keep), bits));
+    }
+
+    lsb1_spread_scalar(carrier + payload_index * STEGOBMP_LSB1_BYTES_PER_PAYLOAD, payload + payload_index, payload_size - payload_index);
+}
+
+__attribute__((target("avx2")))
+static void lsb1_gather_avx2(unsigned char *payload, const unsigned char *carrier, const size_t payload_size)
+{
+    const __m256i reverse = _mm256_setr_epi8(
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+
+    size_t payload_index = 0;
+    for (; payload_index + 4 <= payload_size; payload_index += 4)
+    {
+        const __m256i lane = _mm256_loadu_si256((const __m256i *)(carrier + payload_index * STEGOBMP_LSB1_BYTES_PER_PAYLOAD));
+        const uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(_mm256_shuffle_epi8(lane, reverse), 7));
+        payload[payload_index] = (unsigned char)(mask & 0xFF);
+        payload[payload_index + 1] = (unsigned char)((mask >> 8) & 0xFF);
+        payload[payload_index + 2] = (unsigned char)((mask >> 16) & 0xFF);
+        payload[payload_index + 3] = (unsigned char)((mask >> 24) & 0xFF);
+    }
+
+    lsb1_gather_sse2(payload + payload_index, carrier + payload_index * STEGOBMP_LSB1_BYTES_PER_PAYLOAD, payload_size - payload_index);
+}
+
+/* 32 payload bytes <-> 64 carrier bytes per step */
+__attribute__((target("avx2")))
+static void lsb4_spread_avx2(unsigned char *carrier, const unsigned char *payload, const size_t payload_size)
+{
+    const __m256i nibble = _mm256_set1_epi8(STEGOBMP_LSB4_BIT_MASK_4);
+    const __m256i keep = _mm256_set1_epi8((char)STEGOBMP_LSB4_MASK);
+
+    size_t payload_index = 0;
+    for (; payload_index + 32 <= payload_size; payload_index += 32)
+    {
+        const __m256i source = _mm256_loadu_si256((const __m256i *)(payload + payload_index));
+        const __m256i high = _mm256_and_si256(_mm256_srli_epi16(source, STEGOBMP_LSB4_NIBBLE_SIZE_BITS), nibble);
+        const __m256i low = _mm256_and_si256(source, nibble);
+
+        /* unpack works per 128-bit lane, so put the halves back in payload order */
+        const __m256i interleaved_low = _mm256_unpacklo_epi8(high, low);
+        const __m256i interleaved_high = _mm256_unpackhi_epi8(high, low);
+        const __m256i first = _mm256_permute2x128_si256(interleaved_low, interleaved_high, 0x20);
+        const __m256i second = _mm256_permute2x128_si256(interleaved_low, interleaved_high, 0x31);
+
+        __m256i *lane = (__m256i *)(carrier + payload_index * STEGOBMP_LSB4_BYTES_PER_PAYLOAD);
+        _mm256_storeu_si256(lane, _mm256_or_si256(_mm256_and_si256(_mm256_loadu_si256(lane), keep), first));
+        _mm256_storeu_si256(lane + 1, _mm256_or_si256(_mm256_and_si256(_mm256_loadu_si256(lane + 1), keep), second));
+    }
+
+    lsb4_spread_sse2(carrier + payload_index * STEGOBMP_LSB4_BYTES_PER_PAYLOAD, payload + payload_index, payload_size - payload_index);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i lsb4_merge_avx2(const __m256i lane)
+{
+    const __m256i nibbles = _mm256_and_si256(lane, _mm256_set1_epi8(STEGOBMP_LSB4_BIT_MASK_4));
+    const __m256i merged = _mm256_or_si256(_mm256_slli_epi16(nibbles, STEGOBMP_LSB4_NIBBLE_SIZE_BITS), _mm256_srli_epi16(nibbles, 8));
+    return _mm256_and_si256(merged, _mm256_set1_epi16(0x00FF));
+}
+
+__attribute__((target("avx2")))
+static void lsb4_gather_avx2(unsigned char *payload, const unsigned char *carrier, const size_t payload_size)
+{
+    size_t payload_index = 0;
+    for (; payload_index + 32 <= payload_size; payload_index += 32)
+    {
+        const __m256i *lane = (const __m256i *)(carrier + payload_index * STEGOBMP_LSB4_BYTES_PER_PAYLOAD);
+        const __m256i packed = _mm256_packus_epi16(lsb4_merge_avx2(_mm256_loadu_si256(lane)), lsb4_merge_avx2(_mm256_loadu_si256(lane + 1)));
+        _mm256_storeu_si256((__m256i *)(payload + payload_index), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+
+    lsb4_gather_sse2(payload + payload_index, carrier + payload_index * STEGOBMP_LSB4_BYTES_PER_PAYLOAD, payload_size - payload_index);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i pattern_merge_avx2(const __m256i lane)
+{
+    const __m256i patterns = _mm256_and_si256(_mm256_srli_epi16(lane, STEGOBMP_LSBI_PATTERN_SHIFT), _mm256_set1_epi8(0x03));
+    const __m256i pairs = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(patterns, _mm256_set1_epi16(0x00FF)), 2), _mm256_srli_epi16(patterns, 8));
+    return _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(pairs, _mm256_set1_epi32(0x0000FFFF)), 4), _mm256_srli_epi32(pairs, 16));
+}
+
+/* 128 carrier bytes -> 32 plane bytes per step */
+__attribute__((target("avx2")))
+static void pattern_gather_avx2(unsigned char *plane, const unsigned char *carrier, const size_t plane_size)
+{
+    /* the packs interleave the 128-bit halves: put the 4-byte groups back in carrier order */
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    size_t plane_index = 0;
+    for (; plane_index + 32 <= plane_size; plane_index += 32)
+    {
+        const __m256i *lane = (const __m256i *)(carrier + plane_index * STEGOBMP_PATTERNS_PER_PLANE_BYTE);
+        const __m256i low = _mm256_packs_epi32(pattern_merge_avx2(_mm256_loadu_si256(lane)), pattern_merge_avx2(_mm256_loadu_si256(lane + 1)));
+        const __m256i high = _mm256_packs_epi32(pattern_merge_avx2(_mm256_loadu_si256(lane + 2)), pattern_merge_avx2(_mm256_loadu_si256(lane + 3)));
+        _mm256_storeu_si256((__m256i *)(plane + plane_index), _mm256_permutevar8x32_epi32(_mm256_packus_epi16(low, high), order));
+    }
+
+    pattern_gather_sse2(plane + plane_index, carrier + plane_index * STEGOBMP_PATTERNS_PER_PLANE_BYTE, plane_size - plane_index);
+}
+
+/* LSBI works on 48-byte periods (4 payload bytes): three 128-bit vectors whose
+ * channel layout is described by lsbi_lanes. 256-bit shuffles cannot cross
+ * lanes, so these kernels stay on VEX-encoded 128-bit operations. */
+static struct {
+    unsigned char byte_select[3][16]; /* payload byte feeding each carrier lane, 0x80 on red lanes */
+    unsigned char bit_select[3][16];  /* payload bit feeding each carrier lane, 0 on red lanes */
+    unsigned char valid[3][16];       /* 0xFF on payload lanes, 0x00 on red lanes */
+    unsigned char compact[4][16];     /* gathers the decoded lanes back in MSB-first order */
+} lsbi_lanes;
+
+static pthread_once_t lsbi_lanes_once = PTHREAD_ONCE_INIT;
+
+static void lsbi_lanes_init(void)
+{
+    memset(&lsbi_lanes, 0, sizeof(lsbi_lanes));
+    memset(lsbi_lanes.byte_select, 0x80, sizeof(lsbi_lanes.byte_select));
+    memset(lsbi_lanes.compact, 0x80, sizeof(lsbi_lanes.compact));
+
+    for (int byte = 0; byte < 4; byte++)
+    {
+        for (int b = 0; b < 8; b++)
+        {
+            const int t = byte * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD + lsbi_bit_offsets[b];
+            lsbi_lanes.byte_select[t / 16][t % 16] = (unsigned char)byte;
+            lsbi_lanes.bit_select[t / 16][t % 16] = (unsigned char)(0x80 >> b);
+            lsbi_lanes.valid[t / 16][t % 16] = 0xFF;
+
+            /* output lane holding this bit once movemask packs it: bytes 0-1 come from
+             * vectors 0/1 (compact 0/1), bytes 2-3 from vectors 1/2 (compact 2/3) */
+            const int out_lane = (byte % 2) * 8 + (7 - b);
+            const int compact = (byte / 2) * 2 + (t / 16) - (byte / 2);
+            lsbi_lanes.compact[compact][out_lane] = (unsigned char)(t % 16);
+        }
+    }
+}
+
+__attribute__((target("avx2,popcnt")))
+static inline __m128i lsbi_desired_bits(const __m128i payload_word, const int r)
+{
+    const __m128i bit_select = _mm_loadu_si128((const __m128i *)lsbi_lanes.bit_select[r]);
+    const __m128i selected = _mm_and_si128(_mm_shuffle_epi8(payload_word, _mm_loadu_si128((const __m128i *)lsbi_lanes.byte_select[r])), bit_select);
+    return _mm_and_si128(_mm_cmpeq_epi8(selected, bit_select), _mm_set1_epi8(1));
+}
+
+__attribute__((target("avx2,popcnt")))
+static inline __m128i lsbi_flip_table(const int *must_change)
+{
+    /* indexed directly by (pixel & 0x06), so patterns land on lanes 0, 2, 4 and 6 */
+    return _mm_setr_epi8((char)(must_change[0] & 1), 0, (char)(must_change[1] & 1), 0,
+                         (char)(must_change[2] & 1), 0, (char)(must_change[3] & 1), 0,
+                         0, 0, 0, 0, 0, 0, 0, 0);
+}
+
+__attribute__((target("avx2,popcnt")))
+static void lsbi_costs_avx2(const unsigned char *block, const unsigned char *payload, const size_t payload_size, uint64_t *cost0, uint64_t *cost1)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i pattern_mask = _mm_set1_epi8(STEGOBMP_LSBI_PATTERN_MASK);
+    uint64_t count[4] = {0, 0, 0, 0};
+    uint64_t mismatch[4] = {0, 0, 0, 0};
+
+    size_t payload_index = 0;
+    for (; payload_index + 4 <= payload_size; payload_index += 4)
+    {
+        int32_t word;
+        memcpy(&word, payload + payload_index, sizeof(word));
+        const __m128i payload_word = _mm_cvtsi32_si128(word);
+        const unsigned char *period = block + payload_index * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD;
+
+        for (int r = 0; r < 3; r++)
+        {
+            const __m128i pix = _mm_loadu_si128((const __m128i *)(period + 16 * r));
+            const __m128i valid = _mm_loadu_si128((const __m128i *)lsbi_lanes.valid[r]);
+            const __m128i differs = _mm_cmpeq_epi8(_mm_xor_si128(_mm_and_si128(pix, one), lsbi_desired_bits(payload_word, r)), one);
+            const __m128i pattern = _mm_and_si128(pix, pattern_mask);
+
+            for (int p = 0; p < 4; p++)
+            {
+                const __m128i selected = _mm_and_si128(_mm_cmpeq_epi8(pattern, _mm_set1_epi8((char)(p << STEGOBMP_LSBI_PATTERN_SHIFT))), valid);
+                count[p] += (uint64_t)__builtin_popcount((unsigned)_mm_movemask_epi8(selected));
+                mismatch[p] += (uint64_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_and_si128(selected, differs)));
+            }
+        }
+    }
+
+    /* a channel either already matches the bit or its inverse */
+    for (int p = 0; p < 4; p++)
+    {
+        cost0[p] += mismatch[p];
+        cost1[p] += count[p] - mismatch[p];
+    }
+
+    lsbi_costs_scalar(block + payload_index * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD, payload + payload_index, payload_size - payload_index, cost0, cost1);
+}
+
+__attribute__((target("avx2,popcnt")))
+static void lsbi_apply_avx2(unsigned char *block, const unsigned char *payload, const size_t payload_size, const int *must_change)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i pattern_mask = _mm_set1_epi8(STEGOBMP_LSBI_PATTERN_MASK);
+    const __m128i flip = lsbi_flip_table(must_change);
+
+    size_t payload_index = 0;
+    for (; payload_index + 4 <= payload_size; payload_index += 4)
+    {
+        int32_t word;
+        memcpy(&word, payload + payload_index, sizeof(word));
+        const __m128i payload_word = _mm_cvtsi32_si128(word);
+        unsigned char *period = block + payload_index * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD;
+
+        for (int r = 0; r < 3; r++)
+        {
+            __m128i *lane = (__m128i *)(period + 16 * r);
+            const __m128i pix = _mm_loadu_si128(lane);
+            const __m128i writable = _mm_and_si128(_mm_loadu_si128((const __m128i *)lsbi_lanes.valid[r]), one);
+            const __m128i bit = _mm_xor_si128(lsbi_desired_bits(payload_word, r), _mm_shuffle_epi8(flip, _mm_and_si128(pix, pattern_mask)));
+            _mm_storeu_si128(lane, _mm_or_si128(_mm_andnot_si128(writable, pix), _mm_and_si128(bit, writable)));
+        }
+    }
+
+    lsbi_apply_scalar(block + payload_index * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD, payload + payload_index, payload_size - payload_index, must_change);
+}
+
+__attribute__((target("avx2,popcnt")))
+static void lsbi_decode_avx2(unsigned char *payload, const unsigned char *block, const size_t payload_size, const int *must_change)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i pattern_mask = _mm_set1_epi8(STEGOBMP_LSBI_PATTERN_MASK);
+    const __m128i flip = lsbi_flip_table(must_change);
+
+    size_t payload_index = 0;
+    for (; payload_index + 4 <= payload_size; payload_index += 4)
+    {
+        const unsigned char *period = block + payload_index * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD;
+        __m128i bits[3];
+        for (int r = 0; r < 3; r++)
+        {
+            const __m128i pix = _mm_loadu_si128((const __m128i *)(period + 16 * r));
+            bits[r] = _mm_xor_si128(_mm_and_si128(pix, one), _mm_shuffle_epi8(flip, _mm_and_si128(pix, pattern_mask)));
+        }
+
+        const __m128i first = _mm_or_si128(_mm_shuffle_epi8(bits[0], _mm_loadu_si128((const __m128i *)lsbi_lanes.compact[0])),
+                                           _mm_shuffle_epi8(bits[1], _mm_loadu_si128((const __m128i *)lsbi_lanes.compact[1])));
+        const __m128i second = _mm_or_si128(_mm_shuffle_epi8(bits[1], _mm_loadu_si128((const __m128i *)lsbi_lanes.compact[2])),
+                                            _mm_shuffle_epi8(bits[2], _mm_loadu_si128((const __m128i *)lsbi_lanes.compact[3])));
+        const int first_mask = _mm_movemask_epi8(_mm_slli_epi16(first, 7));
+        const int second_mask = _mm_movemask_epi8(_mm_slli_epi16(second, 7));
+        payload[payload_index] = (unsigned char)(first_mask & 0xFF);
+        payload[payload_index + 1] = (unsigned char)((first_mask >> 8) & 0xFF);
+        payload[payload_index + 2] = (unsigned char)(second_mask & 0xFF);
+        payload[payload_index + 3] = (unsigned char)((second_mask >> 8) & 0xFF);
+    }
+
+    lsbi_decode_scalar(payload + payload_index, block + payload_index * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD, payload_size - payload_index, must_change);
+}
+
+__attribute__((target("avx2")))
+static inline void sample_pairs_flush_avx2(StegoPairLanes *lanes, const size_t phase, __m256i *x, __m256i *y, __m256i *same_msbs)
+{
+    unsigned char spill[32];
+    _mm256_storeu_si256((__m256i *)spill, *x);
+    stat_lanes_add8(lanes->x[phase], spill, 32);
+    _mm256_storeu_si256((__m256i *)spill, *y);
+    stat_lanes_add8(lanes->y[phase], spill, 32);
+    _mm256_storeu_si256((__m256i *)spill, *same_msbs);
+    stat_lanes_add8(lanes->same_msbs[phase], spill, 32);
+    *x = _mm256_setzero_si256();
+    *y = _mm256_setzero_si256();
+    *same_msbs = _mm256_setzero_si256();
+}
+
+/* 32 pairs per vector, 96-byte chunks */
+__attribute__((target("avx2")))
+static void sample_pairs_avx2(const unsigned char *pixels, const size_t row_bytes, const size_t pixel_count, const size_t row_count, StegoSamplePairCounts *counts)
+{
+    const size_t lanes_per_vector = 32;
+    const size_t chunk_bytes = lanes_per_vector * STEGOBMP_STAT_CHANNELS;
+    const size_t pair_bytes = stat_pair_bytes(pixel_count);
+    const size_t chunks = pair_bytes / chunk_bytes;
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i msbs = _mm256_set1_epi8((char)0xFE);
+
+    StegoPairLanes lanes;
+    memset(&lanes, 0, sizeof(lanes));
+
+    for (size_t row = 0; row < row_count; row++)
+    {
+        const unsigned char *line = pixels + row * row_bytes;
+        for (size_t phase = 0; phase < STEGOBMP_STAT_CHANNELS; phase++)
+        {
+            __m256i x = _mm256_setzero_si256();
+            __m256i y = _mm256_setzero_si256();
+            __m256i same_msbs = _mm256_setzero_si256();
+            size_t pending = 0;
+
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+            {
+                const unsigned char *sample = line + chunk * chunk_bytes + phase * lanes_per_vector;
+                const __m256i u = _mm256_loadu_si256((const __m256i *)sample);
+                const __m256i v = _mm256_loadu_si256((const __m256i *)(sample + STEGOBMP_STAT_CHANNELS));
+                const __m256i less = _mm256_cmpgt_epi8(_mm256_xor_si256(v, bias), _mm256_xor_si256(u, bias));
+                const __m256i greater = _mm256_cmpgt_epi8(_mm256_xor_si256(u, bias), _mm256_xor_si256(v, bias));
+                const __m256i odd = _mm256_cmpeq_epi8(_mm256_and_si256(v, one), one);
+
+                x = _mm256_sub_epi8(x, _mm256_or_si256(_mm256_andnot_si256(odd, less), _mm256_and_si256(odd, greater)));
+                y = _mm256_sub_epi8(y, _mm256_or_si256(_mm256_andnot_si256(odd, greater), _mm256_and_si256(odd, less)));
+                same_msbs = _mm256_sub_epi8(same_msbs, _mm256_cmpeq_epi8(_mm256_and_si256(u, msbs), _mm256_and_si256(v, msbs)));
+
+                if (++pending == STEGOBMP_STAT_FLUSH_INTERVAL)
+                {
+                    sample_pairs_flush_avx2(&lanes, phase, &x, &y, &same_msbs);
+                    pending = 0;
+                }
+            }
+            sample_pairs_flush_avx2(&lanes, phase, &x, &y, &same_msbs);
+        }
+        sample_pairs_bytes(line, chunks * chunk_bytes, pair_bytes, counts);
+    }
+
+    sample_pairs_fold(&lanes, lanes_per_vector, (uint64_t)chunks * row_count, counts);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rs_smoothness_avx2(const __m256i a, const __m256i b, const __m256i c, const __m256i d)
+{
+    return _mm256_add_epi16(_mm256_add_epi16(_mm256_abs_epi16(_mm256_sub_epi16(b, a)), _mm256_abs_epi16(_mm256_sub_epi16(c, b))),
+                            _mm256_abs_epi16(_mm256_sub_epi16(d, c)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rs_flip_negative_avx2(const __m256i value, const __m256i one)
+{
+    return _mm256_sub_epi16(_mm256_xor_si256(_mm256_add_epi16(value, one), one), one);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rs_load_avx2(const unsigned char *samples)
+{
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)samples));
+}
+
+__attribute__((target("avx2")))
+static inline void rs_groups_flush_avx2(StegoRsLanes *lanes, const size_t phase, __m256i *regular, __m256i *singular)
+{
+    uint16_t spill[16];
+    for (int rs_case = 0; rs_case < STEGOBMP_RS_CASES; rs_case++)
+    {
+        _mm256_storeu_si256((__m256i *)spill, regular[rs_case]);
+        stat_lanes_add16(lanes->regular[phase][rs_case], spill, 16);
+        _mm256_storeu_si256((__m256i *)spill, singular[rs_case]);
+        stat_lanes_add16(lanes->singular[phase][rs_case], spill, 16);
+        regular[rs_case] = _mm256_setzero_si256();
+        singular[rs_case] = _mm256_setzero_si256();
+    }
+}
+
+/* 16 groups per vector, 48-byte chunks */
+__attribute__((target("avx2")))
+static void rs_groups_avx2(const unsigned char *pixels, const size_t row_bytes, const size_t pixel_count, const size_t row_count, StegoRsCounts *counts)
+{
+    const size_t lanes_per_vector = 16;
+    const size_t chunk_bytes = lanes_per_vector * STEGOBMP_STAT_CHANNELS;
+    const size_t group_bytes = stat_group_bytes(pixel_count);
+    const size_t chunks = group_bytes / chunk_bytes;
+    const __m256i one = _mm256_set1_epi16(1);
+
+    StegoRsLanes lanes;
+    memset(&lanes, 0, sizeof(lanes));
+
+    for (size_t row = 0; row < row_count; row++)
+    {
+        const unsigned char *line = pixels + row * row_bytes;
+        for (size_t phase = 0; phase < STEGOBMP_STAT_CHANNELS; phase++)
+        {
+            __m256i regular[STEGOBMP_RS_CASES];
+            __m256i singular[STEGOBMP_RS_CASES];
+            for (int rs_case = 0; rs_case < STEGOBMP_RS_CASES; rs_case++)
+                regular[rs_case] = singular[rs_case] = _mm256_setzero_si256();
+            size_t pending = 0;
+
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+            {
+                const unsigned char *sample = line + chunk * chunk_bytes + phase * lanes_per_vector;
+                const __m256i a = rs_load_avx2(sample);
+                const __m256i b = rs_load_avx2(sample + STEGOBMP_STAT_CHANNELS);
+                const __m256i c = rs_load_avx2(sample + 2 * STEGOBMP_STAT_CHANNELS);
+                const __m256i d = rs_load_avx2(sample + 3 * STEGOBMP_STAT_CHANNELS);
+                const __m256i a1 = _mm256_xor_si256(a, one);
+                const __m256i b1 = _mm256_xor_si256(b, one);
+                const __m256i c1 = _mm256_xor_si256(c, one);
+                const __m256i d1 = _mm256_xor_si256(d, one);
+
+                const __m256i smoothness = rs_smoothness_avx2(a, b, c, d);
+                const __m256i inverted_smoothness = rs_smoothness_avx2(a1, b1, c1, d1);
+                const __m256i after[STEGOBMP_RS_CASES] = {
+                    rs_smoothness_avx2(a, b1, c1, d),
+                    rs_smoothness_avx2(a, rs_flip_negative_avx2(b, one), rs_flip_negative_avx2(c, one), d),
+                    rs_smoothness_avx2(a1, b, c, d1),
+                    rs_smoothness_avx2(a1, rs_flip_negative_avx2(b1, one), rs_flip_negative_avx2(c1, one), d1)
+                };
+                for (int rs_case = 0; rs_case < STEGOBMP_RS_CASES; rs_case++)
+                {
+                    const __m256i before = rs_case < STEGOBMP_RS_POSITIVE_INVERTED ? smoothness : inverted_smoothness;
+                    regular[rs_case] = _mm256_sub_epi16(regular[rs_case], _mm256_cmpgt_epi16(after[rs_case], before));
+                    singular[rs_case] = _mm256_sub_epi16(singular[rs_case], _mm256_cmpgt_epi16(before, after[rs_case]));
+                }
+
+                if (++pending == STEGOBMP_STAT_FLUSH_INTERVAL)
+                {
+                    rs_groups_flush_avx2(&lanes, phase, regular, singular);
+                    pending = 0;
+                }
+            }
+            rs_groups_flush_avx2(&lanes, phase, regular, singular);
+        }
+        rs_groups_bytes(line, chunks * chunk_bytes, group_bytes, counts);
+    }
+
+    rs_groups_fold(&lanes, lanes_per_vector, (uint64_t)chunks * row_count, counts);
+}
+
+static const StegoKernelTable avx2_table = {
+    STEGOBMP_KERNEL_AVX2,
+    lsb1_spread_avx2,
+    lsb1_gather_avx2,
+    lsb4_spread_avx2,
+    lsb4_gather_avx2,
+    pattern_gather_avx2,
+    lsbi_costs_avx2,
+    lsbi_apply_avx2,
+    lsbi_decode_avx2,
+    sample_pairs_avx2,
+    rs_groups_avx2
+};
+
+/* ---------------------------------------------------------------------- */
+/* SSE4.2 CRC32C                                                            */
+/* ---------------------------------------------------------------------- */
+
+/* One crc32 instruction per 8 bytes once the pointer is aligned */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *data, size_t length)
+{
+    while (length > 0 && ((uintptr_t)data & 7) != 0)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+        length--;
+    }
+#if defined(__x86_64__)
+    uint64_t wide = crc;
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = (uint32_t)wide;
+#endif
+    for (; length >= 4; data += 4, length -= 4)
+    {
+        uint32_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+    while (length--)
+        crc = _mm_crc32_u8(crc, *data++);
+    return crc;
+}
+
+#endif /* STEGOBMP_KERNELS_X86 */
+
+/* ---------------------------------------------------------------------- */
+/* Runtime dispatch                                                         */
+/* ---------------------------------------------------------------------- */
+
+static const StegoKernelTable *active_table = &scalar_table;
+static stego_crc32c_fn active_crc32c = crc32c_scalar;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static uint32_t self_check_next(uint32_t *state)
+{
+    /* xorshift32, deterministic so a failing check is reproducible */
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void self_check_fill(unsigned char *buffer, const size_t size, uint32_t *state)
+{
+    for (size_t i = 0; i < size; i++)
+        buffer[i] = (unsigned char)(self_check_next(state) >> 24);
+}
+
+typedef void (*stego_kernel_fn)(unsigned char *, const unsigned char *, size_t);
+
+static int kernel_pair_matches(const stego_kernel_fn reference_spread, const stego_kernel_fn spread, const stego_kernel_fn reference_gather, const stego_kernel_fn gather, const size_t carrier_bytes_per_payload)
+{
+    static const size_t payload_sizes[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 64, 67, STEGOBMP_SELF_CHECK_MAX_PAYLOAD};
+
+    unsigned char payload[STEGOBMP_SELF_CHECK_MAX_PAYLOAD];
+    unsigned char expected[STEGOBMP_SELF_CHECK_MAX_PAYLOAD * STEGOBMP_LSB1_BYTES_PER_PAYLOAD + STEGOBMP_SELF_CHECK_MAX_OFFSET];
+    unsigned char actual[sizeof(expected)];
+    uint32_t state = 0x9E3779B9u;
+
+    for (size_t s = 0; s < sizeof(payload_sizes) / sizeof(payload_sizes[0]); s++)
+    {
+        const size_t payload_size = payload_sizes[s];
+        const size_t carrier_size = payload_size * carrier_bytes_per_payload;
+
+        for (size_t offset = 0; offset <= STEGOBMP_SELF_CHECK_MAX_OFFSET; offset++)
+        {
+            self_check_fill(payload, payload_size, &state);
+            self_check_fill(expected, sizeof(expected), &state);
+            memcpy(actual, expected, sizeof(expected));
+
+            reference_spread(expected + offset, payload, payload_size);
+            spread(actual + offset, payload, payload_size);
+            if (memcmp(expected, actual, sizeof(expected)) != 0)
+                return 0;
+
+            unsigned char gathered_expected[STEGOBMP_SELF_CHECK_MAX_PAYLOAD];
+            unsigned char gathered_actual[STEGOBMP_SELF_CHECK_MAX_PAYLOAD];
+            self_check_fill(actual, carrier_size + offset, &state);
+            reference_gather(gathered_expected, actual + offset, payload_size);
+            gather(gathered_actual, actual + offset, payload_size);
+            if (memcmp(gathered_expected, gathered_actual, payload_size) != 0)
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int pattern_gather_matches(const StegoKernelTable *table)
+{
+    unsigned char carrier[STEGOBMP_SELF_CHECK_MAX_PAYLOAD * STEGOBMP_PATTERNS_PER_PLANE_BYTE + STEGOBMP_SELF_CHECK_MAX_OFFSET];
+    unsigned char expected[STEGOBMP_SELF_CHECK_MAX_PAYLOAD];
+    unsigned char actual[STEGOBMP_SELF_CHECK_MAX_PAYLOAD];
+    uint32_t state = 0x6A09E667u;
+
+    for (size_t plane_size = 0; plane_size <= STEGOBMP_SELF_CHECK_MAX_PAYLOAD; plane_size += plane_size < 40 ? 1 : 31)
+    {
+        for (size_t offset = 0; offset <= STEGOBMP_SELF_CHECK_MAX_OFFSET; offset++)
+        {
+            self_check_fill(carrier, sizeof(carrier), &state);
+            pattern_gather_scalar(expected, carrier + offset, plane_size);
+            table->pattern_gather(actual, carrier + offset, plane_size);
+            if (memcmp(expected, actual, plane_size) != 0)
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int lsbi_kernels_match(const StegoKernelTable *table)
+{
+    static const size_t payload_sizes[] = {0, 1, 3, 4, 5, 8, 11, 64, 67, STEGOBMP_SELF_CHECK_MAX_PAYLOAD};
+
+    unsigned char payload[STEGOBMP_SELF_CHECK_MAX_PAYLOAD];
+    unsigned char expected[STEGOBMP_SELF_CHECK_MAX_PAYLOAD * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD];
+    unsigned char actual[sizeof(expected)];
+    unsigned char decoded_expected[STEGOBMP_SELF_CHECK_MAX_PAYLOAD];
+    unsigned char decoded_actual[STEGOBMP_SELF_CHECK_MAX_PAYLOAD];
+    uint32_t state = 0x2545F491u;
+
+    for (size_t s = 0; s < sizeof(payload_sizes) / sizeof(payload_sizes[0]); s++)
+    {
+        const size_t payload_size = payload_sizes[s];
+
+        for (int mask = 0; mask < 16; mask += 5)
+        {
+            const int must_change[4] = {mask & 1, (mask >> 1) & 1, (mask >> 2) & 1, (mask >> 3) & 1};
+
+            self_check_fill(payload, payload_size, &state);
+            self_check_fill(expected, sizeof(expected), &state);
+            memcpy(actual, expected, sizeof(expected));
+
+            uint64_t cost0_expected[4] = {0, 0, 0, 0}, cost1_expected[4] = {0, 0, 0, 0};
+            uint64_t cost0_actual[4] = {0, 0, 0, 0}, cost1_actual[4] = {0, 0, 0, 0};
+            lsbi_costs_scalar(expected, payload, payload_size, cost0_expected, cost1_expected);
+            table->lsbi_costs(actual, payload, payload_size, cost0_actual, cost1_actual);
+            if (memcmp(cost0_expected, cost0_actual, sizeof(cost0_expected)) != 0 ||
+                memcmp(cost1_expected, cost1_actual, sizeof(cost1_expected)) != 0)
+                return 0;
+
+            lsbi_apply_scalar(expected, payload, payload_size, must_change);
+            table->lsbi_apply(actual, payload, payload_size, must_change);
+            if (memcmp(expected, actual, sizeof(expected)) != 0)
+                return 0;
+
+            self_check_fill(actual, sizeof(actual), &state);
+            lsbi_decode_scalar(decoded_expected, actual, payload_size, must_change);
+            table->lsbi_decode(decoded_actual, actual, payload_size, must_change);
+            if (memcmp(decoded_expected, decoded_actual, payload_size) != 0)
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Rows of several widths around the chunk sizes, plus a tall image that crosses the lane counter spills */
+static int stat_kernels_match(const StegoKernelTable *table)
+{
+    static const size_t widths[] = {1, 2, 3, 4, 5, 8, 11, 16, 17, 19, 33, 35, 49, 67, 97, 131};
+    const size_t width_count = sizeof(widths) / sizeof(widths[0]);
+
+    unsigned char image[STEGOBMP_SELF_CHECK_STAT_ROWS * STEGOBMP_SELF_CHECK_STAT_ROW_BYTES];
+    uint32_t state = 0x51ED270Bu;
+
+    for (size_t w = 0; w <= width_count; w++)
+    {
+        const size_t pixel_count = w < width_count ? widths[w] : STEGOBMP_SELF_CHECK_STAT_WIDTH;
+        const size_t row_count = w < width_count ? 3 : STEGOBMP_SELF_CHECK_STAT_ROWS;
+        const size_t row_bytes = (pixel_count * STEGOBMP_STAT_CHANNELS + 3) & ~(size_t)3;
+
+        for (int narrow = 0; narrow < 2; narrow++)
+        {
+            self_check_fill(image, row_bytes * row_count, &state);
+            /* a narrow value range makes ties, equal MSBs and flips past 0/255 common */
+            if (narrow)
+                for (size_t i = 0; i < row_bytes * row_count; i++)
+                    image[i] = (unsigned char)((i & 1 ? 0 : 252) + (image[i] & 3));
+
+            StegoSamplePairCounts pairs_expected[STEGOBMP_STAT_CHANNELS], pairs_actual[STEGOBMP_STAT_CHANNELS];
+            memset(pairs_expected, 0, sizeof(pairs_expected));
+            memset(pairs_actual, 0, sizeof(pairs_actual));
+            sample_pairs_scalar(image, row_bytes, pixel_count, row_count, pairs_expected);
+            table->sample_pairs(image, row_bytes, pixel_count, row_count, pairs_actual);
+            if (memcmp(pairs_expected, pairs_actual, sizeof(pairs_expected)) != 0)
+                return 0;
+
+            StegoRsCounts rs_expected[STEGOBMP_STAT_CHANNELS], rs_actual[STEGOBMP_STAT_CHANNELS];
+            memset(rs_expected, 0, sizeof(rs_expected));
+            memset(rs_actual, 0, sizeof(rs_actual));
+            rs_groups_scalar(image, row_bytes, pixel_count, row_count, rs_expected);
+            table->rs_groups(image, row_bytes, pixel_count, row_count, rs_actual);
+            if (memcmp(rs_expected, rs_actual, sizeof(rs_expected)) != 0)
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int kernels_match_scalar(const StegoKernelTable *table)
+{
+    return kernel_pair_matches(scalar_table.lsb1_spread, table->lsb1_spread, scalar_table.lsb1_gather, table->lsb1_gather, STEGOBMP_LSB1_BYTES_PER_PAYLOAD) &&
+           kernel_pair_matches(scalar_table.lsb4_spread, table->lsb4_spread, scalar_table.lsb4_gather, table->lsb4_gather, STEGOBMP_LSB4_BYTES_PER_PAYLOAD) &&
+           pattern_gather_matches(table) &&
+           lsbi_kernels_match(table) &&
+           stat_kernels_match(table);
+}
+
+/* Split at every length and alignment the SSE4.2 loop distinguishes */
+static int crc32c_matches_scalar(const stego_crc32c_fn crc32c)
+{
+    unsigned char data[STEGOBMP_SELF_CHECK_MAX_PAYLOAD + STEGOBMP_SELF_CHECK_MAX_OFFSET];
+    uint32_t state = 0x7F4A7C15u;
+    self_check_fill(data, sizeof(data), &state);
+
+    for (size_t offset = 0; offset <= STEGOBMP_SELF_CHECK_MAX_OFFSET; offset++)
+    {
+        for (size_t length = 0; length <= STEGOBMP_SELF_CHECK_MAX_PAYLOAD; length++)
+        {
+            const size_t split = length / 3;
+            const uint32_t expected = crc32c_scalar(0xFFFFFFFFu, data + offset, length);
+            const uint32_t actual = crc32c(crc32c(0xFFFFFFFFu, data + offset, split), data + offset + split, length - split);
+            if (expected != actual)
+                return 0;
+        }
+    }
+    return 1;
+}
+
+static const StegoKernelTable *select_best_table(void)
+{
+    const char *forced = getenv(STEGOBMP_KERNEL_ENV);
+    if (forced && strcmp(forced, STEGOBMP_KERNEL_ENV_SCALAR) == 0)
+        return &scalar_table;
+
+#ifdef STEGOBMP_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    {
+        pthread_once(&lsbi_lanes_once, lsbi_lanes_init);
+        return &avx2_table;
+    }
+    if (__builtin_cpu_supports("sse2"))
+        return &sse2_table;
+#endif
+
+    return &scalar_table;
+}
+
+static stego_crc32c_fn select_best_crc32c(void)
+{
+    const char *forced = getenv(STEGOBMP_KERNEL_ENV);
+    if (forced && strcmp(forced, STEGOBMP_KERNEL_ENV_SCALAR) == 0)
+        return crc32c_scalar;
+
+#ifdef STEGOBMP_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+        return crc32c_sse42;
+#endif
+
+    return crc32c_scalar;
+}
+
+static void kernels_init(void)
+{
+    crc32c_table_init();
+    const stego_crc32c_fn crc32c = select_best_crc32c();
+    if (crc32c != crc32c_scalar && !crc32c_matches_scalar(crc32c))
+        stego_diag_report(STEGO_DIAG_WARNING, "SSE4.2 CRC32C failed the self-check, falling back to scalar");
+    else
+        active_crc32c = crc32c;
+
+    const StegoKernelTable *candidate = select_best_table();
+
+    if (candidate != &scalar_table && !kernels_match_scalar(candidate))
+    {
+        stego_diag_report(STEGO_DIAG_WARNING, "%s kernels failed the self-check, falling back to scalar", stegobmp_kernels_level_name(candidate->level));
+        candidate = &scalar_table;
+    }
+
+    active_table = candidate;
+}
+
+static const StegoKernelTable *kernels(void)
+{
+    pthread_once(&kernels_once, kernels_init);
+    return active_table;
+}
+
+static stego_crc32c_fn kernels_crc32c(void)
+{
+    pthread_once(&kernels_once, kernels_init);
+    return active_crc32c;
+}
+
+void stegobmp_lsb1_spread(unsigned char *carrier, const unsigned char *payload, const size_t payload_size)
+{
+    kernels()->lsb1_spread(carrier, payload, payload_size);
+}
+
+void stegobmp_lsb1_gather(unsigned char *payload, const unsigned char *carrier, const size_t payload_size)
+{
+    kernels()->lsb1_gather(payload, carrier, payload_size);
+}
+
+void stegobmp_lsb4_spread(unsigned char *carrier, const unsigned char *payload, const size_t payload_size)
+{
+    kernels()->lsb4_spread(carrier, payload, payload_size);
+}
+
+void stegobmp_lsb4_gather(unsigned char *payload, const unsigned char *carrier, const size_t payload_size)
+{
+    kernels()->lsb4_gather(payload, carrier, payload_size);
+}
+
+void stegobmp_pattern_gather(unsigned char *plane, const unsigned char *carrier, const size_t plane_size)
+{
+    kernels()->pattern_gather(plane, carrier, plane_size);
+}
+
+void stegobmp_lsbi_costs(const unsigned char *carrier, const size_t first_byte, const unsigned char *payload, const size_t payload_size, uint64_t cost0[4], uint64_t cost1[4])
+{
+    kernels()->lsbi_costs(carrier + STEGOBMP_LSBI_CONTROL_BYTES + first_byte * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD, payload, payload_size, cost0, cost1);
+}
+
+void stegobmp_lsbi_apply(unsigned char *carrier, const size_t first_byte, const unsigned char *payload, const size_t payload_size, const int must_change[4])
+{
+    kernels()->lsbi_apply(carrier + STEGOBMP_LSBI_CONTROL_BYTES + first_byte * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD, payload, payload_size, must_change);
+}
+
+void stegobmp_lsbi_decode(unsigned char *payload, const unsigned char *carrier, const size_t first_byte, const size_t payload_size, const int must_change[4])
+{
+    kernels()->lsbi_decode(payload, carrier + STEGOBMP_LSBI_CONTROL_BYTES + first_byte * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD, payload_size, must_change);
+}
+
+void stegobmp_channel_histograms(const unsigned char *pixels, const size_t row_bytes, const size_t pixel_count, const size_t row_count, uint64_t histogram[STEGOBMP_STAT_CHANNELS][STEGOBMP_STAT_LEVELS])
+{
+    /* Scatter increments have no SSE2/AVX2 form; instead every channel of even and
+     * odd pixels gets its own 32-bit table, so runs of equal values do not chain
+     * increments of one counter through the store buffer. */
+    uint32_t tables[2][STEGOBMP_STAT_CHANNELS][STEGOBMP_STAT_LEVELS];
+    memset(tables, 0, sizeof(tables));
+    uint64_t pending = 0;
+
+    for (size_t row = 0; row < row_count; row++)
+    {
+        if (pending + pixel_count > UINT32_MAX)
+        {
+            stat_histograms_flush(tables, histogram);
+            pending = 0;
+        }
+
+        const unsigned char *pixel = pixels + row * row_bytes;
+        size_t i = 0;
+        for (; i + 2 <= pixel_count; i += 2, pixel += 2 * STEGOBMP_STAT_CHANNELS)
+        {
+            tables[0][0][pixel[0]]++;
+            tables[0][1][pixel[1]]++;
+            tables[0][2][pixel[2]]++;
+            tables[1][0][pixel[3]]++;
+            tables[1][1][pixel[4]]++;
+            tables[1][2][pixel[5]]++;
+        }
+        if (i < pixel_count)
+        {
+            tables[0][0][pixel[0]]++;
+            tables[0][1][pixel[1]]++;
+            tables[0][2][pixel[2]]++;
+        }
+        pending += pixel_count;
+    }
+
+    stat_histograms_flush(tables, histogram);
+}
+
+void stegobmp_sample_pairs(const unsigned char *pixels, const size_t row_bytes, const size_t pixel_count, const size_t row_count, StegoSamplePairCounts counts[STEGOBMP_STAT_CHANNELS])
+{
+    kernels()->sample_pairs(pixels, row_bytes, pixel_count, row_count, counts);
+}
+
+void stegobmp_rs_groups(const unsigned char *pixels, const size_t row_bytes, const size_t pixel_count, const size_t row_count, StegoRsCounts counts[STEGOBMP_STAT_CHANNELS])
+{
+    kernels()->rs_groups(pixels, row_bytes, pixel_count, row_count, counts);
+}
+
+StegoKernelLevel stegobmp_kernels_level(void)
+{
+    return kernels()->level;
+}
+
+const char *stegobmp_kernels_level_name(const StegoKernelLevel level)
+{
+    switch (level)
+    {
+        case STEGOBMP_KERNEL_SSE2:
+            return "SSE2";
+        case STEGOBMP_KERNEL_AVX2:
+            return "AVX2";
+        default:
+            return "scalar";
+    }
+}
+
+uint32_t stegobmp_crc32c(const uint32_t crc, const unsigned char *data, const size_t length)
+{
+    return ~kernels_crc32c()(~crc, data, length);
+}
+
+static int self_check_table(const StegoKernelTable *table)
+{
+    if (kernels_match_scalar(table))
+        return 0;
+    stego_diag_report(STEGO_DIAG_ERROR, "%s kernels differ from the scalar ones", stegobmp_kernels_level_name(table->level));
+    return 1;
+}
+
+int stegobmp_kernels_self_check(void)
+{
+    /* the CRC32C tables are built on first dispatch */
+    pthread_once(&kernels_once, kernels_init);
+
+    int failures = 0;
+    const uint32_t check = ~crc32c_scalar(0xFFFFFFFFu, (const unsigned char *)STEGOBMP_CRC32C_CHECK_INPUT, strlen(STEGOBMP_CRC32C_CHECK_INPUT));
+    if (check != STEGOBMP_CRC32C_CHECK_VALUE)
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "Scalar CRC32C gives %08X for the check input instead of %08X", check, STEGOBMP_CRC32C_CHECK_VALUE);
+        failures++;
+    }
+
+#ifdef STEGOBMP_KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2") && !crc32c_matches_scalar(crc32c_sse42))
+    {
+        stego_diag_report(STEGO_DIAG_ERROR, "SSE4.2 CRC32C differs from the scalar one");
+        failures++;
+    }
+    if (__builtin_cpu_supports("sse2"))
+        failures += self_check_table(&sse2_table);
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    {
+        pthread_once(&lsbi_lanes_once, lsbi_lanes_init);
+        failures += self_check_table(&avx2_table);
+    }
+#endif
+
+    return failures ? 1 : 0;
+}
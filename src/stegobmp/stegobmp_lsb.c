@@ -1,8 +1,11 @@
 #include "../../include/stegobmp/stegobmp_lsb.h"
+#include "../../include/stegobmp/stegobmp_kernels.h"
 #include "../../include/stegobmp/stegobmp_utils.h"
+#include "../../include/stegobmp/stegobmp_compress.h"
 #include "../../include/bmp/bmp_utils.h"
+#include "../../include/diagnostics/diagnostics.h"
 
-#include <stdio.h>
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -18,20 +21,9 @@ int lsb_1_hide(BMP *bmp, const unsigned char *payload_buffer, const size_t paylo
         return -1;
     }
 
-    uint64_t bmp_byte_index = 0;
-    const uint64_t bmp_data_size = (uint64_t)bmp->data_size;
-
-    for (size_t payload_index = 0; payload_index < payload_size; payload_index++)
-    {
-        for (int bit_index = STEGOBMP_LSB1_MOST_SIGNIFICANT_BIT; bit_index >= 0; bit_index--)
-        {
-            if (bmp_byte_index >= bmp_data_size)
-                return -1; /* safety */
-            const unsigned char bit = (unsigned char)((payload_buffer[payload_index] >> bit_index) & STEGOBMP_LSB1_BIT_MASK_1);
-            bmp->data[bmp_byte_index] = (unsigned char)((bmp->data[bmp_byte_index] & STEGOBMP_LSB1_MASK) | bit);
-            bmp_byte_index++;
-        }
-    }
+    /* capacity was checked above, so the kernel can run without per-byte bounds checks */
+    stegobmp_lsb1_spread(bmp->data, payload_buffer, payload_size);
+    bmp_mark_dirty(bmp, 0, payload_size * STEGOBMP_LSB1_BYTES_PER_PAYLOAD);
 
     /* leave the rest of the pixels unchanged */
     return 0;
@@ -44,25 +36,45 @@ int lsb_4_hide(BMP *bmp, const unsigned char *payload_buffer, const size_t paylo
 
     if (required_amount_bytes > max_amount_bytes)
     {
-        printf("Error: BMP does not have enough space to hide the payload\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "BMP does not have enough space to hide the payload");
         return 1;
     }
 
-    size_t bmp_byte_index = 0;
+    stegobmp_lsb4_spread(bmp->data, payload_buffer, payload_size);
+    bmp_mark_dirty(bmp, 0, payload_size * STEGOBMP_LSB4_BYTES_PER_PAYLOAD);
 
-    for (size_t payload_index = 0; payload_index < payload_size; payload_index++)
-    {
-        const unsigned char payload_high_nibble = payload_buffer[payload_index] >> STEGOBMP_LSB4_NIBBLE_SIZE_BITS & STEGOBMP_LSB4_BIT_MASK_4;
-        const unsigned char payload_low_nibble = payload_buffer[payload_index] & STEGOBMP_LSB4_BIT_MASK_4;
+    return 0;
+}
 
-        bmp->data[bmp_byte_index] = bmp->data[bmp_byte_index] & STEGOBMP_LSB4_MASK | payload_high_nibble;
-        bmp_byte_index++;
+/* number of payload channels available in a carrier of data_size bytes */
+static uint64_t lsbi_channel_count(const uint64_t data_size)
+{
+    if (data_size <= STEGOBMP_LSBI_CONTROL_BYTES)
+        return 0;
+    const uint64_t skipped = data_size / BMP_BYTES_PER_PIXEL - STEGOBMP_LSBI_CONTROL_BYTES / BMP_BYTES_PER_PIXEL;
+    return data_size - STEGOBMP_LSBI_CONTROL_BYTES - skipped;
+}
 
-        bmp->data[bmp_byte_index] = bmp->data[bmp_byte_index] & STEGOBMP_LSB4_MASK | payload_low_nibble;
-        bmp_byte_index++;
-    }
+uint64_t lsb_1_capacity(const BMP *bmp)
+{
+    return (uint64_t)bmp->data_size / STEGOBMP_LSB1_BYTES_PER_PAYLOAD;
+}
 
-    return 0;
+uint64_t lsb_4_capacity(const BMP *bmp)
+{
+    return (uint64_t)bmp->data_size / STEGOBMP_LSB4_BYTES_PER_PAYLOAD;
+}
+
+uint64_t lsb_i_capacity(const BMP *bmp)
+{
+    return lsbi_channel_count((uint64_t)bmp->data_size) / STEGOBMP_LSBI_BYTES_PER_PAYLOAD;
+}
+
+uint64_t lsb_i_legacy_capacity(const BMP *bmp)
+{
+    if (bmp->data_size < STEGOBMP_LSBI_CONTROL_BYTES)
+        return 0;
+    return ((uint64_t)bmp->data_size - STEGOBMP_LSBI_CONTROL_BYTES) / STEGOBMP_LSBI_BYTES_PER_PAYLOAD;
 }
 
 int lsb_i_hide(BMP *bmp, const unsigned char *payload_buffer, const size_t payload_size)
@@ -76,156 +88,284 @@ int lsb_i_hide(BMP *bmp, const unsigned char *payload_buffer, const size_t paylo
         return -1;
     }
 
-    /* build list of indices for payload bits: start at raw offset 4, skip red channel (idx%3==2) */
-    unsigned int *msg_idx = malloc(sizeof(unsigned int) * (size_t)total_pixel_bytes);
-    if (!msg_idx)
-        return -1;
-    size_t msg_count = 0;
-    for (uint64_t i = 4; i < total_pixel_bytes; ++i)
-    {
-        if ((i % 3) == 2)
-            continue; /* skip red channel */
-        msg_idx[msg_count++] = (unsigned int)i;
-    }
-
     const uint64_t payload_bits = (uint64_t)payload_size * 8ULL;
-    if (payload_bits > msg_count)
-    {
-        free(msg_idx);
+    if (payload_bits > lsbi_channel_count(total_pixel_bytes))
         return -1;
-    }
 
-    unsigned char *pixels = bmp->data; /* in-memory buffer */
+    unsigned char *pixels = bmp->data; /* modified in place */
 
     /* compute costs per pattern (bits 1..2) to decide inversion mask */
     uint64_t cost0[4] = {0, 0, 0, 0}, cost1[4] = {0, 0, 0, 0};
-    for (uint64_t j = 0; j < payload_bits; ++j)
-    {
-        size_t idx = msg_idx[j];
-        unsigned char pix = pixels[idx];
-        int pattern = (pix & 0x06) >> 1;
-        int orig = pix & 1;
-        uint32_t byte_idx = (uint32_t)(j / 8);
-        int bit_in_byte = (int)(j % 8);
-        int desired = (payload_buffer[byte_idx] >> (7 - bit_in_byte)) & 1;
-        if (orig != desired)
-            cost0[pattern]++;
-        if (orig != (desired ^ 1))
-            cost1[pattern]++;
-    }
+    stegobmp_lsbi_costs(pixels, 0, payload_buffer, payload_size, cost0, cost1);
 
     int must_change[4];
     for (int p = 0; p < 4; ++p)
         must_change[p] = (cost1[p] < cost0[p]) ? 1 : 0;
 
-    /* prepare out buffer (copy) and write mask into first 4 raw pixel bytes (direct mapping) */
-    unsigned char *out_pixels = malloc((size_t)total_pixel_bytes);
-    if (!out_pixels)
-    {
-        free(msg_idx);
-        return -1;
-    }
-    memcpy(out_pixels, pixels, (size_t)total_pixel_bytes);
+    /* write mask into first 4 raw pixel bytes (direct mapping) */
     for (int i = 0; i < 4; ++i)
     {
-        out_pixels[i] = (unsigned char)((out_pixels[i] & 0xFE) | (must_change[i] & 1));
+        pixels[i] = (unsigned char)((pixels[i] & 0xFE) | (must_change[i] & 1));
     }
 
-    /* write payload bits applying chosen mask per pattern */
-    for (uint64_t j = 0; j < payload_bits; ++j)
-    {
-        size_t idx = msg_idx[j];
-        unsigned char src = out_pixels[idx];
-        int pattern = (src & 0x06) >> 1;
-        uint32_t byte_idx = (uint32_t)(j / 8);
-        int bit_in_byte = (int)(j % 8);
-        int desired = (payload_buffer[byte_idx] >> (7 - bit_in_byte)) & 1;
-        if (must_change[pattern])
-            desired ^= 1;
-        out_pixels[idx] = (unsigned char)((src & 0xFE) | desired);
-    }
-
-    /* copy modified pixels back into bmp->data */
-    memcpy(bmp->data, out_pixels, (size_t)total_pixel_bytes);
+    /* write payload bits applying chosen mask per pattern; bits 1..2 are never touched */
+    stegobmp_lsbi_apply(pixels, 0, payload_buffer, payload_size, must_change);
+    bmp_mark_dirty(bmp, 0, STEGOBMP_LSBI_CONTROL_BYTES + payload_size * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD);
 
-    free(msg_idx);
-    free(out_pixels);
     return 0;
 }
 
-unsigned char *lsb_1_retrieve(const BMP *bmp, size_t *extracted_payload_size)
+/*
+ * Retrieval is header-first: the 4-byte size is decoded and checked against the
+ * carrier capacity, then the bounded extension window right after the declared
+ * file bytes is decoded on the stack. Only when it holds a terminator is the
+ * exactly sized payload buffer allocated and filled, straight from the pixels.
+ * Probing several methods shares the packed planes of stegobmp_planes.h, so the
+ * headers and windows they all read are extracted once.
+ */
+
+/* Everything a decoder needs besides the output: the planes it may read and, for LSBI, its control bits */
+typedef struct
 {
-    if (!bmp || !extracted_payload_size)
-        return NULL;
+    const BMP *bmp;
+    /* NULL for a single-method retrieve, which has nothing to share */
+    StegoBitPlanes *planes;
+    const int *must_change;
+    /* LSBI: pattern plane byte -> inversion of the 4 LSBs it covers, first carrier byte in bit 3 */
+    unsigned char flips[256];
+} LsbDecoder;
+
+/* decodes count payload bytes starting at payload byte first_byte */
+typedef void (*lsb_decode_fn)(LsbDecoder *decoder, unsigned char *out, size_t first_byte, size_t count);
+
+#ifdef STEGOBMP_DEBUG
+#define LSB_REPORT_PEAK_ALLOCATION(method, bytes) stego_diag_report(STEGO_DIAG_DEBUG, "%s retrieve peak allocation %zu bytes", method, (size_t)(bytes))
+#else
+#define LSB_REPORT_PEAK_ALLOCATION(method, bytes) ((void)(method), (void)(bytes))
+#endif
+
+static void lsb_decoder_init(LsbDecoder *decoder, const BMP *bmp, StegoBitPlanes *planes, const int *must_change)
+{
+    decoder->bmp = bmp;
+    decoder->planes = planes;
+    decoder->must_change = must_change;
+    if (!must_change)
+        return;
+    for (int patterns = 0; patterns < 256; ++patterns)
+    {
+        unsigned char flip = 0;
+        for (int shift = 6; shift >= 0; shift -= 2)
+            flip = (unsigned char)((flip << 1) | (must_change[(patterns >> shift) & 3] & 1));
+        decoder->flips[patterns] = flip;
+    }
+}
 
-    const unsigned char *data = bmp->data;
-    const size_t data_size = bmp->data_size;
+/* Decodes the size and the extension window into probe; 1 when a terminator shows up inside the carrier */
+static int probe_header(const lsb_decode_fn decode, LsbDecoder *decoder, const uint64_t capacity, StegoLsbProbe *probe)
+{
+    if (capacity < BMP_INT_SIZE_BYTES + STEGOBMP_NULL_CHARACTER_SIZE)
+        return 0;
+
+    unsigned char size_buf[BMP_INT_SIZE_BYTES];
+    decode(decoder, size_buf, 0, BMP_INT_SIZE_BYTES);
+
+    /* a compressed container flags its size; the stream itself is inflated when saved */
+    probe->size_field = read_uint32_big_endian(size_buf);
+    const uint32_t file_size = probe->size_field & STEGOBMP_SIZE_LENGTH_MASK;
+    const uint64_t extension_start = (uint64_t)BMP_INT_SIZE_BYTES + file_size;
+    if (file_size == 0 || extension_start + STEGOBMP_NULL_CHARACTER_SIZE > capacity)
+        return 0;
+
+    uint64_t window_size = capacity - extension_start;
+    if (window_size > STEGOBMP_EXTENSION_WINDOW)
+        window_size = STEGOBMP_EXTENSION_WINDOW;
+    decode(decoder, probe->window, (size_t)extension_start, (size_t)window_size);
+
+    const unsigned char *terminator = memchr(probe->window, STEGOBMP_NULL_CHARACTER, (size_t)window_size);
+    if (!terminator)
+        return 0;
+
+    /* a checksummed container keeps its CRC32C after the terminator; save_extracted_file verifies it */
+    probe->trailer_size = (size_t)(terminator - probe->window) + STEGOBMP_NULL_CHARACTER_SIZE;
+    const size_t checksum_size = stego_payload_trailer_size(probe->size_field);
+    if (extension_start + probe->trailer_size + checksum_size > capacity)
+        return 0;
+
+    probe->payload_size = (size_t)extension_start + probe->trailer_size + checksum_size;
+    return 1;
+}
 
-    const size_t max_payload_bytes = data_size / STEGOBMP_LSB1_BYTES_PER_PAYLOAD;
-    if (max_payload_bytes < BMP_INT_SIZE_BYTES + STEGOBMP_NULL_CHARACTER_SIZE)
+/* Fills an exactly sized buffer from a probe whose header and window are already decoded */
+static unsigned char *retrieve_probed(const lsb_decode_fn decode, LsbDecoder *decoder, const StegoLsbProbe *probe, size_t *extracted_payload_size, size_t *peak_allocation)
+{
+    unsigned char *buffer = malloc(probe->payload_size);
+    if (!buffer)
         return NULL;
+    *peak_allocation += probe->payload_size;
 
-    uint64_t cursor = 0;
-    unsigned char size_buf[BMP_INT_SIZE_BYTES];
+    const uint32_t file_size = probe->size_field & STEGOBMP_SIZE_LENGTH_MASK;
+    const size_t extension_start = BMP_INT_SIZE_BYTES + (size_t)file_size;
+    write_uint32_big_endian(buffer, probe->size_field);
+    decode(decoder, buffer + BMP_INT_SIZE_BYTES, BMP_INT_SIZE_BYTES, file_size);
+    memcpy(buffer + extension_start, probe->window, probe->trailer_size);
 
-    for (size_t byte_index = 0; byte_index < BMP_INT_SIZE_BYTES; ++byte_index)
-    {
-        unsigned char acc = 0;
-        for (int b = STEGOBMP_LSB1_MOST_SIGNIFICANT_BIT; b >= 0; --b)
-        {
-            if (cursor >= data_size)
-                return NULL;
+    const size_t checksum_offset = extension_start + probe->trailer_size;
+    if (probe->payload_size > checksum_offset)
+        decode(decoder, buffer + checksum_offset, checksum_offset, probe->payload_size - checksum_offset);
 
-            const unsigned char bit = data[cursor++] & STEGOBMP_LSB1_BIT_MASK_1;
-            acc |= (unsigned char)(bit << b);
-        }
-        size_buf[byte_index] = acc;
-    }
+    *extracted_payload_size = probe->payload_size;
+    return buffer;
+}
 
-    const uint32_t file_size = read_uint32_big_endian(size_buf);
-    if (file_size == 0)
+static unsigned char *retrieve_header_first(const lsb_decode_fn decode, LsbDecoder *decoder, const uint64_t capacity, size_t *extracted_payload_size, size_t *peak_allocation)
+{
+    StegoLsbProbe probe;
+    if (!probe_header(decode, decoder, capacity, &probe))
         return NULL;
+    return retrieve_probed(decode, decoder, &probe, extracted_payload_size, peak_allocation);
+}
 
-    const size_t max_possible_payload = max_payload_bytes;
-    unsigned char *buffer = malloc(max_possible_payload);
-    if (!buffer)
+/*
+ * Plane holding carrier bytes [first, end), or NULL when the span is decoded from
+ * the pixels instead: without planes, when the plane can not be allocated, and
+ * for a long span no earlier decode extracted, which would cost a pass over the
+ * plane and a second copy of the payload for a single reader.
+ */
+static const unsigned char *decoder_plane(LsbDecoder *decoder, const StegoPlane plane, const size_t first, const size_t end)
+{
+    if (!decoder->planes)
+        return NULL;
+    if (end - first > STEGOBMP_PLANES_BLOCK_BYTES && !stego_planes_hold(decoder->planes, plane, first, end))
         return NULL;
+    return stego_planes_require(decoder->planes, plane, first, end);
+}
+
+/* LSB1 and LSB4 payload bytes are plane bytes as they stand */
+static void lsb_1_decode(LsbDecoder *decoder, unsigned char *out, const size_t first_byte, const size_t count)
+{
+    const size_t first = first_byte * STEGOBMP_LSB1_BYTES_PER_PAYLOAD;
+    const unsigned char *lsb = decoder_plane(decoder, STEGOBMP_PLANE_LSB, first, first + count * STEGOBMP_LSB1_BYTES_PER_PAYLOAD);
+    if (lsb)
+        memcpy(out, lsb + first_byte, count);
+    else
+        stegobmp_lsb1_gather(out, decoder->bmp->data + first, count);
+}
 
-    memcpy(buffer, size_buf, BMP_INT_SIZE_BYTES);
+static void lsb_4_decode(LsbDecoder *decoder, unsigned char *out, const size_t first_byte, const size_t count)
+{
+    const size_t first = first_byte * STEGOBMP_LSB4_BYTES_PER_PAYLOAD;
+    const unsigned char *nibble = decoder_plane(decoder, STEGOBMP_PLANE_NIBBLE, first, first + count * STEGOBMP_LSB4_BYTES_PER_PAYLOAD);
+    if (nibble)
+        memcpy(out, nibble + first_byte, count);
+    else
+        stegobmp_lsb4_gather(out, decoder->bmp->data + first, count);
+}
 
-    size_t out_index = BMP_INT_SIZE_BYTES;
-    int found_terminator = 0;
+/* 12 channel bits of one payload byte, first carrier byte on top: drops the red ones at bits 10, 7, 4 and 1 */
+static unsigned char lsb_i_drop_red(const unsigned int bits)
+{
+    return (unsigned char)((bits >> 4 & 0x80) | (bits >> 3 & 0x60) | (bits >> 2 & 0x18) | (bits >> 1 & 0x06) | (bits & 0x01));
+}
+
+/* LSB inversions of the n groups of 4 carrier bytes behind patterns, first group on top */
+static inline uint32_t lsb_i_flips(const unsigned char *flips, const unsigned char *patterns, const int n)
+{
+    uint32_t bits = 0;
+    for (int g = 0; g < n; ++g)
+        bits = bits << 4 | flips[patterns[g]];
+    return bits;
+}
 
-    while (out_index < max_possible_payload)
+/*
+ * Payload byte j sits at carrier byte 4 + 12j: 3 pattern plane bytes from 1 + 3j
+ * and 12 LSB plane bits, from bit 4 of byte 3k for an even j = 2k and from the
+ * start of byte 3k + 2 for an odd one. A pair starting at an even j therefore
+ * takes bits 4 .. 27 of LSB bytes 3k .. 3k + 3 in one word.
+ */
+static void lsb_i_decode(LsbDecoder *decoder, unsigned char *out, const size_t first_byte, const size_t count)
+{
+    const size_t first = STEGOBMP_LSBI_CONTROL_BYTES + first_byte * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD;
+    const size_t end = first + count * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD;
+
+    /* extracting two planes for one reader costs more than the shuffle kernel over
+     * the pixels: only short spans (headers and windows the probes share) and spans
+     * some earlier decode already extracted are read from the planes */
+    const unsigned char *lsb = decoder_plane(decoder, STEGOBMP_PLANE_LSB, first, end);
+    const unsigned char *pattern = lsb ? decoder_plane(decoder, STEGOBMP_PLANE_PATTERN, first, end) : NULL;
+    if (!pattern)
     {
-        unsigned char acc = 0;
-        for (int b = STEGOBMP_LSB1_MOST_SIGNIFICANT_BIT; b >= 0; --b)
-        {
-            if (cursor >= data_size)
-                goto end_of_data;
+        stegobmp_lsbi_decode(out, decoder->bmp->data, first_byte, count, decoder->must_change);
+        return;
+    }
 
-            const unsigned char bit = data[cursor++] & STEGOBMP_LSB1_BIT_MASK_1;
-            acc |= (unsigned char)(bit << b);
-        }
+    const unsigned char *flips = decoder->flips;
 
-        buffer[out_index++] = acc;
+    size_t i = 0;
+    if (count && (first_byte & 1))
+    {
+        const unsigned char *lsbs = lsb + (STEGOBMP_LSBI_CONTROL_BYTES + 12 * first_byte) / 8;
+        const uint32_t word = (uint32_t)lsbs[0] << 8 | lsbs[1];
+        out[i++] = lsb_i_drop_red((word >> 4 ^ lsb_i_flips(flips, pattern + 1 + 3 * first_byte, 3)) & 0xFFF);
+    }
+    for (; i + 2 <= count; i += 2)
+    {
+        const size_t j = first_byte + i;
+        const unsigned char *lsbs = lsb + (STEGOBMP_LSBI_CONTROL_BYTES + 12 * j) / 8;
+        const uint32_t word = (uint32_t)lsbs[0] << 24 | (uint32_t)lsbs[1] << 16 | (uint32_t)lsbs[2] << 8 | lsbs[3];
+        const uint32_t bits = (word >> 4 ^ lsb_i_flips(flips, pattern + 1 + 3 * j, 6)) & 0xFFFFFF;
+        out[i] = lsb_i_drop_red(bits >> 12);
+        out[i + 1] = lsb_i_drop_red(bits & 0xFFF);
+    }
+    if (i < count)
+    {
+        const size_t j = first_byte + i;
+        const unsigned char *lsbs = lsb + (STEGOBMP_LSBI_CONTROL_BYTES + 12 * j) / 8;
+        const uint32_t word = (uint32_t)lsbs[0] << 8 | lsbs[1];
+        out[i] = lsb_i_drop_red((word ^ lsb_i_flips(flips, pattern + 1 + 3 * j, 3)) & 0xFFF);
+    }
+}
 
-        if (out_index > BMP_INT_SIZE_BYTES + file_size && acc == STEGOBMP_NULL_CHARACTER)
+/* legacy LSBI layout flagged by STEGOBMP_LSBI_CONTROL_PATTERN: bit = lsb ^ msb, no channel skipping */
+void lsb_i_legacy_decode(const BMP *bmp, unsigned char *out, const size_t first_byte, const size_t count)
+{
+    const unsigned char *data = bmp->data + STEGOBMP_LSBI_CONTROL_BYTES + first_byte * STEGOBMP_LSBI_BYTES_PER_PAYLOAD;
+    for (size_t i = 0; i < count; ++i)
+    {
+        unsigned char acc = 0;
+        for (int b = 7; b >= 0; --b)
         {
-            found_terminator = 1;
-            break;
+            unsigned char lsb = *data & 1;
+            unsigned char msb = (*data >> 7) & 1;
+            acc |= (unsigned char)((lsb ^ msb) << b);
+            data++;
         }
+        out[i] = acc;
     }
+}
 
-end_of_data:
+/* the MSB it needs is in no plane, so the legacy layout still reads the pixels */
+static void lsb_i_control_decode(LsbDecoder *decoder, unsigned char *out, const size_t first_byte, const size_t count)
+{
+    lsb_i_legacy_decode(decoder->bmp, out, first_byte, count);
+}
 
-    if (!found_terminator)
-    {
-        free(buffer);
+/* Runs a header-first retrieve of one method straight from the pixels */
+static unsigned char *retrieve_from_pixels(const BMP *bmp, const lsb_decode_fn decode, const int *must_change, const uint64_t capacity, size_t *extracted_payload_size, size_t *peak_allocation)
+{
+    LsbDecoder decoder;
+    lsb_decoder_init(&decoder, bmp, NULL, must_change);
+    return retrieve_header_first(decode, &decoder, capacity, extracted_payload_size, peak_allocation);
+}
+
+unsigned char *lsb_1_retrieve(const BMP *bmp, size_t *extracted_payload_size)
+{
+    if (!bmp || !extracted_payload_size)
         return NULL;
-    }
 
-    *extracted_payload_size = out_index;
+    size_t peak_allocation = 0;
+    const uint64_t capacity = lsb_1_capacity(bmp);
+    unsigned char *buffer = retrieve_from_pixels(bmp, lsb_1_decode, NULL, capacity, extracted_payload_size, &peak_allocation);
+    LSB_REPORT_PEAK_ALLOCATION(STEGOBMP_LSB1_METHOD, peak_allocation);
     return buffer;
 }
 
@@ -234,29 +374,15 @@ unsigned char *lsb_1_retrieve_encrypted(const BMP *bmp, size_t *extracted_payloa
     if (!bmp || !extracted_payload_size)
         return NULL;
 
-    const unsigned char *data = bmp->data;
-    const size_t data_size = bmp->data_size;
-
-    const size_t max_payload_bytes = data_size / STEGOBMP_LSB1_BYTES_PER_PAYLOAD;
+    const size_t max_payload_bytes = bmp->data_size / STEGOBMP_LSB1_BYTES_PER_PAYLOAD;
     if (max_payload_bytes < BMP_INT_SIZE_BYTES)
         return NULL;
 
-    uint64_t cursor = 0;
-    unsigned char size_buf[BMP_INT_SIZE_BYTES];
+    LsbDecoder decoder;
+    lsb_decoder_init(&decoder, bmp, NULL, NULL);
 
-    for (size_t byte_index = 0; byte_index < BMP_INT_SIZE_BYTES; ++byte_index)
-    {
-        unsigned char acc = 0;
-        for (int b = STEGOBMP_LSB1_MOST_SIGNIFICANT_BIT; b >= 0; --b)
-        {
-            if (cursor >= data_size)
-                return NULL;
-
-            const unsigned char bit = data[cursor++] & STEGOBMP_LSB1_BIT_MASK_1;
-            acc |= (unsigned char)(bit << b);
-        }
-        size_buf[byte_index] = acc;
-    }
+    unsigned char size_buf[BMP_INT_SIZE_BYTES];
+    lsb_1_decode(&decoder, size_buf, 0, BMP_INT_SIZE_BYTES);
 
     const uint32_t cipher_size = read_uint32_big_endian(size_buf);
     if (cipher_size == 0 || cipher_size > max_payload_bytes - BMP_INT_SIZE_BYTES)
@@ -264,146 +390,43 @@ unsigned char *lsb_1_retrieve_encrypted(const BMP *bmp, size_t *extracted_payloa
 
     const size_t total_size = BMP_INT_SIZE_BYTES + (size_t)cipher_size;
     unsigned char *buffer = malloc(total_size);
-    if (!buffer)
-        return NULL;
-
-    memcpy(buffer, size_buf, BMP_INT_SIZE_BYTES);
-
-    size_t out_index = BMP_INT_SIZE_BYTES;
-    while (out_index < total_size)
+    if (buffer)
     {
-        unsigned char acc = 0;
-        for (int b = STEGOBMP_LSB1_MOST_SIGNIFICANT_BIT; b >= 0; --b)
-        {
-            if (cursor >= data_size)
-            {
-                free(buffer);
-                return NULL;
-            }
-
-            const unsigned char bit = data[cursor++] & STEGOBMP_LSB1_BIT_MASK_1;
-            acc |= (unsigned char)(bit << b);
-        }
-        buffer[out_index++] = acc;
+        LSB_REPORT_PEAK_ALLOCATION(STEGOBMP_LSB1_METHOD, total_size);
+        memcpy(buffer, size_buf, BMP_INT_SIZE_BYTES);
+        lsb_1_decode(&decoder, buffer + BMP_INT_SIZE_BYTES, BMP_INT_SIZE_BYTES, cipher_size);
+        *extracted_payload_size = total_size;
     }
 
-    *extracted_payload_size = total_size;
     return buffer;
 }
 
-
 unsigned char *lsb_4_retrieve(const BMP *bmp, size_t *extracted_payload_size)
 {
-    const size_t bmp_data_size = bmp->data_size;
-    size_t bmp_byte_index = 0;
-    unsigned char size_buffer[BMP_INT_SIZE_BYTES];
-
-    if (bmp_data_size < BMP_INT_SIZE_BYTES * STEGOBMP_LSB4_BYTES_PER_PAYLOAD)
-    {
-        printf("Error: BMP does not have enough space to extract the payload size\n");
-        return NULL;
-    }
-
-    for (size_t i = 0; i < BMP_INT_SIZE_BYTES; i++)
-    {
-        unsigned char extracted_byte = 0;
-        if (bmp_byte_index >= bmp_data_size)
-        {
-            printf("Error: BMP does not have the complete payload size\n");
-            return NULL;
-        }
-        const unsigned char msn = bmp->data[bmp_byte_index] & STEGOBMP_LSB4_BIT_MASK_4;
-        extracted_byte |= msn << STEGOBMP_LSB4_NIBBLE_SIZE_BITS;
-        bmp_byte_index++;
-
-        if (bmp_byte_index >= bmp_data_size)
-        {
-            printf("Error: BMP does not have the complete payload size\n");
-            return NULL;
-        }
-        const unsigned char lsn = bmp->data[bmp_byte_index] & STEGOBMP_LSB4_BIT_MASK_4;
-        extracted_byte |= lsn;
-        bmp_byte_index++;
-
-        size_buffer[i] = extracted_byte;
-    }
-
-    const uint32_t file_size = read_uint32_big_endian(size_buffer);
-    const size_t min_payload_bytes = BMP_INT_SIZE_BYTES + file_size + STEGOBMP_NULL_CHARACTER_SIZE;
-    const size_t required_bmp_bytes = min_payload_bytes * STEGOBMP_LSB4_BYTES_PER_PAYLOAD;
-
-    if (file_size == 0 || file_size > (bmp_data_size / STEGOBMP_LSB4_BYTES_PER_PAYLOAD) - BMP_INT_SIZE_BYTES)
-    {
-        printf("Error: Extracted payload size is invalid (%u bytes)\n", file_size);
-        return NULL;
-    }
-
-    if (required_bmp_bytes > bmp_data_size)
-    {
-        printf("Error: BMP does not have the complete payload size (Total size expected: %zu bytes)\n", min_payload_bytes);
+    if (!bmp || !extracted_payload_size)
         return NULL;
-    }
 
-    const size_t max_payload_bytes = bmp_data_size / STEGOBMP_LSB4_BYTES_PER_PAYLOAD;
-    unsigned char *payload_buffer = malloc(max_payload_bytes);
-    if (!payload_buffer)
+    if (bmp->data_size < BMP_INT_SIZE_BYTES * STEGOBMP_LSB4_BYTES_PER_PAYLOAD)
     {
-        printf("Error: Could not allocate memory for payload buffer\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "BMP does not have enough space to extract the payload size");
         return NULL;
     }
 
-    memcpy(payload_buffer, size_buffer, BMP_INT_SIZE_BYTES);
-
-    size_t payload_byte_index = BMP_INT_SIZE_BYTES;
-
-    while (bmp_byte_index < bmp_data_size && payload_byte_index < max_payload_bytes)
-    {
-        unsigned char extracted_byte = 0;
-        if (bmp_byte_index >= bmp_data_size)
-        {
-            printf("Error: BMP does not have the complete payload expected\n");
-            free(payload_buffer);
-            return NULL;
-        }
-        const unsigned char msn = bmp->data[bmp_byte_index] & STEGOBMP_LSB4_BIT_MASK_4;
-        extracted_byte |= msn << STEGOBMP_LSB4_NIBBLE_SIZE_BITS;
-        bmp_byte_index++;
-
-        if (bmp_byte_index >= bmp_data_size)
-        {
-            printf("Error: BMP does not have the complete payload size\n");
-            free(payload_buffer);
-            return NULL;
-        }
-        const unsigned char lsn = bmp->data[bmp_byte_index] & STEGOBMP_LSB4_BIT_MASK_4;
-        extracted_byte |= lsn;
-        bmp_byte_index++;
-
-        payload_buffer[payload_byte_index] = extracted_byte;
-
-        if (payload_byte_index >= BMP_INT_SIZE_BYTES + file_size && payload_buffer[payload_byte_index] == STEGOBMP_NULL_CHARACTER)
-        {
-            payload_byte_index++;
-            break;
-        }
-
-        payload_byte_index++;
-    }
-
-    if (payload_byte_index < min_payload_bytes)
+    size_t peak_allocation = 0;
+    const uint64_t capacity = lsb_4_capacity(bmp);
+    unsigned char *buffer = retrieve_from_pixels(bmp, lsb_4_decode, NULL, capacity, extracted_payload_size, &peak_allocation);
+    LSB_REPORT_PEAK_ALLOCATION(STEGOBMP_LSB4_METHOD, peak_allocation);
+    if (!buffer)
     {
-        printf("Error: Extracted payload incomplete or null terminator missing\n");
-        free(payload_buffer);
+        stego_diag_report(STEGO_DIAG_ERROR, "Extracted payload size is invalid or null terminator missing");
         return NULL;
     }
-
-    *extracted_payload_size = payload_byte_index;
-    return payload_buffer;
+    return buffer;
 }
 
 unsigned char *lsb_i_retrieve(const BMP *bmp, size_t *extracted_payload_size)
 {
-    if (!bmp)
+    if (!bmp || !extracted_payload_size)
         return NULL;
     const unsigned char *data = bmp->data;
     const uint64_t data_size = (uint64_t)bmp->data_size;
@@ -416,152 +439,99 @@ unsigned char *lsb_i_retrieve(const BMP *bmp, size_t *extracted_payload_size)
         control_pattern = (control_pattern << 1) | (data[i] & 1);
     }
 
+    size_t peak_allocation = 0;
+    unsigned char *buffer;
+
     if (control_pattern == STEGOBMP_LSBI_CONTROL_PATTERN)
     {
-        uint64_t idx = STEGOBMP_LSBI_CONTROL_BYTES;
-        unsigned char size_buf[BMP_INT_SIZE_BYTES];
-        for (size_t i = 0; i < BMP_INT_SIZE_BYTES; ++i)
-        {
-            unsigned char acc = 0;
-            for (int b = 7; b >= 0; --b)
-            {
-                if (idx >= data_size)
-                    return NULL;
-                unsigned char lsb = data[idx] & 1;
-                unsigned char msb = (data[idx] >> 7) & 1;
-                unsigned char bit = lsb ^ msb;
-                acc |= (unsigned char)(bit << b);
-                idx++;
-            }
-            size_buf[i] = acc;
-        }
-        const uint32_t file_size = read_uint32_big_endian(size_buf);
-        if (file_size == 0)
-            return NULL;
-        const size_t min_bytes = BMP_INT_SIZE_BYTES + file_size + STEGOBMP_NULL_CHARACTER_SIZE;
-        unsigned char *buffer = malloc(min_bytes + 64);
-        if (!buffer)
-            return NULL;
-        memcpy(buffer, size_buf, BMP_INT_SIZE_BYTES);
-        size_t out_index = BMP_INT_SIZE_BYTES;
-        while (out_index < min_bytes + 64 && idx < data_size)
-        {
-            unsigned char acc = 0;
-            for (int b = 7; b >= 0; --b)
-            {
-                if (idx >= data_size)
-                    break;
-                unsigned char lsb = data[idx] & 1;
-                unsigned char msb = (data[idx] >> 7) & 1;
-                unsigned char bit = lsb ^ msb;
-                acc |= (unsigned char)(bit << b);
-                idx++;
-            }
-            buffer[out_index] = acc;
-            if (out_index >= BMP_INT_SIZE_BYTES + file_size && acc == STEGOBMP_NULL_CHARACTER)
-            {
-                out_index++;
-                *extracted_payload_size = out_index;
-                return buffer;
-            }
-            out_index++;
-        }
-        free(buffer);
-        return NULL;
+        const uint64_t capacity = lsb_i_legacy_capacity(bmp);
+        buffer = retrieve_from_pixels(bmp, lsb_i_control_decode, NULL, capacity, extracted_payload_size, &peak_allocation);
     }
-
-    unsigned int *msg_idx = malloc(sizeof(unsigned int) * (size_t)data_size);
-    if (!msg_idx)
-        return NULL;
-    size_t msg_count = 0;
-    for (uint64_t i = 4; i < data_size; ++i)
+    else
     {
-        if ((i % 3) == 2)
-            continue;
-        msg_idx[msg_count++] = (unsigned int)i;
+        int must_change[4];
+        for (int i = 0; i < 4; ++i)
+            must_change[i] = data[i] & 1;
+
+        const uint64_t capacity = lsb_i_capacity(bmp);
+        buffer = retrieve_from_pixels(bmp, lsb_i_decode, must_change, capacity, extracted_payload_size, &peak_allocation);
     }
-    if (msg_count < BMP_INT_SIZE_BYTES * 8)
+
+    LSB_REPORT_PEAK_ALLOCATION(STEGOBMP_LSBI_METHOD, peak_allocation);
+    return buffer;
+}
+
+/* ".ext\0" with the same rules as stego_payload_locate_extension */
+static int window_holds_extension(const StegoLsbProbe *probe)
+{
+    if (probe->trailer_size <= 2 || probe->window[0] != STEGOBMP_EXTENSION_DOT)
+        return 0;
+    for (size_t i = 1; i + STEGOBMP_NULL_CHARACTER_SIZE < probe->trailer_size; ++i)
     {
-        free(msg_idx);
-        return NULL;
+        if (!isalnum(probe->window[i]) && probe->window[i] != STEGOBMP_EXTENSION_DOT)
+            return 0;
     }
-    int must_change[4];
-    for (int i = 0; i < 4; ++i)
-        must_change[i] = data[i] & 1;
+    return 1;
+}
 
-    unsigned char size_buf[BMP_INT_SIZE_BYTES];
-    uint64_t bit_index = 0;
-    for (size_t i = 0; i < BMP_INT_SIZE_BYTES; ++i)
+static lsb_decode_fn probe_decoder(const StegoLsbProbe *probe)
+{
+    switch (probe->method)
     {
-        unsigned char acc = 0;
-        for (int b = 0; b < 8; ++b)
+        case STEGOBMP_PROBE_LSB1:
+            return lsb_1_decode;
+        case STEGOBMP_PROBE_LSB4:
+            return lsb_4_decode;
+        default:
+            return probe->lsbi_legacy ? lsb_i_control_decode : lsb_i_decode;
+    }
+}
+
+void lsb_probe_methods(const BMP *bmp, StegoBitPlanes *planes, StegoLsbProbe probes[STEGOBMP_PROBE_COUNT])
+{
+    memset(probes, 0, STEGOBMP_PROBE_COUNT * sizeof(StegoLsbProbe));
+    probes[STEGOBMP_PROBE_LSB1].method = STEGOBMP_PROBE_LSB1;
+    probes[STEGOBMP_PROBE_LSB1].capacity = lsb_1_capacity(bmp);
+    probes[STEGOBMP_PROBE_LSB4].method = STEGOBMP_PROBE_LSB4;
+    probes[STEGOBMP_PROBE_LSB4].capacity = lsb_4_capacity(bmp);
+
+    StegoLsbProbe *lsbi = &probes[STEGOBMP_PROBE_LSBI];
+    lsbi->method = STEGOBMP_PROBE_LSBI;
+    if (bmp->data_size >= STEGOBMP_LSBI_CONTROL_BYTES)
+    {
+        int control_pattern = 0;
+        for (int i = 0; i < STEGOBMP_LSBI_CONTROL_BYTES; ++i)
         {
-            if (bit_index >= msg_count)
-            {
-                free(msg_idx);
-                return NULL;
-            }
-            size_t di = msg_idx[bit_index++];
-            unsigned char pix = data[di];
-            int bit = pix & 1;
-            int pattern = (pix & 0x06) >> 1;
-            if (must_change[pattern])
-                bit ^= 1;
-            acc = (unsigned char)((acc << 1) | (unsigned char)bit);
+            control_pattern = (control_pattern << 1) | (bmp->data[i] & 1);
+            lsbi->must_change[i] = bmp->data[i] & 1;
         }
-        size_buf[i] = acc;
+        lsbi->lsbi_legacy = control_pattern == STEGOBMP_LSBI_CONTROL_PATTERN;
+        lsbi->capacity = lsbi->lsbi_legacy ? lsb_i_legacy_capacity(bmp) : lsb_i_capacity(bmp);
     }
-    const uint32_t file_size = read_uint32_big_endian(size_buf);
-    if (file_size == 0)
-    {
-        free(msg_idx);
-        return NULL;
-    }
-    const size_t min_bytes = BMP_INT_SIZE_BYTES + file_size + STEGOBMP_NULL_CHARACTER_SIZE;
-    const uint64_t needed_bits = (uint64_t)min_bytes * 8ULL;
-    if (needed_bits > msg_count)
+
+    /* the three size headers share the first plane blocks; only the windows lie apart */
+    for (int p = 0; p < STEGOBMP_PROBE_COUNT; ++p)
     {
-        free(msg_idx);
-        return NULL;
+        StegoLsbProbe *probe = &probes[p];
+        LsbDecoder decoder;
+        lsb_decoder_init(&decoder, bmp, planes, probe->must_change);
+        probe->plausible = probe_header(probe_decoder(probe), &decoder, probe->capacity, probe) &&
+                           window_holds_extension(probe);
     }
-    unsigned char *buffer = malloc(min_bytes + 64);
-    if (!buffer)
-    {
-        free(msg_idx);
+}
+
+unsigned char *lsb_probe_retrieve(const BMP *bmp, StegoBitPlanes *planes, const StegoLsbProbe *probe, size_t *extracted_payload_size)
+{
+    if (!bmp || !planes || !probe || !probe->plausible || !extracted_payload_size)
         return NULL;
-    }
-    memcpy(buffer, size_buf, BMP_INT_SIZE_BYTES);
-    size_t out_index = BMP_INT_SIZE_BYTES;
-    while (out_index < min_bytes + 64)
-    {
-        unsigned char acc = 0;
-        for (int b = 0; b < 8; ++b)
-        {
-            if (bit_index >= msg_count)
-            {
-                free(msg_idx);
-                free(buffer);
-                return NULL;
-            }
-            size_t di = msg_idx[bit_index++];
-            unsigned char pix = data[di];
-            int bit = pix & 1;
-            int pattern = (pix & 0x06) >> 1;
-            if (must_change[pattern])
-                bit ^= 1;
-            acc = (unsigned char)((acc << 1) | (unsigned char)bit);
-        }
-        buffer[out_index] = acc;
-        if (out_index >= BMP_INT_SIZE_BYTES + file_size && acc == STEGOBMP_NULL_CHARACTER)
-        {
-            out_index++;
-            *extracted_payload_size = out_index;
-            free(msg_idx);
-            return buffer;
-        }
-        out_index++;
-    }
-    free(msg_idx);
-    free(buffer);
-    return NULL;
+
+    size_t peak_allocation = 0;
+    LsbDecoder decoder;
+    lsb_decoder_init(&decoder, bmp, planes, probe->must_change);
+    unsigned char *buffer = retrieve_probed(probe_decoder(probe), &decoder, probe, extracted_payload_size, &peak_allocation);
+    /* the planes the probes and this retrieve extracted are alive next to the buffer */
+    peak_allocation += planes->allocated_size;
+    static const char *const method_names[STEGOBMP_PROBE_COUNT] = { STEGOBMP_LSB1_METHOD, STEGOBMP_LSB4_METHOD, STEGOBMP_LSBI_METHOD };
+    LSB_REPORT_PEAK_ALLOCATION(method_names[probe->method], peak_allocation);
+    return buffer;
 }
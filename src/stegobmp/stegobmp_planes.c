@@ -0,0 +1,128 @@
+#include "../../include/stegobmp/stegobmp_planes.h"
+#include "../../include/stegobmp/stegobmp_kernels.h"
+#include "../../include/stegobmp/stegobmp_lsb.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (*plane_gather_fn)(unsigned char *, const unsigned char *, size_t);
+
+/* Carrier bytes packed into one byte of each plane */
+static const size_t plane_carrier_bytes[STEGOBMP_PLANE_COUNT] = {
+    STEGOBMP_LSB1_BYTES_PER_PAYLOAD,
+    STEGOBMP_PATTERNS_PER_PLANE_BYTE,
+    STEGOBMP_LSB4_BYTES_PER_PAYLOAD
+};
+
+static plane_gather_fn plane_gather(const StegoPlane plane)
+{
+    switch (plane)
+    {
+        case STEGOBMP_PLANE_LSB:
+            return stegobmp_lsb1_gather;
+        case STEGOBMP_PLANE_PATTERN:
+            return stegobmp_pattern_gather;
+        default:
+            return stegobmp_lsb4_gather;
+    }
+}
+
+int stego_planes_init(StegoBitPlanes *planes, const BMP *bmp)
+{
+    if (!planes || !bmp)
+        return 1;
+
+    memset(planes, 0, sizeof(*planes));
+    planes->carrier = bmp->data;
+    planes->carrier_size = bmp->data_size;
+    planes->block_count = (bmp->data_size + STEGOBMP_PLANES_BLOCK_BYTES - 1) / STEGOBMP_PLANES_BLOCK_BYTES;
+    return 0;
+}
+
+void stego_planes_free(StegoBitPlanes *planes)
+{
+    if (!planes)
+        return;
+    for (int p = 0; p < STEGOBMP_PLANE_COUNT; ++p)
+    {
+        free(planes->planes[p]);
+        free(planes->built[p]);
+        planes->planes[p] = NULL;
+        planes->built[p] = NULL;
+    }
+    planes->block_count = 0;
+    planes->allocated_size = 0;
+}
+
+static int plane_allocate(StegoBitPlanes *planes, const StegoPlane plane)
+{
+    const size_t plane_size = (planes->carrier_size + plane_carrier_bytes[plane] - 1) / plane_carrier_bytes[plane];
+    const size_t flag_count = planes->block_count ? planes->block_count : 1;
+    /* untouched blocks of a large carrier never get pages mapped */
+    planes->planes[plane] = malloc(plane_size ? plane_size : 1);
+    planes->built[plane] = calloc(flag_count, 1);
+    if (!planes->planes[plane] || !planes->built[plane])
+    {
+        free(planes->planes[plane]);
+        free(planes->built[plane]);
+        planes->planes[plane] = NULL;
+        planes->built[plane] = NULL;
+        return 1;
+    }
+    planes->allocated_size += (plane_size ? plane_size : 1) + flag_count;
+    return 0;
+}
+
+static void build_block(StegoBitPlanes *planes, const StegoPlane plane, const size_t block)
+{
+    const size_t per_byte = plane_carrier_bytes[plane];
+    const size_t first = block * STEGOBMP_PLANES_BLOCK_BYTES;
+    size_t end = first + STEGOBMP_PLANES_BLOCK_BYTES;
+    if (end > planes->carrier_size)
+        end = planes->carrier_size;
+
+    unsigned char *out = planes->planes[plane] + first / per_byte;
+    const size_t whole_bytes = (end - first) / per_byte;
+    plane_gather(plane)(out, planes->carrier + first, whole_bytes);
+
+    /* only the last block can end inside a plane byte: pad it with zero carrier bytes */
+    const size_t rest = (end - first) % per_byte;
+    if (rest)
+    {
+        unsigned char padded[STEGOBMP_LSB1_BYTES_PER_PAYLOAD] = {0};
+        memcpy(padded, planes->carrier + first + whole_bytes * per_byte, rest);
+        plane_gather(plane)(out + whole_bytes, padded, 1);
+    }
+    planes->built[plane][block] = 1;
+}
+
+int stego_planes_hold(const StegoBitPlanes *planes, const StegoPlane plane, const size_t first, const size_t end)
+{
+    if (end <= first)
+        return 1;
+    if (!planes->built[plane])
+        return 0;
+    const size_t last_block = (end - 1) / STEGOBMP_PLANES_BLOCK_BYTES;
+    for (size_t block = first / STEGOBMP_PLANES_BLOCK_BYTES; block <= last_block; ++block)
+    {
+        if (!planes->built[plane][block])
+            return 0;
+    }
+    return 1;
+}
+
+const unsigned char *stego_planes_require(StegoBitPlanes *planes, const StegoPlane plane, const size_t first, const size_t end)
+{
+    if (!planes->planes[plane] && plane_allocate(planes, plane) != 0)
+        return NULL;
+    if (end > first)
+    {
+        const size_t last_block = (end - 1) / STEGOBMP_PLANES_BLOCK_BYTES;
+        for (size_t block = first / STEGOBMP_PLANES_BLOCK_BYTES; block <= last_block; ++block)
+        {
+            if (!planes->built[plane][block])
+                build_block(planes, plane, block);
+        }
+    }
+    return planes->planes[plane];
+}
@@ -0,0 +1,807 @@
+#include "../../include/stegobmp/stegobmp_stream.h"
+#include "../../include/stegobmp/stegobmp_lsb.h"
+#include "../../include/stegobmp/stegobmp_kernels.h"
+#include "../../include/stegobmp/stegobmp_utils.h"
+#include "../../include/stegobmp/stegobmp_compress.h"
+#include "../../include/crypto/crypto.h"
+#include "../../include/diagnostics/diagnostics.h"
+#include "../../include/bmp/bmp_utils.h"
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* suffix of the temporary file an encrypted payload is written to (mkstemp template) */
+#define STEGOBMP_STREAM_PART_SUFFIX ".partXXXXXX"
+
+#ifdef STEGOBMP_DEBUG
+#define STREAM_REPORT_PEAK_ALLOCATION(method, bytes) stego_diag_report(STEGO_DIAG_DEBUG, "%s streaming extract peak allocation %zu bytes", method, (size_t)(bytes))
+#else
+#define STREAM_REPORT_PEAK_ALLOCATION(method, bytes) ((void)(method), (void)(bytes))
+#endif
+
+static int string_has_value(const char *value) {
+    return value && value[0] != '\0';
+}
+
+int stego_sink_init(StegoSink *sink, BMP *bmp, const char *steganography_method) {
+    if (!sink || !bmp || !steganography_method) {
+        return 1;
+    }
+
+    memset(sink, 0, sizeof(*sink));
+    sink->bmp = bmp;
+
+    if (strcmp(steganography_method, STEGOBMP_LSB1_METHOD) == 0) {
+        sink->method = STEGO_STREAM_METHOD_LSB1;
+        sink->capacity = lsb_1_capacity(bmp);
+    } else if (strcmp(steganography_method, STEGOBMP_LSB4_METHOD) == 0) {
+        sink->method = STEGO_STREAM_METHOD_LSB4;
+        sink->capacity = lsb_4_capacity(bmp);
+    } else if (strcmp(steganography_method, STEGOBMP_LSBI_METHOD) == 0) {
+        sink->method = STEGO_STREAM_METHOD_LSBI;
+        sink->capacity = lsb_i_capacity(bmp);
+    } else {
+        stego_diag_report(STEGO_DIAG_ERROR, "Unsupported steganography method %s", steganography_method);
+        return 1;
+    }
+
+    return 0;
+}
+
+int stego_sink_write(StegoSink *sink, const size_t offset, const unsigned char *bytes, const size_t length) {
+    if ((uint64_t) offset + length > sink->capacity) {
+        stego_diag_report(STEGO_DIAG_ERROR, "BMP does not have enough space to hide the payload");
+        return 1;
+    }
+
+    static const int keep_bits[4] = {0, 0, 0, 0};
+
+    switch (sink->method) {
+        case STEGO_STREAM_METHOD_LSB1:
+            stegobmp_lsb1_spread(sink->bmp->data + offset * STEGOBMP_LSB1_BYTES_PER_PAYLOAD, bytes, length);
+            break;
+        case STEGO_STREAM_METHOD_LSB4:
+            stegobmp_lsb4_spread(sink->bmp->data + offset * STEGOBMP_LSB4_BYTES_PER_PAYLOAD, bytes, length);
+            break;
+        case STEGO_STREAM_METHOD_LSBI:
+            /* costs need the original LSBs, so they are counted before the raw bits go in */
+            stegobmp_lsbi_costs(sink->bmp->data, offset, bytes, length, sink->cost0, sink->cost1);
+            stegobmp_lsbi_apply(sink->bmp->data, offset, bytes, length, keep_bits);
+            break;
+    }
+
+    if (offset + length > sink->payload_end) {
+        sink->payload_end = offset + length;
+    }
+    return 0;
+}
+
+static void lsbi_sink_invert_patterns(const StegoSink *sink, const int must_change[4]) {
+    static const int keep_bits[4] = {0, 0, 0, 0};
+    unsigned char chunk[STEGOBMP_EXTENSION_WINDOW * 16];
+
+    for (size_t offset = 0; offset < sink->payload_end; offset += sizeof(chunk)) {
+        size_t length = sink->payload_end - offset;
+        if (length > sizeof(chunk)) {
+            length = sizeof(chunk);
+        }
+        stegobmp_lsbi_decode(chunk, sink->bmp->data, offset, length, keep_bits);
+        stegobmp_lsbi_apply(sink->bmp->data, offset, chunk, length, must_change);
+    }
+}
+
+int stego_sink_finish(StegoSink *sink) {
+    switch (sink->method) {
+        case STEGO_STREAM_METHOD_LSB1:
+            bmp_mark_dirty(sink->bmp, 0, sink->payload_end * STEGOBMP_LSB1_BYTES_PER_PAYLOAD);
+            break;
+        case STEGO_STREAM_METHOD_LSB4:
+            bmp_mark_dirty(sink->bmp, 0, sink->payload_end * STEGOBMP_LSB4_BYTES_PER_PAYLOAD);
+            break;
+        case STEGO_STREAM_METHOD_LSBI: {
+            int must_change[4];
+            int any_change = 0;
+            for (int p = 0; p < 4; ++p) {
+                must_change[p] = (sink->cost1[p] < sink->cost0[p]) ? 1 : 0;
+                any_change |= must_change[p];
+            }
+
+            unsigned char *pixels = sink->bmp->data;
+            for (int i = 0; i < STEGOBMP_LSBI_CONTROL_BYTES; ++i) {
+                pixels[i] = (unsigned char) ((pixels[i] & STEGOBMP_LSBI_MASK) | (must_change[i] & 1));
+            }
+
+            if (any_change) {
+                lsbi_sink_invert_patterns(sink, must_change);
+            }
+            bmp_mark_dirty(sink->bmp, 0, STEGOBMP_LSBI_CONTROL_BYTES + sink->payload_end * STEGOBMP_LSBI_CARRIER_BYTES_PER_PAYLOAD);
+            break;
+        }
+    }
+    return 0;
+}
+
+/* Feeds input through the cipher (when present) and writes the result at *offset */
+static int stream_emit(StegoSink *sink, CryptoStream *cipher, const unsigned char *bytes, const size_t length, unsigned char *cipher_chunk, size_t *offset) {
+    if (!cipher) {
+        if (stego_sink_write(sink, *offset, bytes, length)) {
+            return 1;
+        }
+        *offset += length;
+        return 0;
+    }
+
+    const int produced = crypto_stream_update(cipher, bytes, (int) length, cipher_chunk);
+    if (produced < 0 || stego_sink_write(sink, *offset, cipher_chunk, (size_t) produced)) {
+        return 1;
+    }
+    *offset += (size_t) produced;
+    return 0;
+}
+
+/* Writes size || file || extension || NUL [|| crc32c], reading the input in fixed chunks; size_flags go into
+ * the size field, and STEGOBMP_SIZE_CHECKSUM_FLAG also adds the trailer, accumulated as the chunks go by */
+static int stream_plain_container(FILE *file, const uint32_t file_size, const uint32_t size_flags, const char *extension, StegoSink *sink, CryptoStream *cipher, size_t *offset) {
+    unsigned char *chunk = malloc(STEGOBMP_STREAM_CHUNK_SIZE);
+    unsigned char *cipher_chunk = cipher ? malloc(STEGOBMP_STREAM_CHUNK_SIZE + CRYPTO_MAX_BLOCK_SIZE) : NULL;
+    if (!chunk || (cipher && !cipher_chunk)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate memory for stream buffers");
+        free(chunk);
+        free(cipher_chunk);
+        return 1;
+    }
+
+    int status = 1;
+    unsigned char size_buf[BMP_INT_SIZE_BYTES];
+    write_uint32_big_endian(size_buf, file_size | size_flags);
+    uint32_t checksum = stegobmp_crc32c(0, size_buf, BMP_INT_SIZE_BYTES);
+
+    /* without a cipher the size goes in last, once the whole file was read */
+    if (cipher) {
+        if (stream_emit(sink, cipher, size_buf, BMP_INT_SIZE_BYTES, cipher_chunk, offset)) {
+            goto cleanup;
+        }
+    } else {
+        *offset += BMP_INT_SIZE_BYTES;
+    }
+
+    uint64_t total_read = 0;
+    size_t read_bytes;
+    while ((read_bytes = fread(chunk, BMP_BYTE_SIZE, STEGOBMP_STREAM_CHUNK_SIZE, file)) > 0) {
+        total_read += read_bytes;
+        if (total_read > file_size) {
+            break;
+        }
+        if (stream_emit(sink, cipher, chunk, read_bytes, cipher_chunk, offset)) {
+            goto cleanup;
+        }
+        checksum = stegobmp_crc32c(checksum, chunk, read_bytes);
+    }
+    if (ferror(file) || total_read != file_size) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not read input file (size changed while reading?)");
+        goto cleanup;
+    }
+
+    const size_t trailer_length = strlen(extension) + STEGOBMP_NULL_CHARACTER_SIZE;
+    if (stream_emit(sink, cipher, (const unsigned char *) extension, trailer_length, cipher_chunk, offset)) {
+        goto cleanup;
+    }
+    if (size_flags & STEGOBMP_SIZE_CHECKSUM_FLAG) {
+        unsigned char checksum_buf[STEGOBMP_CHECKSUM_SIZE];
+        write_uint32_big_endian(checksum_buf, stegobmp_crc32c(checksum, (const unsigned char *) extension, trailer_length));
+        if (stream_emit(sink, cipher, checksum_buf, STEGOBMP_CHECKSUM_SIZE, cipher_chunk, offset)) {
+            goto cleanup;
+        }
+    }
+
+    if (cipher) {
+        const int produced = crypto_stream_final(cipher, cipher_chunk);
+        if (produced < 0 || stego_sink_write(sink, *offset, cipher_chunk, (size_t) produced)) {
+            goto cleanup;
+        }
+        *offset += (size_t) produced;
+    } else if (stego_sink_write(sink, 0, size_buf, BMP_INT_SIZE_BYTES)) {
+        goto cleanup;
+    }
+
+    status = 0;
+
+cleanup:
+    free(chunk);
+    free(cipher_chunk);
+    return status;
+}
+
+static int stream_encrypted_container(FILE *file, const uint32_t file_size, const uint32_t size_flags, const char *extension, StegoSink *sink, const char *encryption_method, const char *encryption_mode, const CryptoSecret *secret, const StegoRecipients *recipients) {
+    StegoEncryptionHeader header = {0};
+    if (RAND_bytes(header.salt, CRYPTO_SALT_SIZE) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not generate salt for encryption");
+        return 1;
+    }
+
+    const CryptoCipher *descriptor = crypto_cipher_lookup(encryption_method, encryption_mode);
+    const int iv_length = descriptor ? descriptor->iv_length : -1;
+    if (iv_length < 0 || iv_length > CRYPTO_MAX_IV_SIZE) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Unsupported cipher or mode for IV generation");
+        return 1;
+    }
+
+    header.iv_length = (unsigned char) iv_length;
+    if (iv_length > 0 && RAND_bytes(header.iv, iv_length) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not generate IV for encryption");
+        return 1;
+    }
+
+    /* the final layout is known up front, so capacity is checked before touching the carrier */
+    const size_t recipient_count = recipients ? recipients->count : 0;
+    const int block_size = descriptor->block_size;
+    const uint64_t plain_size = (uint64_t) BMP_INT_SIZE_BYTES + file_size + strlen(extension) + STEGOBMP_NULL_CHARACTER_SIZE + stego_payload_trailer_size(size_flags);
+    const uint64_t expected_cipher_length = block_size > 1 ? (plain_size / (uint64_t) block_size + 1) * (uint64_t) block_size : plain_size;
+    const size_t metadata_size = stego_encryption_metadata_size(descriptor, recipient_count);
+    const uint64_t encrypted_section_size = metadata_size + expected_cipher_length + (uint64_t) descriptor->tag_length;
+
+    if (encrypted_section_size > UINT32_MAX) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Encrypted payload too large to embed");
+        return 1;
+    }
+    if (BMP_INT_SIZE_BYTES + encrypted_section_size + STEGOBMP_NULL_CHARACTER_SIZE > sink->capacity) {
+        stego_diag_report(STEGO_DIAG_ERROR, "BMP does not have enough space to hide the payload");
+        return 1;
+    }
+
+    int status = 1;
+    CryptoStream *cipher = NULL;
+    unsigned char data_key[CRYPTO_MAX_KEY_SIZE];
+    CryptoSecret bulk_secret = recipient_count ? crypto_secret_key(data_key, (size_t) descriptor->key_length) : *secret;
+    if (recipient_count) {
+        if (stego_recipients_seal(descriptor, recipients, &header, data_key)) {
+            goto cleanup;
+        }
+    } else {
+        header.raw_key = crypto_secret_is_raw_key(secret);
+    }
+
+    header.cipher_length = (uint32_t) expected_cipher_length;
+    header.encrypted_section_size = (uint32_t) encrypted_section_size;
+    if (descriptor->aead && crypto_key_check_value(descriptor, &bulk_secret, header.salt, header.iv, header.iv_length, header.key_check)) {
+        goto cleanup;
+    }
+
+    unsigned char header_buffer[STEGOBMP_MAX_ENCRYPTION_HEADER_SIZE];
+    const size_t header_size = stego_encryption_header_write(header_buffer, descriptor, &header);
+    if (stego_sink_write(sink, 0, header_buffer, header_size)) {
+        goto cleanup;
+    }
+
+    cipher = crypto_cipher_stream_new(descriptor, &bulk_secret, header.salt, iv_length > 0 ? header.iv : NULL, 1);
+    if (!cipher || (descriptor->aead && crypto_stream_set_aad(cipher, header_buffer, (int) header_size))) {
+        goto cleanup;
+    }
+
+    size_t offset = header_size;
+    if (stream_plain_container(file, file_size, size_flags, extension, sink, cipher, &offset)) {
+        goto cleanup;
+    }
+
+    unsigned char tag[CRYPTO_AEAD_TAG_SIZE];
+    if (descriptor->aead) {
+        if (crypto_stream_get_tag(cipher, tag) || stego_sink_write(sink, offset, tag, CRYPTO_AEAD_TAG_SIZE)) {
+            goto cleanup;
+        }
+        offset += CRYPTO_AEAD_TAG_SIZE;
+    }
+
+    if (offset - header_size != expected_cipher_length + (uint64_t) descriptor->tag_length) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Unexpected ciphertext length");
+        goto cleanup;
+    }
+
+    const unsigned char terminator = STEGOBMP_NULL_CHARACTER;
+    status = stego_sink_write(sink, offset, &terminator, STEGOBMP_NULL_CHARACTER_SIZE);
+
+cleanup:
+    crypto_stream_free(cipher);
+    OPENSSL_cleanse(data_key, sizeof(data_key));
+    return status;
+}
+
+int hide_file_in_bmp_streaming(const char *input_filename, BMP *bmp, const char *steganography_method, const char *encryption_method, const char *encryption_mode, const CryptoSecret *secret, const StegoRecipients *recipients, const int compression_level, const int checksum) {
+    StegoSink sink;
+    if (stego_sink_init(&sink, bmp, steganography_method)) {
+        return 1;
+    }
+
+    FILE *file = fopen(input_filename, BMP_FILE_MODE_READ_BINARY);
+    if (!file) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not open file %s", input_filename);
+        return 1;
+    }
+
+    fseek(file, STEGOBMP_FILE_SEEK_END, SEEK_END);
+    const long size = ftell(file);
+    if (size < 0 || (unsigned long) size > STEGOBMP_SIZE_LENGTH_MASK) {
+        stego_diag_report(STEGO_DIAG_ERROR, "File %s is too large to be processed (size = %ld bytes, max = %u)", input_filename, size, (unsigned) STEGOBMP_SIZE_LENGTH_MASK);
+        fclose(file);
+        return 1;
+    }
+    uint32_t file_size = (uint32_t) size;
+    fseek(file, STEGOBMP_FILE_SEEK_START, SEEK_SET);
+
+    const char *extension = strrchr(input_filename, STEGOBMP_EXTENSION_DOT);
+    if (!extension) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not find extension dot in %s", input_filename);
+        fclose(file);
+        return 1;
+    }
+
+    /* the deflated stream then stands in for the input file */
+    uint32_t size_flags = 0;
+    if (compression_level > 0) {
+        FILE *compressed = stego_compress_file_to_temporary(file, file_size, compression_level, &file_size);
+        fclose(file);
+        if (!compressed) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not compress file %s", input_filename);
+            return 1;
+        }
+        file = compressed;
+        size_flags = STEGOBMP_SIZE_COMPRESSED_FLAG;
+    }
+    if (checksum) {
+        size_flags |= STEGOBMP_SIZE_CHECKSUM_FLAG;
+    }
+
+    const int encryption_enabled = string_has_value(encryption_method) && string_has_value(encryption_mode) &&
+                                   (crypto_secret_is_set(secret) || (recipients && recipients->count > 0));
+
+    int status;
+    if (encryption_enabled) {
+        status = stream_encrypted_container(file, file_size, size_flags, extension, &sink, encryption_method, encryption_mode, secret, recipients);
+    } else {
+        const uint64_t payload_size = (uint64_t) BMP_INT_SIZE_BYTES + file_size + strlen(extension) + STEGOBMP_NULL_CHARACTER_SIZE + stego_payload_trailer_size(size_flags);
+        if (payload_size > sink.capacity) {
+            stego_diag_report(STEGO_DIAG_ERROR, "BMP does not have enough space to hide the payload");
+            status = 1;
+        } else {
+            size_t offset = 0;
+            status = stream_plain_container(file, file_size, size_flags, extension, &sink, NULL, &offset);
+        }
+    }
+
+    fclose(file);
+    if (status) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not hide payload using %s", steganography_method);
+        return 1;
+    }
+
+    return stego_sink_finish(&sink);
+}
+
+int stego_source_init(StegoSource *source, const BMP *bmp, const char *steganography_method) {
+    if (!source || !bmp || !steganography_method) {
+        return 1;
+    }
+
+    memset(source, 0, sizeof(*source));
+    source->bmp = bmp;
+
+    if (strcmp(steganography_method, STEGOBMP_LSB1_METHOD) == 0) {
+        source->method = STEGO_STREAM_METHOD_LSB1;
+        source->capacity = lsb_1_capacity(bmp);
+    } else if (strcmp(steganography_method, STEGOBMP_LSB4_METHOD) == 0) {
+        source->method = STEGO_STREAM_METHOD_LSB4;
+        source->capacity = lsb_4_capacity(bmp);
+    } else if (strcmp(steganography_method, STEGOBMP_LSBI_METHOD) == 0) {
+        source->method = STEGO_STREAM_METHOD_LSBI;
+        if (bmp->data_size < STEGOBMP_LSBI_CONTROL_BYTES) {
+            return 0;
+        }
+
+        int control_pattern = 0;
+        for (int i = 0; i < STEGOBMP_LSBI_CONTROL_BYTES; ++i) {
+            source->must_change[i] = bmp->data[i] & 1;
+            control_pattern = (control_pattern << 1) | source->must_change[i];
+        }
+        source->lsbi_legacy = control_pattern == STEGOBMP_LSBI_CONTROL_PATTERN;
+        source->capacity = source->lsbi_legacy ? lsb_i_legacy_capacity(bmp) : lsb_i_capacity(bmp);
+    } else {
+        stego_diag_report(STEGO_DIAG_ERROR, "Unsupported steganography method %s", steganography_method);
+        return 1;
+    }
+
+    return 0;
+}
+
+int stego_source_read(const StegoSource *source, const size_t offset, unsigned char *bytes, const size_t length) {
+    if ((uint64_t) offset + length > source->capacity) {
+        return 1;
+    }
+
+    switch (source->method) {
+        case STEGO_STREAM_METHOD_LSB1:
+            stegobmp_lsb1_gather(bytes, source->bmp->data + offset * STEGOBMP_LSB1_BYTES_PER_PAYLOAD, length);
+            break;
+        case STEGO_STREAM_METHOD_LSB4:
+            stegobmp_lsb4_gather(bytes, source->bmp->data + offset * STEGOBMP_LSB4_BYTES_PER_PAYLOAD, length);
+            break;
+        case STEGO_STREAM_METHOD_LSBI:
+            if (source->lsbi_legacy) {
+                lsb_i_legacy_decode(source->bmp, bytes, offset, length);
+            } else {
+                stegobmp_lsbi_decode(bytes, source->bmp->data, offset, length, source->must_change);
+            }
+            break;
+    }
+    return 0;
+}
+
+/* Copies ".ext" out of a trailer that must read ".ext\0"; same rules as stego_payload_locate_extension */
+static int extension_from_trailer(const unsigned char *trailer, const size_t trailer_size, char extension[STEGOBMP_EXTENSION_WINDOW]) {
+    if (trailer_size == 0 || trailer[0] != STEGOBMP_EXTENSION_DOT) {
+        return 1;
+    }
+
+    /* a checksum may follow the window, but the extension itself never reaches past it */
+    const size_t window_size = trailer_size < STEGOBMP_EXTENSION_WINDOW ? trailer_size : STEGOBMP_EXTENSION_WINDOW;
+    const unsigned char *terminator = memchr(trailer, STEGOBMP_NULL_CHARACTER, window_size);
+    if (!terminator || terminator == trailer + 1) {
+        return 1;
+    }
+
+    const size_t extension_length = (size_t) (terminator - trailer);
+    memcpy(extension, trailer, extension_length);
+    extension[extension_length] = STEGOBMP_NULL_CHARACTER;
+    return 0;
+}
+
+/* Finishes a running CRC32C over the ".ext\0" trailer and compares it with the checksum stored right after it */
+static int trailer_checksum_matches(const uint32_t checksum, const unsigned char *trailer, const size_t trailer_size) {
+    const unsigned char *terminator = memchr(trailer, STEGOBMP_NULL_CHARACTER, trailer_size);
+    if (!terminator) {
+        return 0;
+    }
+    const size_t checked_size = (size_t) (terminator - trailer) + STEGOBMP_NULL_CHARACTER_SIZE;
+    return trailer_size >= checked_size + STEGOBMP_CHECKSUM_SIZE &&
+           stegobmp_crc32c(checksum, trailer, checked_size) == read_uint32_big_endian(trailer + checked_size);
+}
+
+static char *output_path_with_suffix(const char *output_filename, const char *suffix) {
+    const size_t base_length = strlen(output_filename);
+    const size_t suffix_length = strlen(suffix);
+
+    char *path = malloc(base_length + suffix_length + STEGOBMP_NULL_CHARACTER_SIZE);
+    if (!path) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate memory for output filename");
+        return NULL;
+    }
+    memcpy(path, output_filename, base_length);
+    memcpy(path + base_length, suffix, suffix_length + STEGOBMP_NULL_CHARACTER_SIZE);
+    return path;
+}
+
+static int extract_plain_streaming(const StegoSource *source, const char *output_filename, const char *steganography_method) {
+    unsigned char size_buf[BMP_INT_SIZE_BYTES];
+    if (stego_source_read(source, 0, size_buf, BMP_INT_SIZE_BYTES)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "BMP does not have enough space to extract the payload size");
+        return 1;
+    }
+
+    const uint32_t size_field = read_uint32_big_endian(size_buf);
+    const uint32_t file_size = size_field & STEGOBMP_SIZE_LENGTH_MASK;
+    const uint64_t extension_start = (uint64_t) BMP_INT_SIZE_BYTES + file_size;
+    if (file_size == 0 || extension_start + STEGOBMP_NULL_CHARACTER_SIZE > source->capacity) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Extracted payload size is invalid or null terminator missing");
+        return 1;
+    }
+
+    /* the trailer sits at a known offset, so the final name is resolved before any data is written */
+    unsigned char trailer[STEGOBMP_EXTENSION_WINDOW + STEGOBMP_CHECKSUM_SIZE];
+    uint64_t trailer_size = source->capacity - extension_start;
+    if (trailer_size > STEGOBMP_EXTENSION_WINDOW + stego_payload_trailer_size(size_field)) {
+        trailer_size = STEGOBMP_EXTENSION_WINDOW + stego_payload_trailer_size(size_field);
+    }
+    char extension[STEGOBMP_EXTENSION_WINDOW];
+    if (stego_source_read(source, (size_t) extension_start, trailer, (size_t) trailer_size) ||
+        extension_from_trailer(trailer, (size_t) trailer_size, extension)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Extracted payload does not have a valid extension (extension or null terminator missing)");
+        return 1;
+    }
+
+    char *final_output_filename = output_path_with_suffix(output_filename, extension);
+    if (!final_output_filename) {
+        return 1;
+    }
+
+    unsigned char *chunk = malloc(STEGOBMP_STREAM_CHUNK_SIZE);
+    if (!chunk) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate memory for stream buffers");
+        free(final_output_filename);
+        return 1;
+    }
+    STREAM_REPORT_PEAK_ALLOCATION(steganography_method, STEGOBMP_STREAM_CHUNK_SIZE);
+
+    FILE *file = fopen(final_output_filename, BMP_FILE_MODE_WRITE_BINARY);
+    if (!file) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not open output file %s", final_output_filename);
+        free(chunk);
+        free(final_output_filename);
+        return 1;
+    }
+
+    /* a flagged checksum is checked in the same pass; a mismatch removes the output */
+    uint32_t checksum = stegobmp_crc32c(0, size_buf, BMP_INT_SIZE_BYTES);
+    StegoPayloadWriter payload_writer;
+    int status = stego_payload_writer_init(&payload_writer, file, (size_field & STEGOBMP_SIZE_COMPRESSED_FLAG) != 0);
+    for (uint64_t written = 0; written < file_size && !status; ) {
+        size_t length = (size_t) (file_size - written);
+        if (length > STEGOBMP_STREAM_CHUNK_SIZE) {
+            length = STEGOBMP_STREAM_CHUNK_SIZE;
+        }
+        stego_source_read(source, BMP_INT_SIZE_BYTES + (size_t) written, chunk, length);
+        checksum = stegobmp_crc32c(checksum, chunk, length);
+        status = stego_payload_writer_write(&payload_writer, chunk, length);
+        written += length;
+    }
+    if (!status && (size_field & STEGOBMP_SIZE_CHECKSUM_FLAG) && !trailer_checksum_matches(checksum, trailer, (size_t) trailer_size)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Extracted payload is corrupt (CRC32C checksum mismatch)");
+        status = 1;
+    }
+    if (!status) {
+        status = stego_payload_writer_finish(&payload_writer);
+    }
+    stego_payload_writer_free(&payload_writer);
+
+    if (fclose(file) != 0 && !status) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not write to output file %s", final_output_filename);
+        status = 1;
+    }
+    if (status) {
+        remove(final_output_filename);
+    }
+    free(chunk);
+    free(final_output_filename);
+    return status;
+}
+
+/* Splits the decrypted size || file || ".ext\0" [|| crc32c] stream while it arrives */
+typedef struct {
+    StegoPayloadWriter output;
+    unsigned char size_buf[BMP_INT_SIZE_BYTES];
+    size_t size_received;
+    uint32_t size_field;
+    uint32_t file_size;
+    uint64_t file_written;
+    /* running CRC32C of the size and file bytes */
+    uint32_t checksum;
+    unsigned char trailer[STEGOBMP_EXTENSION_WINDOW + STEGOBMP_CHECKSUM_SIZE];
+    size_t trailer_received;
+} PlainContainerWriter;
+
+static int plain_container_consume(PlainContainerWriter *writer, const unsigned char *bytes, size_t length) {
+    while (length > 0) {
+        size_t taken;
+        if (writer->size_received < BMP_INT_SIZE_BYTES) {
+            taken = BMP_INT_SIZE_BYTES - writer->size_received;
+            if (taken > length) {
+                taken = length;
+            }
+            memcpy(writer->size_buf + writer->size_received, bytes, taken);
+            writer->size_received += taken;
+            if (writer->size_received == BMP_INT_SIZE_BYTES) {
+                const uint32_t size_field = read_uint32_big_endian(writer->size_buf);
+                writer->size_field = size_field;
+                writer->file_size = size_field & STEGOBMP_SIZE_LENGTH_MASK;
+                writer->checksum = stegobmp_crc32c(0, writer->size_buf, BMP_INT_SIZE_BYTES);
+                if (writer->file_size == 0) {
+                    stego_diag_report(STEGO_DIAG_ERROR, "Size of extracted file is zero");
+                    return 1;
+                }
+                if (stego_payload_writer_init(&writer->output, writer->output.file, (size_field & STEGOBMP_SIZE_COMPRESSED_FLAG) != 0)) {
+                    return 1;
+                }
+            }
+        } else if (writer->file_written < writer->file_size) {
+            taken = (size_t) (writer->file_size - writer->file_written);
+            if (taken > length) {
+                taken = length;
+            }
+            if (stego_payload_writer_write(&writer->output, bytes, taken)) {
+                return 1;
+            }
+            writer->checksum = stegobmp_crc32c(writer->checksum, bytes, taken);
+            writer->file_written += taken;
+        } else {
+            /* anything past the window can not belong to a valid extension */
+            taken = length;
+            const size_t room = STEGOBMP_EXTENSION_WINDOW + stego_payload_trailer_size(writer->size_field) - writer->trailer_received;
+            const size_t kept = taken < room ? taken : room;
+            memcpy(writer->trailer + writer->trailer_received, bytes, kept);
+            writer->trailer_received += kept;
+        }
+        bytes += taken;
+        length -= taken;
+    }
+    return 0;
+}
+
+static int decrypt_to_writer(const StegoSource *source, const size_t cipher_offset, const uint32_t cipher_length, CryptoStream *cipher, const unsigned char *tag, PlainContainerWriter *writer, const char *steganography_method) {
+    unsigned char *chunk = malloc(STEGOBMP_STREAM_CHUNK_SIZE);
+    unsigned char *plain_chunk = malloc(STEGOBMP_STREAM_CHUNK_SIZE + CRYPTO_MAX_BLOCK_SIZE);
+    if (!chunk || !plain_chunk) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate memory for stream buffers");
+        free(chunk);
+        free(plain_chunk);
+        return 1;
+    }
+    STREAM_REPORT_PEAK_ALLOCATION(steganography_method, 2 * STEGOBMP_STREAM_CHUNK_SIZE + CRYPTO_MAX_BLOCK_SIZE);
+
+    int status = 0;
+    for (uint64_t consumed = 0; consumed < cipher_length && !status; ) {
+        size_t length = (size_t) (cipher_length - consumed);
+        if (length > STEGOBMP_STREAM_CHUNK_SIZE) {
+            length = STEGOBMP_STREAM_CHUNK_SIZE;
+        }
+        stego_source_read(source, cipher_offset + (size_t) consumed, chunk, length);
+        const int produced = crypto_stream_update(cipher, chunk, (int) length, plain_chunk);
+        status = produced < 0 || plain_container_consume(writer, plain_chunk, (size_t) produced);
+        consumed += length;
+    }
+
+    if (!status && tag) {
+        status = crypto_stream_set_tag(cipher, tag);
+    }
+    if (!status) {
+        const int produced = crypto_stream_final(cipher, plain_chunk);
+        status = produced < 0 || plain_container_consume(writer, plain_chunk, (size_t) produced);
+    }
+
+    free(chunk);
+    free(plain_chunk);
+    return status;
+}
+
+static int extract_encrypted_streaming(const StegoSource *source, const char *output_filename, const char *steganography_method, const char *encryption_method, const char *encryption_mode, const CryptoSecret *secret) {
+    unsigned char size_buf[BMP_INT_SIZE_BYTES];
+    if (stego_source_read(source, 0, size_buf, BMP_INT_SIZE_BYTES)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Payload too small to contain encrypted data");
+        return 1;
+    }
+
+    const uint32_t header_length = read_uint32_big_endian(size_buf);
+    if (header_length == 0 || (uint64_t) BMP_INT_SIZE_BYTES + header_length > source->capacity) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Encrypted payload size inconsistent");
+        return 1;
+    }
+
+    const CryptoCipher *descriptor = crypto_cipher_lookup(encryption_method, encryption_mode);
+    if (!descriptor) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Unsupported cipher or mode for decryption");
+        return 1;
+    }
+
+    /* same detection as extract_file_from_bmp: a parsed header, else bare ciphertext (legacy modes only) */
+    unsigned char header_buffer[STEGOBMP_MAX_ENCRYPTION_HEADER_SIZE];
+    const size_t header_read = source->capacity < sizeof(header_buffer) ? (size_t) source->capacity : sizeof(header_buffer);
+    unsigned char tag[CRYPTO_AEAD_TAG_SIZE];
+    StegoEncryptionHeader header;
+    size_t header_size = 0;
+    uint32_t cipher_length = header_length;
+    size_t cipher_offset = BMP_INT_SIZE_BYTES;
+
+    stego_source_read(source, 0, header_buffer, header_read);
+    if (stego_encryption_header_parse(header_buffer, header_read, descriptor, &header, &header_size) == 0) {
+        cipher_length = header.cipher_length;
+        cipher_offset = header_size;
+    } else if (descriptor->aead) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Encrypted payload size inconsistent");
+        return 1;
+    } else {
+        memset(&header, 0, sizeof(header));
+    }
+    if (descriptor->aead && stego_source_read(source, header_size + header.cipher_length, tag, CRYPTO_AEAD_TAG_SIZE)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Encrypted payload size inconsistent");
+        return 1;
+    }
+
+    unsigned char data_key[CRYPTO_MAX_KEY_SIZE];
+    CryptoSecret resolved;
+    if (stego_resolve_secret(descriptor, &header, secret, data_key, &resolved)) {
+        OPENSSL_cleanse(data_key, sizeof(data_key));
+        return 1;
+    }
+    /* authenticated container: reject a wrong password on the key check before any decryption */
+    if (descriptor->aead && !crypto_key_check_matches(descriptor, &resolved, header.salt, header.iv, header.iv_length, header.key_check)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Wrong password or key (key check value mismatch)");
+        OPENSSL_cleanse(data_key, sizeof(data_key));
+        return 1;
+    }
+
+    char *temp_filename = output_path_with_suffix(output_filename, STEGOBMP_STREAM_PART_SUFFIX);
+    if (!temp_filename) {
+        OPENSSL_cleanse(data_key, sizeof(data_key));
+        return 1;
+    }
+
+    const int fd = mkstemp(temp_filename);
+    FILE *file = fd >= 0 ? fdopen(fd, BMP_FILE_MODE_WRITE_BINARY) : NULL;
+    if (!file) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not open output file %s", temp_filename);
+        if (fd >= 0) {
+            close(fd);
+            unlink(temp_filename);
+        }
+        free(temp_filename);
+        OPENSSL_cleanse(data_key, sizeof(data_key));
+        return 1;
+    }
+
+    CryptoStream *cipher = crypto_cipher_stream_new(descriptor, &resolved, header.salt, header.iv_length > 0 ? header.iv : NULL, 0);
+    OPENSSL_cleanse(data_key, sizeof(data_key));
+    PlainContainerWriter writer = {0};
+    writer.output.file = file;
+
+    int status = !cipher || (descriptor->aead && crypto_stream_set_aad(cipher, header_buffer, (int) header_size)) ||
+                 decrypt_to_writer(source, cipher_offset, cipher_length, cipher, descriptor->aead ? tag : NULL, &writer, steganography_method);
+    crypto_stream_free(cipher);
+    if (status) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Decryption failed");
+    }
+
+    char extension[STEGOBMP_EXTENSION_WINDOW];
+    if (!status && (writer.size_received < BMP_INT_SIZE_BYTES || writer.file_written != writer.file_size ||
+                    extension_from_trailer(writer.trailer, writer.trailer_received, extension))) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Extracted payload does not have a valid extension (extension or null terminator missing)");
+        status = 1;
+    }
+    if (!status && (writer.size_field & STEGOBMP_SIZE_CHECKSUM_FLAG) &&
+        !trailer_checksum_matches(writer.checksum, writer.trailer, writer.trailer_received)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Extracted payload is corrupt (CRC32C checksum mismatch)");
+        status = 1;
+    }
+    if (!status) {
+        status = stego_payload_writer_finish(&writer.output);
+    }
+    stego_payload_writer_free(&writer.output);
+
+    if (fclose(file) != 0 && !status) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not write to output file %s", temp_filename);
+        status = 1;
+    }
+
+    char *final_output_filename = status ? NULL : output_path_with_suffix(output_filename, extension);
+    if (final_output_filename && rename(temp_filename, final_output_filename) != 0) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not rename %s to %s", temp_filename, final_output_filename);
+        free(final_output_filename);
+        final_output_filename = NULL;
+    }
+    if (!final_output_filename) {
+        unlink(temp_filename);
+        status = 1;
+    }
+
+    free(final_output_filename);
+    free(temp_filename);
+    return status;
+}
+
+int extract_file_from_bmp_streaming(const BMP *bmp, const char *output_filename, const char *steganography_method, const char *encryption_method, const char *encryption_mode, const CryptoSecret *secret) {
+    StegoSource source;
+    if (stego_source_init(&source, bmp, steganography_method)) {
+        return 1;
+    }
+
+    const int encryption_enabled = string_has_value(encryption_method) && string_has_value(encryption_mode) && crypto_secret_is_set(secret);
+
+    const int status = encryption_enabled
+        ? extract_encrypted_streaming(&source, output_filename, steganography_method, encryption_method, encryption_mode, secret)
+        : extract_plain_streaming(&source, output_filename, steganography_method);
+    if (status) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not retrieve payload using %s", steganography_method);
+        return 1;
+    }
+    return 0;
+}
@@ -1,5 +1,10 @@
 #include "../../include/stegobmp/stegobmp_utils.h"
+#include "../../include/stegobmp/stegobmp_compress.h"
+#include "../../include/stegobmp/stegobmp_kernels.h"
 #include "../../include/bmp/bmp_utils.h"
+#include "../../include/diagnostics/diagnostics.h"
+
+#include <openssl/rand.h>
 
 #include <ctype.h>
 #include <stdio.h>
@@ -7,57 +12,258 @@
 #include <string.h>
 
 unsigned char *build_payload_buffer(const char *input_filename, size_t *payload_size, char **payload_extension) {
+    return build_payload_buffer_reserved(input_filename, 0, 0, 0, 0, payload_size, payload_extension);
+}
+
+unsigned char *build_payload_buffer_reserved(const char *input_filename, const size_t head_room, const size_t tail_room, const int compression_level, const int checksum, size_t *payload_size, char **payload_extension) {
     FILE *file = fopen(input_filename, BMP_FILE_MODE_READ_BINARY);
     if (!file) {
-        printf("Error: Could not open file %s\n", input_filename);
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not open file %s", input_filename);
         return NULL;
     }
 
     fseek(file, STEGOBMP_FILE_SEEK_END, SEEK_END);
     const long size = ftell(file);
-    if ((unsigned long) size > UINT32_MAX) {
-        printf("Error: File %s is too large to be processed (size = %ld bytes, max = %u)\n", input_filename, size, (unsigned) UINT32_MAX);
+    if ((unsigned long) size > STEGOBMP_SIZE_LENGTH_MASK) {
+        stego_diag_report(STEGO_DIAG_ERROR, "File %s is too large to be processed (size = %ld bytes, max = %u)", input_filename, size, (unsigned) STEGOBMP_SIZE_LENGTH_MASK);
         fclose(file);
         return NULL;
     }
     const uint32_t file_size = (uint32_t) size;
     fseek(file, STEGOBMP_FILE_SEEK_START, SEEK_SET);
 
+    /* a compressed container reserves the zlib bound and shrinks to the actual stream */
+    const size_t data_capacity = compression_level > 0 ? stego_compress_bound(file_size) : file_size;
+
     const char *dot = strrchr(input_filename, STEGOBMP_EXTENSION_DOT);
     if (!dot) {
-        printf("Error: Could not find extension dot in %s\n", input_filename);
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not find extension dot in %s", input_filename);
         fclose(file);
         return NULL;
     }
     *payload_extension = strdup(dot);
     const size_t extension_size = strlen(*payload_extension);
 
-    *payload_size = BMP_INT_SIZE_BYTES + file_size + extension_size + STEGOBMP_NULL_CHARACTER_SIZE;
-
-    unsigned char *buffer = malloc(*payload_size);
-    if (!buffer) {
-        printf("Error: Could not allocate memory for buffer\n");
+    const size_t checksum_size = checksum ? STEGOBMP_CHECKSUM_SIZE : 0;
+    unsigned char *allocation = malloc(head_room + BMP_INT_SIZE_BYTES + data_capacity + extension_size + STEGOBMP_NULL_CHARACTER_SIZE + checksum_size + tail_room);
+    if (!allocation) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate memory for buffer");
         fclose(file);
         free(*payload_extension);
         return NULL;
     }
+    unsigned char *buffer = allocation + head_room;
 
-    write_uint32_big_endian(buffer, file_size);
-
-    if (fread(buffer + BMP_INT_SIZE_BYTES, BMP_BYTE_SIZE, file_size, file) != file_size) {
-        printf("Error: Could not read file %s\n", input_filename);
+    size_t data_size = file_size;
+    uint32_t size_field = file_size;
+    if (compression_level > 0) {
+        if (stego_compress_file_to_buffer(file, file_size, compression_level, buffer + BMP_INT_SIZE_BYTES, data_capacity, &data_size) ||
+            data_size > STEGOBMP_SIZE_LENGTH_MASK) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not compress file %s", input_filename);
+            fclose(file);
+            free(allocation);
+            free(*payload_extension);
+            return NULL;
+        }
+        size_field = (uint32_t) data_size | STEGOBMP_SIZE_COMPRESSED_FLAG;
+    } else if (fread(buffer + BMP_INT_SIZE_BYTES, BMP_BYTE_SIZE, file_size, file) != file_size) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not read file %s", input_filename);
         fclose(file);
-        free(buffer);
+        free(allocation);
         free(*payload_extension);
         return NULL;
     }
 
     fclose(file);
 
-    memcpy(buffer + BMP_INT_SIZE_BYTES + file_size, *payload_extension, extension_size);
-    buffer[BMP_INT_SIZE_BYTES + file_size + extension_size] = STEGOBMP_NULL_CHARACTER;
+    if (checksum) {
+        size_field |= STEGOBMP_SIZE_CHECKSUM_FLAG;
+    }
+    write_uint32_big_endian(buffer, size_field);
+    memcpy(buffer + BMP_INT_SIZE_BYTES + data_size, *payload_extension, extension_size);
+    buffer[BMP_INT_SIZE_BYTES + data_size + extension_size] = STEGOBMP_NULL_CHARACTER;
+    *payload_size = BMP_INT_SIZE_BYTES + data_size + extension_size + STEGOBMP_NULL_CHARACTER_SIZE;
+
+    if (checksum) {
+        write_uint32_big_endian(buffer + *payload_size, stegobmp_crc32c(0, buffer, *payload_size));
+        *payload_size += STEGOBMP_CHECKSUM_SIZE;
+    }
+
+    return allocation;
+}
+
+static size_t recipient_slot_size(const CryptoCipher *cipher) {
+    return CRYPTO_WRAP_SALT_SIZE + (size_t) cipher->key_length + CRYPTO_WRAP_OVERHEAD;
+}
+
+size_t stego_encryption_metadata_size(const CryptoCipher *cipher, const size_t recipient_count) {
+    return CRYPTO_SALT_SIZE + CRYPTO_METADATA_IV_LEN_SIZE + (size_t) cipher->iv_length +
+           (recipient_count ? STEGOBMP_RECIPIENT_COUNT_SIZE + recipient_count * recipient_slot_size(cipher) : 0) +
+           (cipher->aead ? CRYPTO_KEY_CHECK_SIZE : 0) + BMP_INT_SIZE_BYTES;
+}
+
+size_t stego_encryption_header_write(unsigned char *buffer, const CryptoCipher *cipher, const StegoEncryptionHeader *header) {
+    unsigned char *cursor = buffer;
+    write_uint32_big_endian(cursor, header->encrypted_section_size);
+    cursor += BMP_INT_SIZE_BYTES;
+    memcpy(cursor, header->salt, CRYPTO_SALT_SIZE);
+    cursor += CRYPTO_SALT_SIZE;
+    *cursor = header->iv_length | (header->raw_key ? STEGOBMP_IV_LENGTH_RAW_KEY_FLAG : 0) |
+              (header->recipient_count ? STEGOBMP_IV_LENGTH_RECIPIENTS_FLAG : 0);
+    cursor += CRYPTO_METADATA_IV_LEN_SIZE;
+    memcpy(cursor, header->iv, header->iv_length);
+    cursor += header->iv_length;
+    if (header->recipient_count) {
+        *cursor = (unsigned char) header->recipient_count;
+        cursor += STEGOBMP_RECIPIENT_COUNT_SIZE;
+        for (size_t i = 0; i < header->recipient_count; i++) {
+            memcpy(cursor, header->recipients[i].salt, CRYPTO_WRAP_SALT_SIZE);
+            cursor += CRYPTO_WRAP_SALT_SIZE;
+            memcpy(cursor, header->recipients[i].wrapped_key, (size_t) cipher->key_length + CRYPTO_WRAP_OVERHEAD);
+            cursor += (size_t) cipher->key_length + CRYPTO_WRAP_OVERHEAD;
+        }
+    }
+    if (cipher->aead) {
+        memcpy(cursor, header->key_check, CRYPTO_KEY_CHECK_SIZE);
+        cursor += CRYPTO_KEY_CHECK_SIZE;
+    }
+    write_uint32_big_endian(cursor, header->cipher_length);
+    cursor += BMP_INT_SIZE_BYTES;
+    return (size_t) (cursor - buffer);
+}
+
+int stego_encryption_header_parse(const unsigned char *buffer, const size_t available, const CryptoCipher *cipher, StegoEncryptionHeader *header, size_t *header_size) {
+    memset(header, 0, sizeof(*header));
+
+    size_t offset = BMP_INT_SIZE_BYTES + CRYPTO_SALT_SIZE + CRYPTO_METADATA_IV_LEN_SIZE;
+    if (available < offset) {
+        return 1;
+    }
+    header->encrypted_section_size = read_uint32_big_endian(buffer);
+    memcpy(header->salt, buffer + BMP_INT_SIZE_BYTES, CRYPTO_SALT_SIZE);
+
+    const unsigned char iv_byte = buffer[BMP_INT_SIZE_BYTES + CRYPTO_SALT_SIZE];
+    header->raw_key = (iv_byte & STEGOBMP_IV_LENGTH_RAW_KEY_FLAG) != 0;
+    const int has_recipients = (iv_byte & STEGOBMP_IV_LENGTH_RECIPIENTS_FLAG) != 0;
+    header->iv_length = iv_byte & STEGOBMP_IV_LENGTH_MASK;
+    if (header->iv_length > CRYPTO_MAX_IV_SIZE || (header->raw_key && has_recipients) ||
+        (cipher->aead && header->iv_length != cipher->iv_length) || available < offset + header->iv_length) {
+        return 1;
+    }
+    memcpy(header->iv, buffer + offset, header->iv_length);
+    offset += header->iv_length;
+
+    if (has_recipients) {
+        if (available < offset + STEGOBMP_RECIPIENT_COUNT_SIZE) {
+            return 1;
+        }
+        header->recipient_count = buffer[offset];
+        offset += STEGOBMP_RECIPIENT_COUNT_SIZE;
+
+        const size_t slot_size = recipient_slot_size(cipher);
+        if (header->recipient_count == 0 || header->recipient_count > STEGOBMP_MAX_RECIPIENTS ||
+            available < offset + header->recipient_count * slot_size) {
+            return 1;
+        }
+        for (size_t i = 0; i < header->recipient_count; i++) {
+            memcpy(header->recipients[i].salt, buffer + offset, CRYPTO_WRAP_SALT_SIZE);
+            memcpy(header->recipients[i].wrapped_key, buffer + offset + CRYPTO_WRAP_SALT_SIZE, slot_size - CRYPTO_WRAP_SALT_SIZE);
+            offset += slot_size;
+        }
+    }
+
+    if (cipher->aead) {
+        if (available < offset + CRYPTO_KEY_CHECK_SIZE) {
+            return 1;
+        }
+        memcpy(header->key_check, buffer + offset, CRYPTO_KEY_CHECK_SIZE);
+        offset += CRYPTO_KEY_CHECK_SIZE;
+    }
+
+    if (available < offset + BMP_INT_SIZE_BYTES) {
+        return 1;
+    }
+    header->cipher_length = read_uint32_big_endian(buffer + offset);
+    offset += BMP_INT_SIZE_BYTES;
+
+    /* the outer size must cover exactly this header, the ciphertext and the tag */
+    const uint64_t expected_section_size = (uint64_t) (offset - BMP_INT_SIZE_BYTES) + header->cipher_length + (uint64_t) cipher->tag_length;
+    if ((!cipher->aead && header->cipher_length == 0) || expected_section_size != header->encrypted_section_size) {
+        return 1;
+    }
+
+    *header_size = offset;
+    return 0;
+}
+
+int stego_recipients_seal(const CryptoCipher *cipher, const StegoRecipients *recipients, StegoEncryptionHeader *header, unsigned char data_key[CRYPTO_MAX_KEY_SIZE]) {
+    if (recipients->count == 0 || recipients->count > STEGOBMP_MAX_RECIPIENTS) {
+        stego_diag_report(STEGO_DIAG_ERROR, "A payload can be sealed for 1 to %d passwords", STEGOBMP_MAX_RECIPIENTS);
+        return 1;
+    }
+    if (RAND_bytes(data_key, cipher->key_length) != 1) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not generate data key");
+        return 1;
+    }
+
+    for (size_t i = 0; i < recipients->count; i++) {
+        StegoRecipientSlot *slot = &header->recipients[i];
+        if (RAND_bytes(slot->salt, CRYPTO_WRAP_SALT_SIZE) != 1) {
+            stego_diag_report(STEGO_DIAG_ERROR, "Could not generate salt for key wrapping");
+            return 1;
+        }
+        if (crypto_key_wrap(recipients->passwords[i], slot->salt, data_key, (size_t) cipher->key_length, slot->wrapped_key) < 0) {
+            return 1;
+        }
+    }
+    header->recipient_count = recipients->count;
+    header->raw_key = 0;
+    return 0;
+}
+
+int stego_resolve_secret(const CryptoCipher *cipher, const StegoEncryptionHeader *header, const CryptoSecret *secret,
+                         unsigned char data_key[CRYPTO_MAX_KEY_SIZE], CryptoSecret *resolved) {
+    if (header->recipient_count == 0) {
+        if (header->raw_key != crypto_secret_is_raw_key(secret)) {
+            if (header->raw_key) {
+                stego_diag_report(STEGO_DIAG_ERROR, "Payload was encrypted with a supplied key, extract it with -key or -keyfile");
+            } else {
+                stego_diag_report(STEGO_DIAG_ERROR, "Payload was encrypted with a password-derived key, extract it with -pass");
+            }
+            return 1;
+        }
+        *resolved = *secret;
+        return 0;
+    }
 
-    return buffer;
+    if (crypto_secret_is_raw_key(secret)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Payload was sealed for recipient passwords, extract it with -pass");
+        return 1;
+    }
+
+    /* only the small wrapped keys are tried, never the bulk ciphertext */
+    const size_t wrapped_length = (size_t) cipher->key_length + CRYPTO_WRAP_OVERHEAD;
+    for (size_t i = 0; i < header->recipient_count; i++) {
+        const StegoRecipientSlot *slot = &header->recipients[i];
+        if (crypto_key_unwrap(secret->password, slot->salt, slot->wrapped_key, wrapped_length, data_key) == cipher->key_length) {
+            *resolved = crypto_secret_key(data_key, (size_t) cipher->key_length);
+            return 0;
+        }
+    }
+
+    stego_diag_report(STEGO_DIAG_ERROR, "Password does not open any of the %zu recipient slots", header->recipient_count);
+    return 1;
+}
+
+size_t stego_payload_trailer_size(const uint32_t size_field) {
+    return (size_field & STEGOBMP_SIZE_CHECKSUM_FLAG) ? STEGOBMP_CHECKSUM_SIZE : 0;
+}
+
+int stego_payload_checksum_matches(const unsigned char *payload_buffer, const size_t payload_size, const size_t checked_size) {
+    if (payload_size < STEGOBMP_CHECKSUM_SIZE || checked_size > payload_size - STEGOBMP_CHECKSUM_SIZE) {
+        return 0;
+    }
+    return stegobmp_crc32c(0, payload_buffer, checked_size) == read_uint32_big_endian(payload_buffer + checked_size);
 }
 
 void write_uint32_big_endian(unsigned char *buffer, const uint32_t value) {
@@ -79,24 +285,31 @@ uint32_t read_uint32_big_endian(const unsigned char *buffer) {
 }
 
 int save_extracted_file(const unsigned char *payload_buffer, const size_t extracted_payload_size, const char * output_filename) {
-    const size_t file_size = read_uint32_big_endian(payload_buffer);
+    const uint32_t size_field = read_uint32_big_endian(payload_buffer);
+    const size_t file_size = size_field & STEGOBMP_SIZE_LENGTH_MASK;
     size_t extension_start_index = 0;
     size_t extension_length = 0;
 
     if (file_size == 0) {
-        printf("Error: Size of extracted file is zero\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Size of extracted file is zero");
         return 1;
     }
 
     if (!stego_payload_locate_extension(payload_buffer, extracted_payload_size, file_size, &extension_start_index, &extension_length)) {
-        printf("Error: Extracted payload does not have a valid extension (extension or null terminator missing)\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Extracted payload does not have a valid extension (extension or null terminator missing)");
+        return 1;
+    }
+
+    if ((size_field & STEGOBMP_SIZE_CHECKSUM_FLAG) &&
+        !stego_payload_checksum_matches(payload_buffer, extracted_payload_size, extension_start_index + extension_length + STEGOBMP_NULL_CHARACTER_SIZE)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Extracted payload is corrupt (CRC32C checksum mismatch)");
         return 1;
     }
 
     const size_t output_filename_base_length = strlen(output_filename);
     char *extension = malloc(extension_length + STEGOBMP_NULL_CHARACTER_SIZE);
     if (!extension) {
-        printf("Error: Could not allocate memory for extension buffer\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate memory for extension buffer");
         return 1;
     }
     memcpy(extension, payload_buffer + extension_start_index, extension_length);
@@ -106,7 +319,7 @@ int save_extracted_file(const unsigned char *payload_buffer, const size_t extrac
 
     char *final_output_filename = malloc(output_filename_base_length + output_filename_extension_length + STEGOBMP_NULL_CHARACTER_SIZE);
     if (!final_output_filename) {
-        printf("Error: Could not allocate memory for output filename\n");
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not allocate memory for output filename");
         free(extension);
         return 1;
     }
@@ -116,20 +329,26 @@ int save_extracted_file(const unsigned char *payload_buffer, const size_t extrac
 
     FILE *file = fopen(final_output_filename, BMP_FILE_MODE_WRITE_BINARY);
     if (!file) {
-        printf("Error: Could not open output file %s\n", final_output_filename);
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not open output file %s", final_output_filename);
         free(extension);
         free(final_output_filename);
         return 1;
     }
 
-    if (fwrite(payload_buffer + BMP_INT_SIZE_BYTES, BMP_BYTE_SIZE, file_size, file) != file_size) {
-        printf("Error: Could not write to output file %s\n", final_output_filename);
+    StegoPayloadWriter writer;
+    if (stego_payload_writer_init(&writer, file, (size_field & STEGOBMP_SIZE_COMPRESSED_FLAG) != 0) ||
+        stego_payload_writer_write(&writer, payload_buffer + BMP_INT_SIZE_BYTES, file_size) ||
+        stego_payload_writer_finish(&writer)) {
+        stego_diag_report(STEGO_DIAG_ERROR, "Could not write to output file %s", final_output_filename);
+        stego_payload_writer_free(&writer);
         fclose(file);
+        remove(final_output_filename);
         free(extension);
         free(final_output_filename);
         return 1;
     }
 
+    stego_payload_writer_free(&writer);
     fclose(file);
     free(extension);
     free(final_output_filename);
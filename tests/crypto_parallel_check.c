@@ -0,0 +1,94 @@
+#include "../include/crypto/crypto.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Decrypts a payload of more than two CRYPTO_PARALLEL_MIN_CHUNK_SIZE chunks for
+ * every legacy cipher and mode on one thread and on several, and exits non-zero
+ * unless every run returns the same bytes as the single-threaded one and the
+ * original plain text.
+ */
+
+#define CHECK_PAYLOAD_SIZE (9 * 1024 * 1024 + 3)
+
+static const char *check_methods[] = { "aes128", "aes256", "3des" };
+static const char *check_modes[] = { "ecb", "cbc", "cfb", "ofb" };
+static const int check_thread_counts[] = { 2, 3, 7 };
+
+static int check_cipher(const CryptoCipher *cipher, const unsigned char *plain_text, unsigned char *ciphertext,
+                        unsigned char *reference, unsigned char *decrypted) {
+    static const unsigned char key[CRYPTO_MAX_KEY_SIZE] = "stegobmp parallel decrypt check";
+    const CryptoSecret secret = crypto_secret_key(key, (size_t) cipher->key_length);
+    unsigned char iv[CRYPTO_MAX_IV_SIZE];
+    for (size_t i = 0; i < sizeof(iv); i++) {
+        iv[i] = (unsigned char) (i * 17u + 5u);
+    }
+    const unsigned char *cipher_iv = cipher->iv_length > 0 ? iv : NULL;
+
+    const int cipher_length = crypto_cipher_encrypt(cipher, plain_text, CHECK_PAYLOAD_SIZE, &secret, NULL, cipher_iv, ciphertext);
+    if (cipher_length < 0) {
+        printf("%s-%s: encryption failed\n", cipher->method, cipher->mode);
+        return 1;
+    }
+
+    const int reference_length = crypto_cipher_decrypt_parallel(cipher, ciphertext, cipher_length, &secret, NULL, cipher_iv, reference, 1);
+    if (reference_length != CHECK_PAYLOAD_SIZE || memcmp(reference, plain_text, CHECK_PAYLOAD_SIZE) != 0) {
+        printf("%s-%s: single-threaded decryption does not round trip\n", cipher->method, cipher->mode);
+        return 1;
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(check_thread_counts) / sizeof(check_thread_counts[0]); i++) {
+        memset(decrypted, 0, CHECK_PAYLOAD_SIZE);
+        const int length = crypto_cipher_decrypt_parallel(cipher, ciphertext, cipher_length, &secret, NULL, cipher_iv, decrypted, check_thread_counts[i]);
+        if (length != reference_length || memcmp(decrypted, reference, (size_t) reference_length) != 0) {
+            printf("%s-%s: %d threads differ from one thread\n", cipher->method, cipher->mode, check_thread_counts[i]);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(void) {
+    unsigned char *plain_text = malloc(CHECK_PAYLOAD_SIZE);
+    unsigned char *ciphertext = malloc(CHECK_PAYLOAD_SIZE + CRYPTO_MAX_BLOCK_SIZE);
+    unsigned char *reference = malloc(CHECK_PAYLOAD_SIZE + CRYPTO_MAX_BLOCK_SIZE);
+    unsigned char *decrypted = malloc(CHECK_PAYLOAD_SIZE + CRYPTO_MAX_BLOCK_SIZE);
+    if (!plain_text || !ciphertext || !reference || !decrypted) {
+        printf("Could not allocate the check buffers\n");
+        free(plain_text);
+        free(ciphertext);
+        free(reference);
+        free(decrypted);
+        return 1;
+    }
+    for (size_t i = 0; i < CHECK_PAYLOAD_SIZE; i++) {
+        plain_text[i] = (unsigned char) (i * 31u + (i >> 8));
+    }
+
+    int failures = 0;
+    for (size_t m = 0; m < sizeof(check_methods) / sizeof(check_methods[0]); m++) {
+        for (size_t n = 0; n < sizeof(check_modes) / sizeof(check_modes[0]); n++) {
+            const CryptoCipher *cipher = crypto_cipher_lookup(check_methods[m], check_modes[n]);
+            if (!cipher) {
+                printf("%s-%s: unsupported by this OpenSSL, skipped\n", check_methods[m], check_modes[n]);
+                continue;
+            }
+            failures += check_cipher(cipher, plain_text, ciphertext, reference, decrypted);
+        }
+    }
+
+    free(plain_text);
+    free(ciphertext);
+    free(reference);
+    free(decrypted);
+
+    if (failures) {
+        printf("Parallel decrypt check failed (%d mismatches)\n", failures);
+        return 1;
+    }
+    printf("Parallel decrypt check passed\n");
+    return 0;
+}
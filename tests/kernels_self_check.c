@@ -0,0 +1,17 @@
+#include "../include/stegobmp/stegobmp_kernels.h"
+
+#include <stdio.h>
+
+/*
+ * Checks every SIMD kernel table and CRC32C implementation this CPU supports
+ * against the scalar ones, independently of the table the dispatcher picks,
+ * and exits non-zero when any of them disagrees.
+ */
+int main(void) {
+    if (stegobmp_kernels_self_check()) {
+        printf("Kernel self check failed\n");
+        return 1;
+    }
+    printf("Kernel self check passed (dispatching %s kernels)\n", stegobmp_kernels_level_name(stegobmp_kernels_level()));
+    return 0;
+}